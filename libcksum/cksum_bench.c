@@ -0,0 +1,138 @@
+/*-----------------------------------------------------------------------------
+ * file:  cksum_bench.c
+ *
+ * Description:
+ *
+ * Microbenchmark for the checksum kernels.  Every kernel is first checked
+ * bit for bit against the original 16 bit loop over random buffers of
+ * every length and alignment, then timed at 64, 576 and 1500 bytes.
+ *
+ *---------------------------------------------------------------------------*/
+
+#include <stdio.h>
+#include <stdlib.h>
+#include <string.h>
+#include <time.h>
+#include <arpa/inet.h>
+
+#include "inet_cksum.h"
+
+#define MAX_LEN 2048
+#define BENCH_BYTES (256u << 20)   /* bytes summed per measurement */
+
+static const char *names[] = { "scalar", "sse2", "avx2" };
+static const int sizes[] = { 64, 576, 1500 };
+
+/* the loop cksum() used before this library */
+static uint16_t cksum_ref(const void *_data, int len)
+{
+    const uint8_t *data = _data;
+    uint32_t sum;
+
+    for (sum = 0;len >= 2; data += 2, len -= 2)
+        sum += data[0] << 8 | data[1];
+    if (len > 0)
+        sum += data[0] << 8;
+    while (sum > 0xffff)
+        sum = (sum >> 16) + (sum & 0xffff);
+    sum = htons (~sum);
+    return sum ? sum : 0xffff;
+}
+
+static double now_ns(void)
+{
+    struct timespec ts;
+
+    clock_gettime(CLOCK_MONOTONIC, &ts);
+    return ts.tv_sec * 1e9 + ts.tv_nsec;
+}
+
+static int verify(const unsigned char *buf)
+{
+    int len, off, round;
+
+    for (round = 0; round < 4; round++)
+    {
+        for (off = 0; off < 16; off++)
+        {
+            for (len = 0; len <= MAX_LEN - 16; len++)
+            {
+                const unsigned char *p = buf + round * 4 + off;
+                uint16_t want = cksum_ref(p, len);
+                uint16_t got = inet_cksum(p, len);
+                uint16_t split = inet_csum_finish(
+                    inet_csum_partial(p + (len / 4) * 2, len - (len / 4) * 2,
+                    inet_csum_partial(p, (len / 4) * 2, 0)));
+
+                if (got != want || split != want)
+                {
+                    fprintf(stderr, "%s: mismatch len %d off %d: "
+                            "%04x %04x want %04x\n", inet_csum_kernel(),
+                            len, off, got, split, want);
+                    return -1;
+                }
+            }
+        }
+    }
+    return 0;
+}
+
+int main(int argc, char **argv)
+{
+    static unsigned char buf[MAX_LEN + 64];
+    volatile uint16_t sink = 0;
+    double t, ref_ns[3];
+    unsigned int i, iters;
+    int k, s;
+
+    srand(time(NULL));
+    for (i = 0; i < sizeof(buf); i++)
+    { buf[i] = rand(); }
+
+    /* all-ones data is the worst case for carries */
+    memset(buf + MAX_LEN - 256, 0xff, 256);
+
+    printf("default kernel: %s\n\n", inet_csum_kernel());
+    printf("%-8s %6s %10s %10s %8s\n", "kernel", "bytes", "ns/call",
+           "GB/s", "speedup");
+
+    for (s = 0; s < 3; s++)
+    {
+        iters = BENCH_BYTES / sizes[s];
+        t = now_ns();
+        for (i = 0; i < iters; i++)
+        { sink += cksum_ref(buf + (i & 7), sizes[s]); }
+        ref_ns[s] = (now_ns() - t) / iters;
+        printf("%-8s %6d %10.1f %10.2f %8s\n", "ref16", sizes[s], ref_ns[s],
+               sizes[s] / ref_ns[s], "1.00x");
+    }
+
+    for (k = 0; k < 3; k++)
+    {
+        if (inet_csum_set_kernel(names[k]) != 0)
+        {
+            printf("%-8s (not supported on this CPU)\n", names[k]);
+            continue;
+        }
+        if (verify(buf) != 0)
+        { return 1; }
+
+        for (s = 0; s < 3; s++)
+        {
+            double ns;
+
+            iters = BENCH_BYTES / sizes[s];
+            t = now_ns();
+            for (i = 0; i < iters; i++)
+            { sink += inet_cksum(buf + (i & 7), sizes[s]); }
+            ns = (now_ns() - t) / iters;
+            printf("%-8s %6d %10.1f %10.2f %7.2fx\n", names[k], sizes[s], ns,
+                   sizes[s] / ns, ref_ns[s] / ns);
+        }
+    }
+
+    (void)sink;
+    (void)argc;
+    (void)argv;
+    return 0;
+}
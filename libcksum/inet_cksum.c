@@ -0,0 +1,250 @@
+/*-----------------------------------------------------------------------------
+ * file:  inet_cksum.c
+ *
+ * Description:
+ *
+ * Internet checksum kernels and run time dispatch.
+ *
+ * The one's complement sum is independent of byte order as long as every
+ * word is loaded the same way, and a 32 bit word is congruent to the sum
+ * of its two 16 bit halves modulo 0xffff.  So each kernel adds 32 bit
+ * native loads into 64 bit lanes and the result is folded once at the
+ * end.  A 64 bit accumulator cannot overflow for any buffer below 16 GB.
+ *
+ *---------------------------------------------------------------------------*/
+
+#include <string.h>
+
+#include "inet_cksum.h"
+
+#if defined(__GNUC__) && (defined(__x86_64__) || defined(__i386__))
+#define INET_CSUM_X86 1
+#include <immintrin.h>
+#endif
+
+typedef uint64_t (*csum_fn)(const unsigned char *, size_t, uint64_t);
+
+/*---------------------------------------------------------------------
+ * Method: csum_tail(..)
+ * Scope:  Local
+ *
+ * Add the last 0-3 bytes.  A trailing odd byte is padded with a zero in
+ * memory order, which is what the 16 bit loop did.
+ *
+ *---------------------------------------------------------------------*/
+
+static uint64_t csum_tail(const unsigned char *p, size_t len, uint64_t sum)
+{
+    uint16_t w;
+
+    if (len >= 2)
+    {
+        memcpy(&w, p, 2);
+        sum += w;
+        p += 2;
+        len -= 2;
+    }
+    if (len)
+    {
+        w = 0;
+        memcpy(&w, p, 1);
+        sum += w;
+    }
+    return sum;
+}
+
+static uint64_t csum_scalar(const unsigned char *p, size_t len, uint64_t sum)
+{
+    uint32_t w0, w1, w2, w3;
+    uint64_t s0 = 0, s1 = 0;
+
+    for (; len >= 16; p += 16, len -= 16)
+    {
+        memcpy(&w0, p, 4);
+        memcpy(&w1, p + 4, 4);
+        memcpy(&w2, p + 8, 4);
+        memcpy(&w3, p + 12, 4);
+        s0 += (uint64_t)w0 + w1;
+        s1 += (uint64_t)w2 + w3;
+    }
+    for (; len >= 4; p += 4, len -= 4)
+    {
+        memcpy(&w0, p, 4);
+        s0 += w0;
+    }
+    return csum_tail(p, len, sum + s0 + s1);
+}
+
+#ifdef INET_CSUM_X86
+
+__attribute__((target("sse2")))
+static uint64_t csum_sse2(const unsigned char *p, size_t len, uint64_t sum)
+{
+    __m128i zero = _mm_setzero_si128();
+    __m128i a0 = zero, a1 = zero;
+    uint64_t lanes[2];
+
+    for (; len >= 32; p += 32, len -= 32)
+    {
+        __m128i v0 = _mm_loadu_si128((const __m128i *)p);
+        __m128i v1 = _mm_loadu_si128((const __m128i *)(p + 16));
+        a0 = _mm_add_epi64(a0, _mm_unpacklo_epi32(v0, zero));
+        a1 = _mm_add_epi64(a1, _mm_unpackhi_epi32(v0, zero));
+        a0 = _mm_add_epi64(a0, _mm_unpacklo_epi32(v1, zero));
+        a1 = _mm_add_epi64(a1, _mm_unpackhi_epi32(v1, zero));
+    }
+    if (len >= 16)
+    {
+        __m128i v0 = _mm_loadu_si128((const __m128i *)p);
+        a0 = _mm_add_epi64(a0, _mm_unpacklo_epi32(v0, zero));
+        a1 = _mm_add_epi64(a1, _mm_unpackhi_epi32(v0, zero));
+        p += 16;
+        len -= 16;
+    }
+
+    _mm_storeu_si128((__m128i *)lanes, _mm_add_epi64(a0, a1));
+    return csum_scalar(p, len, sum + lanes[0] + lanes[1]);
+}
+
+__attribute__((target("avx2")))
+static uint64_t csum_avx2(const unsigned char *p, size_t len, uint64_t sum)
+{
+    __m256i zero = _mm256_setzero_si256();
+    __m256i a0 = zero, a1 = zero;
+    uint64_t lanes[4];
+
+    for (; len >= 64; p += 64, len -= 64)
+    {
+        __m256i v0 = _mm256_loadu_si256((const __m256i *)p);
+        __m256i v1 = _mm256_loadu_si256((const __m256i *)(p + 32));
+        a0 = _mm256_add_epi64(a0, _mm256_unpacklo_epi32(v0, zero));
+        a1 = _mm256_add_epi64(a1, _mm256_unpackhi_epi32(v0, zero));
+        a0 = _mm256_add_epi64(a0, _mm256_unpacklo_epi32(v1, zero));
+        a1 = _mm256_add_epi64(a1, _mm256_unpackhi_epi32(v1, zero));
+    }
+    if (len >= 32)
+    {
+        __m256i v0 = _mm256_loadu_si256((const __m256i *)p);
+        a0 = _mm256_add_epi64(a0, _mm256_unpacklo_epi32(v0, zero));
+        a1 = _mm256_add_epi64(a1, _mm256_unpackhi_epi32(v0, zero));
+        p += 32;
+        len -= 32;
+    }
+
+    _mm256_storeu_si256((__m256i *)lanes, _mm256_add_epi64(a0, a1));
+    sum += lanes[0] + lanes[1] + lanes[2] + lanes[3];
+    return csum_scalar(p, len, sum);
+}
+
+#endif /* INET_CSUM_X86 */
+
+/* ----------------------------------------------------------------------------
+ * Kernel table and dispatch
+ * -------------------------------------------------------------------------- */
+
+struct csum_kernel
+{
+    const char *name;
+    csum_fn fn;
+};
+
+static const struct csum_kernel kernels[] =
+{
+#ifdef INET_CSUM_X86
+    { "avx2", csum_avx2 },
+    { "sse2", csum_sse2 },
+#endif
+    { "scalar", csum_scalar }
+};
+
+#define N_KERNELS (sizeof(kernels) / sizeof(kernels[0]))
+
+static uint64_t csum_resolve(const unsigned char *, size_t, uint64_t);
+
+static const struct csum_kernel *active;
+static csum_fn csum_impl = csum_resolve;
+
+static int kernel_usable(const struct csum_kernel *k)
+{
+#ifdef INET_CSUM_X86
+    __builtin_cpu_init();
+    if (k->fn == csum_avx2)
+    { return __builtin_cpu_supports("avx2"); }
+    if (k->fn == csum_sse2)
+    { return __builtin_cpu_supports("sse2"); }
+#endif
+    return 1;   /* scalar */
+}
+
+/* first call picks the best usable kernel; racing threads pick the same */
+static uint64_t csum_resolve(const unsigned char *p, size_t len, uint64_t sum)
+{
+    size_t i;
+
+    for (i = 0; i < N_KERNELS; i++)
+    {
+        if (kernel_usable(&kernels[i]))
+        { break; }
+    }
+    active = &kernels[i];
+    csum_impl = kernels[i].fn;
+    return csum_impl(p, len, sum);
+}
+
+const char *inet_csum_kernel(void)
+{
+    if (!active)
+    { csum_resolve((const unsigned char *)"", 0, 0); }
+    return active->name;
+}
+
+int inet_csum_set_kernel(const char *name)
+{
+    size_t i;
+
+    for (i = 0; i < N_KERNELS; i++)
+    {
+        if (!strcmp(kernels[i].name, name) && kernel_usable(&kernels[i]))
+        {
+            active = &kernels[i];
+            csum_impl = kernels[i].fn;
+            return 0;
+        }
+    }
+    return -1;
+}
+
+/* ----------------------------------------------------------------------------
+ * Public entry points
+ * -------------------------------------------------------------------------- */
+
+uint64_t inet_csum_partial(const void *data, size_t len, uint64_t sum)
+{
+    uint64_t s = csum_impl((const unsigned char *)data, len, 0);
+
+    sum += s;
+    if (sum < s)
+    { sum++; }
+    return sum;
+}
+
+uint16_t inet_csum_fold(uint64_t sum)
+{
+    sum = (sum >> 32) + (sum & 0xffffffffu);
+    sum = (sum >> 32) + (sum & 0xffffffffu);
+    sum = (sum >> 16) + (sum & 0xffff);
+    sum = (sum >> 16) + (sum & 0xffff);
+    return (uint16_t)sum;
+}
+
+uint16_t inet_csum_finish(uint64_t sum)
+{
+    uint16_t c = (uint16_t)~inet_csum_fold(sum);
+
+    return c ? c : 0xffff;
+}
+
+uint16_t inet_cksum(const void *data, size_t len)
+{
+    return inet_csum_finish(csum_impl((const unsigned char *)data, len, 0));
+}
@@ -0,0 +1,45 @@
+/*-----------------------------------------------------------------------------
+ * file:  inet_cksum.h
+ *
+ * Description:
+ *
+ * Internet (RFC 1071) checksum shared by the router (nat_code) and the
+ * reliable transport library (reliable_lab2).
+ *
+ * Sums are accumulated on 32 bit loads into a 64 bit register.  On x86
+ * an SSE2 or AVX2 kernel is chosen at run time from the CPU features,
+ * with a portable scalar kernel as fallback.  All kernels give the same
+ * result as the historical 16 bit loop in cksum().
+ *
+ *---------------------------------------------------------------------------*/
+
+#ifndef INET_CKSUM_H
+#define INET_CKSUM_H
+
+#include <stddef.h>
+#include <stdint.h>
+
+/* Add len bytes to a running sum.  The sum is kept in the native byte
+   order of the loads and is only meaningful to the functions below.  Every
+   buffer but the last must have an even length. */
+uint64_t inet_csum_partial(const void *data, size_t len, uint64_t sum);
+
+/* Fold a running sum to 16 bits (not complemented). */
+uint16_t inet_csum_fold(uint64_t sum);
+
+/* Complement a running sum into a checksum ready to be stored in a header
+   (network byte order).  Like cksum(), a result of 0 is returned as
+   0xffff. */
+uint16_t inet_csum_finish(uint64_t sum);
+
+/* Checksum of a single buffer, identical to the old cksum(). */
+uint16_t inet_cksum(const void *data, size_t len);
+
+/* Name of the kernel in use ("scalar", "sse2" or "avx2"). */
+const char *inet_csum_kernel(void);
+
+/* Force a kernel by name, for benchmarking.  Returns 0 on success, -1 if
+   the kernel is unknown or the CPU cannot run it. */
+int inet_csum_set_kernel(const char *name);
+
+#endif /* -- INET_CKSUM_H -- */
@@ -6,31 +6,48 @@
 #include <pthread.h>
 #include <sched.h>
 #include <string.h>
+#include <stddef.h>
 #include "sr_arpcache.h"
 #include "sr_router.h"
 #include "sr_if.h"
 #include "sr_protocol.h"
-#include "sr_rt.h"
+#include "sr_fib.h"
+#include "sr_epoch.h"
 #include "sr_utils.h"
 
 #ifndef IPV4_HDR_LEN
 #define IPV4_HDR_LEN 4
 #endif
+/* Largest frame that can be queued: the rest of the pool buffer holds its
+   struct sr_packet (2048 - 56 keeps the node pointer-aligned). */
+#define ARPQ_FRAME_MAX (SR_POOL_BUFSZ - sizeof(struct sr_packet))
+static void arpcache_arm(struct sr_arpcache *cache, struct sr_timer *t,
+                         unsigned int ms);
+
 /* 
-  This function gets called every second. For each request sent out, we keep
-  checking whether we should resend an request or destroy the arp request.
+  This function gets called from each request's timer. It resends the
+  request or, after SR_ARPREQ_TRIES, gives up and destroys it.
   See the comments in the header file for an idea of what it should look like.
 */
 
-void send_arp_request(struct sr_instance *sr, struct sr_arpreq *req) {
+/* ARP request for ip, broadcast or, to refresh a known entry, unicast
+   to mac */
+static void send_arp(struct sr_instance *sr, uint32_t ip,
+                     const unsigned char *mac) {
   
-  struct sr_rt* routing_index = check_rtable(sr, req->ip);
-  if (routing_index) {
-    char* next_hop_if = routing_index->interface; 
-    struct sr_if* out_if = sr_get_interface(sr, next_hop_if);
+  sr_epoch_enter();
+  const struct sr_fib* fib = sr_fib_current(sr);
+  const struct sr_fib_nh* nh = sr_fib_lookup(fib, ip);
+  if (nh) {
+    struct sr_if* out_if = sr_fib_iface(fib, nh);
+    char* next_hop_if = out_if->name;
     
+    /* build the request straight into one buffer */
+    uint8_t* new_arp_packet = sr_pool_get(sr->pool);
+    sr_ethernet_hdr_t* new_eth_header = (sr_ethernet_hdr_t*)new_arp_packet;
+    sr_arp_hdr_t* new_arp_header = (sr_arp_hdr_t*)(new_eth_header+1);
+
     /* generate arp request header*/
-    sr_arp_hdr_t* new_arp_header = (sr_arp_hdr_t*)malloc(sizeof(sr_arp_hdr_t));
     new_arp_header->ar_op = htons(arp_op_request);
     new_arp_header->ar_hrd = htons(arp_hrd_ethernet);
     new_arp_header->ar_pro = htons(ethertype_ip);
@@ -39,82 +56,294 @@ void send_arp_request(struct sr_instance *sr, struct sr_arpreq *req) {
     
     new_arp_header->ar_sip = out_if->ip;
     memcpy(new_arp_header->ar_sha, out_if->addr, ETHER_ADDR_LEN); 
-    new_arp_header->ar_tip = htonl(req->ip);
-    memset(new_arp_header->ar_tha, 0xff, ETHER_ADDR_LEN); 
+    new_arp_header->ar_tip = htonl(ip);
     
     /* generate ethernet frame header */
-    sr_ethernet_hdr_t *new_eth_header = (sr_ethernet_hdr_t*)malloc(sizeof(sr_ethernet_hdr_t));
     new_eth_header->ether_type = htons(ethertype_arp);
     memcpy(new_eth_header->ether_shost, out_if->addr, ETHER_ADDR_LEN);
-    memset(new_eth_header->ether_dhost, 0xff, ETHER_ADDR_LEN);
+    if (mac) {
+      memcpy(new_arp_header->ar_tha, mac, ETHER_ADDR_LEN); 
+      memcpy(new_eth_header->ether_dhost, mac, ETHER_ADDR_LEN);
+    } else {
+      memset(new_arp_header->ar_tha, 0xff, ETHER_ADDR_LEN); 
+      memset(new_eth_header->ether_dhost, 0xff, ETHER_ADDR_LEN);
+    }
 
-    /* generate arp packet*/
-    uint8_t* new_arp_packet = (uint8_t*)malloc(sizeof(sr_ethernet_hdr_t)+sizeof(sr_arp_hdr_t));
-    memcpy(new_arp_packet, new_eth_header, sizeof(sr_ethernet_hdr_t));
-    memcpy(new_arp_packet+sizeof(sr_ethernet_hdr_t), new_arp_header, sizeof(sr_arp_hdr_t));
-    
     /* send arp packet*/   
     sr_send_packet(sr, new_arp_packet, sizeof(sr_arp_hdr_t)+sizeof(sr_ethernet_hdr_t), next_hop_if);
-    free(new_arp_packet);
-    free(new_arp_header);
-    free(new_eth_header);
+    sr_pool_put(sr->pool, new_arp_packet);
   }
+  sr_epoch_exit();
+}
+
+void send_arp_request(struct sr_instance *sr, struct sr_arpreq *req) {
+  sr_trace(sr_trace_arp_req, req->times_sent, htonl(req->ip));
+  sr->cache.arp_sent++;
+  send_arp(sr, req->ip, NULL);
 }
 
 void handle_arpreq(struct sr_instance *sr, struct sr_arpreq* req) {
-  time_t now = time(NULL);
-  if (difftime(now, req->sent) >1) {
-    if (req->times_sent >= 5) {
-      /* send ICMP host unreachable to all the waiting pkts sources */
-      struct sr_packet* waiting_pkt = req->packets;  
-      while (waiting_pkt) { 
-        send_icmp(sr, waiting_pkt->buf, waiting_pkt->len, waiting_pkt->iface, 3, 1);
-        waiting_pkt = waiting_pkt->next;
-      }
-      sr_arpreq_destroy(&sr->cache, req);
-    } else {
-      send_arp_request(sr, req); 
-      req->sent = time(NULL);
-      req->times_sent++;
+  if (req->times_sent >= SR_ARPREQ_TRIES) {
+    /* send ICMP host unreachable to all the waiting pkts sources */
+    struct sr_packet* waiting_pkt = req->packets;  
+    while (waiting_pkt) { 
+      send_icmp(sr, waiting_pkt->buf, waiting_pkt->len,
+                sr_get_interface(sr, waiting_pkt->iface), 3, 1);
+      waiting_pkt = waiting_pkt->next;
     }
-  }  
+    sr_arpreq_destroy(&sr->cache, req);
+  } else {
+    send_arp_request(sr, req); 
+    req->sent = time(NULL);
+    req->times_sent++;
+    arpcache_arm(&sr->cache, &req->timer, sr->cache.retry_ms);
+  }
 }
 
-void sr_arpcache_sweepreqs(struct sr_instance *sr) { 
-    /* Fill this in */
-  struct sr_arpreq* req_pt = sr->cache.requests;
-  while (req_pt) {
-    handle_arpreq(sr, req_pt); 
-    req_pt = req_pt->next;
-  }  
+static void arpreq_timer(struct sr_timer *t, void *sr) {
+  handle_arpreq((struct sr_instance *)sr,
+      (struct sr_arpreq *)((char *)t - offsetof(struct sr_arpreq, timer)));
 }
 
 /* You should not need to touch the rest of this code. */
 
-/* Checks if an IP->MAC mapping is in the cache. IP is in network byte order.
-   You must free the returned structure if it is not NULL. */
-struct sr_arpentry *sr_arpcache_lookup(struct sr_arpcache *cache, uint32_t ip) {
-    pthread_mutex_lock(&(cache->lock));
+/* Home slot of ip. */
+static unsigned int arpcache_slot(const struct sr_arptable *t, uint32_t ip) {
+    return (ip * 0x9e3779b1u) >> (32 - t->bits);
+}
+
+/* The valid entry for ip, or the empty slot where it would go. */
+static struct sr_arpentry *arpcache_probe(struct sr_arptable *t, uint32_t ip) {
+    unsigned int i = arpcache_slot(t, ip);
+    
+    while (t->entries[i].valid && t->entries[i].ip != ip) {
+        i = (i + 1) & t->mask;
+    }
+    return &(t->entries[i]);
+}
+
+/* Writers bracket every change to entries a reader could be copying. */
+static void arpcache_write_begin(struct sr_arpcache *cache) {
+    cache->seq++;
+    __sync_synchronize();   /* odd seq before the entries change */
+}
+
+static void arpcache_write_end(struct sr_arpcache *cache) {
+    __sync_synchronize();   /* entries done before seq is even again */
+    cache->seq++;
+}
+
+/* Expiry timer of an entry, found again by IP since entries move. */
+struct arpcache_expiry {
+    struct sr_timer timer;
+    uint32_t ip;
+    uint64_t confirmed;         /* tick of the last reply */
+    unsigned int tries;         /* refreshes sent since */
+};
+
+/* Arms t ms from now. The wheel counts from the tick it last ran, which
+   lags while the timer thread sleeps, so the lag is added; the thread is
+   woken if t is due before it planned to look. Called with lock held. */
+static void arpcache_arm(struct sr_arpcache *cache, struct sr_timer *t,
+                         unsigned int ms) {
+    uint64_t now = sr_timer_clock(&(cache->timers));
+    
+    if (now > cache->timers.now) {
+        ms += now - cache->timers.now;
+    }
+    sr_timer_add(&(cache->timers), t, ms);
+    if (t->expires < cache->wake_at) {
+        cache->wake_at = t->expires;
+        pthread_cond_signal(&(cache->wake));
+    }
+}
+
+/* Empties slot i, moving later entries of the probe run back so every
+   entry stays reachable from its home slot. */
+static void arpcache_remove(struct sr_arpcache *cache, struct sr_arptable *t,
+                            unsigned int i) {
+    unsigned int j = i, home;
     
-    struct sr_arpentry *entry = NULL, *copy = NULL;
+    if (t->entries[i].expiry) {
+        sr_timer_del(&(cache->timers), t->entries[i].expiry);
+        free(t->entries[i].expiry);
+    }
+    arpcache_write_begin(cache);
+    for (;;) {
+        j = (j + 1) & t->mask;
+        if (!t->entries[j].valid) {
+            break;
+        }
+        home = arpcache_slot(t, t->entries[j].ip);
+        /* j may fill the hole unless its home lies cyclically in (i, j] */
+        if (((j - home) & t->mask) >= ((j - i) & t->mask)) {
+            t->entries[i] = t->entries[j];
+            i = j;
+        }
+    }
+    t->entries[i].valid = 0;
+    arpcache_write_end(cache);
+    cache->count--;
+    cache->gen++;
+}
+
+/* Makes room for one entry: CLOCK second chance over the slots. */
+static void arpcache_evict(struct sr_arpcache *cache, struct sr_arptable *t) {
+    struct sr_arpentry *e;
     
-    int i;
-    for (i = 0; i < SR_ARPCACHE_SZ; i++) {
-        if ((cache->entries[i].valid) && (cache->entries[i].ip == ip)) {
-            entry = &(cache->entries[i]);
+    while (cache->count) {
+        e = &(t->entries[cache->hand]);
+        if (e->valid && !e->ref) {
+            arpcache_remove(cache, t, cache->hand);
+            cache->evicted++;
+            return;
         }
+        e->ref = 0;
+        cache->hand = (cache->hand + 1) & t->mask;
     }
+}
+
+/* Adds or refreshes ip, evicting when full. A new entry is not marked
+   referenced: one that is never looked up is the first to go. */
+static struct sr_arpentry *arpcache_put(struct sr_arpcache *cache,
+                                        struct sr_arptable *t,
+                                        const unsigned char *mac,
+                                        uint32_t ip, time_t added) {
+    struct sr_arpentry *e = arpcache_probe(t, ip);
     
-    /* Must return a copy b/c another thread could jump in and modify
-       table after we return. */
-    if (entry) {
-        copy = (struct sr_arpentry *) malloc(sizeof(struct sr_arpentry));
-        memcpy(copy, entry, sizeof(struct sr_arpentry));
+    if (!e->valid && cache->count >= cache->capacity) {
+        arpcache_evict(cache, t);
+        e = arpcache_probe(t, ip);
     }
-        
-    pthread_mutex_unlock(&(cache->lock));
+    arpcache_write_begin(cache);
+    if (!e->valid) {
+        e->ip = ip;
+        e->ref = 0;
+        e->used = 0;
+        e->expiry = NULL;
+        e->valid = 1;
+        cache->count++;
+    }
+    memcpy(e->mac, mac, 6);
+    e->added = added;
+    arpcache_write_end(cache);
+    return e;
+}
+
+/*
+  An entry's timer. An entry lives SR_ARPCACHE_TO from its last reply.
+  The last SR_ARPCACHE_REFRESH retry intervals of that are the refresh
+  window: if the entry was looked up since the reply, a unicast request
+  goes to the cached MAC each interval, while the entry keeps being used
+  as is. A reply restarts the lifetime; without one the entry goes at
+  the end as before. The timer is not moved on a reply, it finds the new
+  time when it fires.
+*/
+static void arpcache_expire(struct sr_timer *timer, void *arg) {
+    struct sr_arpcache *cache = arg;
+    struct arpcache_expiry *x = (struct arpcache_expiry *)timer;
+    struct sr_arptable *t = cache->table;
+    struct sr_arpentry *e = arpcache_probe(t, x->ip);
+    uint64_t age = sr_timer_clock(&(cache->timers)) - x->confirmed;
+    uint64_t life = (uint64_t)(SR_ARPCACHE_TO * 1000);
+    uint64_t window = (uint64_t)cache->retry_ms * SR_ARPCACHE_REFRESH;
     
-    return copy;
+    if (!e->valid || e->expiry != timer) {
+        free(timer);    /* -- cannot happen, removal takes the timer -- */
+        return;
+    }
+    if (age >= life) {
+        arpcache_remove(cache, t, e - t->entries);
+        return;
+    }
+    if (window > life) {
+        window = life;
+    }
+    if (age < life - window) {
+        arpcache_arm(cache, timer, (unsigned int)(life - window - age));
+        return;
+    }
+    if (e->used && x->tries < SR_ARPCACHE_REFRESH && cache->sr) {
+        x->tries++;
+        sr_trace(sr_trace_arp_refresh, x->tries, htonl(x->ip));
+        send_arp(cache->sr, x->ip, e->mac);
+        if (life - age > cache->retry_ms) {
+            arpcache_arm(cache, timer, cache->retry_ms);
+            return;
+        }
+    }
+    arpcache_arm(cache, timer, (unsigned int)(life - age));
+}
+
+/* Checks if an IP->MAC mapping is in the cache. IP is in network byte order.
+   On a hit the entry is copied to *copy and 1 is returned, otherwise 0.
+   
+   Takes no lock: the copy is retried until no writer was active during it,
+   and the table cannot be freed by a resize inside the epoch section. */
+int sr_arpcache_lookup(struct sr_arpcache *cache, uint32_t ip,
+                       struct sr_arpentry *copy) {
+    unsigned int slot;
+    
+    return sr_arpcache_lookup_slot(cache, ip, copy, &slot);
+}
+
+int sr_arpcache_lookup_slot(struct sr_arpcache *cache, uint32_t ip,
+                            struct sr_arpentry *copy, unsigned int *slot) {
+    struct sr_arptable *t;
+    struct sr_arpentry *entry;
+    uint32_t seq;
+    unsigned int i, n;
+    
+    sr_epoch_enter();
+    do {
+        while ((seq = cache->seq) & 1) {
+            /* a writer is moving entries, which takes a few stores */
+        }
+        __sync_synchronize();   /* seq before the entries */
+        t = cache->table;
+        entry = NULL;
+        i = arpcache_slot(t, ip);
+        /* bounded: a torn view might have no empty slot */
+        for (n = 0; n <= t->mask && t->entries[i].valid; n++) {
+            if (t->entries[i].ip == ip) {
+                entry = &(t->entries[i]);
+                memcpy(copy, entry, sizeof(struct sr_arpentry));
+                *slot = i;
+                break;
+            }
+            i = (i + 1) & t->mask;
+        }
+        __sync_synchronize();   /* entries before seq again */
+    } while (cache->seq != seq);
+    
+    /* only hints for eviction and refresh, so a lost update does no harm */
+    if (entry && !entry->ref) {
+        entry->ref = 1;
+    }
+    if (entry && !entry->used) {
+        entry->used = 1;
+    }
+    sr_epoch_exit();
+    
+    return entry != NULL;
+}
+
+/* A slot gone stale through a resize may be out of range or name another
+   entry; the bits are only hints, so that is checked for range only. */
+void sr_arpcache_touch(struct sr_arpcache *cache, unsigned int slot) {
+    struct sr_arptable *t = cache->table;
+    struct sr_arpentry *entry;
+    
+    if (slot > t->mask) {
+        return;
+    }
+    entry = &(t->entries[slot]);
+    if (!entry->ref) {
+        entry->ref = 1;
+    }
+    if (!entry->used) {
+        entry->used = 1;
+    }
 }
 
 /* Adds an ARP request to the ARP request queue. If the request is already on
@@ -138,23 +367,28 @@ struct sr_arpreq *sr_arpcache_queuereq(struct sr_arpcache *cache,
         }
     }
     
-    /* If the IP wasn't found, add it */
+    /* If the IP wasn't found, add it. The caller sends the first request
+       when times_sent is 0, the timer the ones after */
     if (!req) {
         req = (struct sr_arpreq *) calloc(1, sizeof(struct sr_arpreq));
         req->ip = ip;
         req->next = cache->requests;
         cache->requests = req;
+        sr_timer_init(&(req->timer), arpreq_timer, cache->sr);
+        arpcache_arm(cache, &(req->timer), cache->retry_ms);
     }
     
     /* Add the packet to the list of packets for this request */
-    if (packet && packet_len && iface) {
-        struct sr_packet *new_pkt = (struct sr_packet *)malloc(sizeof(struct sr_packet));
+    if (packet && packet_len && iface && packet_len <= ARPQ_FRAME_MAX) {
+        /* The list node sits in the tail of the frame's own pool buffer */
+        uint8_t *buf = sr_pool_get(cache->pool);
+        struct sr_packet *new_pkt = (struct sr_packet *)(buf + ARPQ_FRAME_MAX);
         
-        new_pkt->buf = (uint8_t *)malloc(packet_len);
+        new_pkt->buf = buf;
         memcpy(new_pkt->buf, packet, packet_len);
         new_pkt->len = packet_len;
-		new_pkt->iface = (char *)malloc(sr_IFACE_NAMELEN);
         strncpy(new_pkt->iface, iface, sr_IFACE_NAMELEN);
+        new_pkt->iface[sr_IFACE_NAMELEN - 1] = '\0';
         new_pkt->next = req->packets;
         req->packets = new_pkt;
     }
@@ -190,18 +424,30 @@ struct sr_arpreq *sr_arpcache_insert(struct sr_arpcache *cache,
         }
         prev = req;
     }
-    
-    int i;
-    for (i = 0; i < SR_ARPCACHE_SZ; i++) {
-        if (!(cache->entries[i].valid))
-            break;
+    if (req) {
+        sr_timer_del(&(cache->timers), &(req->timer));
     }
     
-    if (i != SR_ARPCACHE_SZ) {
-        memcpy(cache->entries[i].mac, mac, 6);
-        cache->entries[i].ip = ip;
-        cache->entries[i].added = time(NULL);
-        cache->entries[i].valid = 1;
+    /* a refresh reply with the same MAC leaves cached results valid;
+       evicting to make room bumps gen on its own */
+    struct sr_arpentry *e = arpcache_probe(cache->table, ip);
+    int changed = !e->valid || memcmp(e->mac, mac, ETHER_ADDR_LEN) != 0;
+    
+    e = arpcache_put(cache, cache->table, mac, ip, time(NULL));
+    struct arpcache_expiry *x = (struct arpcache_expiry *)e->expiry;
+    if (!x && (x = malloc(sizeof(struct arpcache_expiry)))) {
+        sr_timer_init(&(x->timer), arpcache_expire, cache);
+        x->ip = ip;
+        e->expiry = &(x->timer);
+        arpcache_arm(cache, e->expiry, 0);  /* -- works out when it is due -- */
+    }
+    if (x) {
+        x->confirmed = sr_timer_clock(&(cache->timers));
+        x->tries = 0;
+    }
+    e->used = 0;
+    if (changed) {
+        cache->gen++;
     }
     
     pthread_mutex_unlock(&(cache->lock));
@@ -215,6 +461,7 @@ void sr_arpreq_destroy(struct sr_arpcache *cache, struct sr_arpreq *entry) {
     pthread_mutex_lock(&(cache->lock));
     
     if (entry) {
+        sr_timer_del(&(cache->timers), &(entry->timer));
         struct sr_arpreq *req, *prev = NULL, *next = NULL; 
         for (req = cache->requests; req != NULL; req = req->next) {
             if (req == entry) {                
@@ -236,11 +483,7 @@ void sr_arpreq_destroy(struct sr_arpcache *cache, struct sr_arpreq *entry) {
         
         for (pkt = entry->packets; pkt; pkt = nxt) {
             nxt = pkt->next;
-            if (pkt->buf)
-                free(pkt->buf);
-            if (pkt->iface)
-                free(pkt->iface);
-            free(pkt);
+            sr_pool_put(cache->pool, pkt->buf);
         }
         
         free(entry);
@@ -254,62 +497,148 @@ void sr_arpcache_dump(struct sr_arpcache *cache) {
     fprintf(stderr, "\nMAC            IP         ADDED                      VALID\n");
     fprintf(stderr, "-----------------------------------------------------------\n");
     
-    int i;
-    for (i = 0; i < SR_ARPCACHE_SZ; i++) {
-        struct sr_arpentry *cur = &(cache->entries[i]);
+    pthread_mutex_lock(&(cache->lock));
+    unsigned int i;
+    for (i = 0; i <= cache->table->mask; i++) {
+        struct sr_arpentry *cur = &(cache->table->entries[i]);
         unsigned char *mac = cur->mac;
+        if (!cur->valid) {
+            continue;
+        }
         fprintf(stderr, "%.1x%.1x%.1x%.1x%.1x%.1x   %.8x   %.24s   %d\n", mac[0], mac[1], mac[2], mac[3], mac[4], mac[5], ntohl(cur->ip), ctime(&(cur->added)), cur->valid);
     }
+    fprintf(stderr, "%u of %u entries, %lu evicted\n", cache->count,
+            cache->capacity, cache->evicted);
+    pthread_mutex_unlock(&(cache->lock));
     
     fprintf(stderr, "\n");
 }
 
+/* The new table is filled privately and then swapped in; readers still
+   on the old one keep it until they leave their epoch section. */
+int sr_arpcache_resize(struct sr_arpcache *cache, unsigned int capacity) {
+    struct sr_arptable *old, *t;
+    unsigned int bits = 4, i;
+    
+    if (capacity == 0) {
+        capacity = 1;
+    }
+    /* -- at most half full keeps probe runs short -- */
+    while ((1u << bits) < 2 * capacity && bits < 31) {
+        bits++;
+    }
+    
+    t = calloc(1, sizeof(struct sr_arptable) +
+                  (sizeof(struct sr_arpentry) << bits));
+    if (!t) {
+        return -1;
+    }
+    t->bits = bits;
+    t->mask = (1u << bits) - 1;
+    t->entries = (struct sr_arpentry *)(t + 1);
+    
+    pthread_mutex_lock(&(cache->lock));
+    old = cache->table;
+    cache->capacity = capacity;
+    cache->count = 0;
+    cache->hand = 0;
+    for (i = 0; old && i <= old->mask; i++) {
+        if (old->entries[i].valid) {
+            struct sr_arpentry *e = arpcache_put(cache, t, old->entries[i].mac,
+                                                 old->entries[i].ip,
+                                                 old->entries[i].added);
+            e->ref = old->entries[i].ref;
+            e->used = old->entries[i].used;
+            e->expiry = old->entries[i].expiry;
+        }
+    }
+    __sync_synchronize();   /* filled before anyone can load it */
+    cache->table = t;
+    cache->gen++;
+    pthread_mutex_unlock(&(cache->lock));
+    
+    if (old) {
+        sr_epoch_retire(old, free);
+    }
+    return 0;
+}
+
 /* Initialize table + table lock. Returns 0 on success. */
 int sr_arpcache_init(struct sr_arpcache *cache) {  
-    /* Seed RNG to kick out a random entry if all entries full. */
-    srand(time(NULL));
-    
-    /* Invalidate all entries */
-    memset(cache->entries, 0, sizeof(cache->entries));
+    cache->table = NULL;
+    cache->seq = 0;
+    cache->capacity = 0;
+    cache->count = 0;
+    cache->hand = 0;
+    cache->evicted = 0;
+    cache->arp_sent = 0;
+    cache->arp_suppressed = 0;
     cache->requests = NULL;
+    cache->pool = NULL;
+    cache->gen = 1;
+    cache->sr = NULL;
+    cache->retry_ms = SR_ARPREQ_RETRY;
+    sr_timer_wheel_init(&(cache->timers));
+    cache->wake_at = 0;
     
     /* Acquire mutex lock */
     pthread_mutexattr_init(&(cache->attr));
     pthread_mutexattr_settype(&(cache->attr), PTHREAD_MUTEX_RECURSIVE);
     int success = pthread_mutex_init(&(cache->lock), &(cache->attr));
     
+    /* Timer thread waits on the same clock as the wheel */
+    pthread_condattr_t cattr;
+    pthread_condattr_init(&cattr);
+    pthread_condattr_setclock(&cattr, CLOCK_MONOTONIC);
+    if (success == 0) {
+        success = pthread_cond_init(&(cache->wake), &cattr);
+    }
+    pthread_condattr_destroy(&cattr);
+    
+    /* Empty table of the default size */
+    if (success == 0 && sr_arpcache_resize(cache, SR_ARPCACHE_SZ) != 0) {
+        success = -1;
+    }
     return success;
 }
 
 /* Destroys table + table lock. Returns 0 on success. */
 int sr_arpcache_destroy(struct sr_arpcache *cache) {
+    unsigned int i;
+    for (i = 0; cache->table && i <= cache->table->mask; i++) {
+        free(cache->table->entries[i].expiry);
+    }
+    pthread_cond_destroy(&(cache->wake));
+    free(cache->table);
+    cache->table = NULL;
     return pthread_mutex_destroy(&(cache->lock)) && pthread_mutexattr_destroy(&(cache->attr));
 }
 
-/* Thread which sweeps through the cache and invalidates entries that were added
-   more than SR_ARPCACHE_TO seconds ago. */
+/* Thread which runs the cache's timers: entry expiry and request resends.
+   Between them it sleeps on wake, at most a second, and is woken early
+   when a timer is armed for before then. */
 void *sr_arpcache_timeout(void *sr_ptr) {
     struct sr_instance *sr = sr_ptr;
     struct sr_arpcache *cache = &(sr->cache);
+    struct timespec until;
+    unsigned int ms;
     
+    pthread_mutex_lock(&(cache->lock));
     while (1) {
-        sleep(1.0);
+        sr_timer_run(&(cache->timers), sr_timer_clock(&(cache->timers)));
         
-        pthread_mutex_lock(&(cache->lock));
-    
-        time_t curtime = time(NULL);
-        
-        int i;    
-        for (i = 0; i < SR_ARPCACHE_SZ; i++) {
-            if ((cache->entries[i].valid) && (difftime(curtime,cache->entries[i].added) > SR_ARPCACHE_TO)) {
-                cache->entries[i].valid = 0;
-            }
+        ms = sr_timer_next(&(cache->timers), 1000);
+        cache->wake_at = cache->timers.now + ms;
+        clock_gettime(CLOCK_MONOTONIC, &until);
+        until.tv_sec += ms / 1000;
+        until.tv_nsec += (ms % 1000) * 1000000L;
+        if (until.tv_nsec >= 1000000000L) {
+            until.tv_sec++;
+            until.tv_nsec -= 1000000000L;
         }
-        
-        sr_arpcache_sweepreqs(sr);
-
-        pthread_mutex_unlock(&(cache->lock));
+        pthread_cond_timedwait(&(cache->wake), &(cache->lock), &until);
     }
+    pthread_mutex_unlock(&(cache->lock));
     
     return NULL;
 }
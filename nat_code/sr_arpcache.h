@@ -9,11 +9,8 @@
    --
 
    # When sending packet to next_hop_ip
-   entry = arpcache_lookup(next_hop_ip)
-
-   if entry:
+   if arpcache_lookup(next_hop_ip, &entry):
        use next_hop_ip->mac mapping in entry to send the packet
-       free entry
    else:
        req = arpcache_queuereq(next_hop_ip, packet, len)
        handle_arpreq(req)
@@ -50,17 +47,11 @@
 
    To meet the guidelines in the assignment (ARP requests are sent every second
    until we send 5 ARP requests, then we send ICMP host unreachable back to
-   all packets waiting on this ARP request), you must fill out the following
-   function that is called every second and is defined in sr_arpcache.c:
-
-   void sr_arpcache_sweepreqs(struct sr_instance *sr) {
-       for each request on sr->cache.requests:
-           handle_arpreq(request)
-   }
-
-   Since handle_arpreq as defined in the comments above could destroy your
-   current request, make sure to save the next pointer before calling
-   handle_arpreq when traversing through the ARP requests linked list.
+   all packets waiting on this ARP request), every request carries a timer
+   on the cache's timer wheel that calls handle_arpreq when it is due; the
+   interval is retry_ms, one second unless changed. Entries expire by timer
+   as well, so the cache thread only wakes for what is due; one still in
+   use is refreshed with unicast requests before it would expire.
  */
 
 #ifndef SR_ARPCACHE_H
@@ -70,22 +61,31 @@
 #include <time.h>
 #include <pthread.h>
 #include "sr_if.h"
+#include "sr_pool.h"
+#include "sr_timer.h"
 
-#define SR_ARPCACHE_SZ    100  
+#define SR_ARPCACHE_SZ    1024 /* default capacity, see sr_arpcache_resize */
 #define SR_ARPCACHE_TO    15.0
+#define SR_ARPREQ_RETRY   1000 /* ms between requests, default */
+#define SR_ARPREQ_TRIES   5
+#define SR_ARPCACHE_REFRESH 3  /* unicast refreshes before an entry in use expires */
 
+/* Lives in the tail of the pool buffer its buf points at; freed with it */
 struct sr_packet {
-    uint8_t *buf;               /* A raw Ethernet frame, presumably with the dest MAC empty */
+    uint8_t *buf;               /* A raw Ethernet frame, presumably with the dest MAC empty (pool buffer) */
     unsigned int len;           /* Length of raw Ethernet frame */
-    char *iface;                /* The outgoing interface */
+    char iface[sr_IFACE_NAMELEN]; /* The outgoing interface */
     struct sr_packet *next;
 };
 
 struct sr_arpentry {
     unsigned char mac[6]; 
+    uint8_t ref;                /* used since the clock hand last passed */
+    uint8_t used;               /* used since the last reply */
     uint32_t ip;                /* IP addr in network byte order */
     time_t added;         
     int valid;
+    struct sr_timer *expiry;    /* due SR_ARPCACHE_TO after added */
 };
 
 struct sr_arpreq {
@@ -97,18 +97,60 @@ struct sr_arpreq {
                                    should update this. */
     struct sr_packet *packets;  /* List of pkts waiting on this req to finish */
     struct sr_arpreq *next;
+    struct sr_timer timer;      /* next send, or giving up */
+};
+
+/* Open addressing table keyed by IP, linear probing, at most half full.
+   Removal shifts the rest of the probe run back, so there are no
+   tombstones. */
+struct sr_arptable {
+    unsigned int bits;          /* 1 << bits slots */
+    unsigned int mask;
+    struct sr_arpentry *entries; /* allocated right after the table */
 };
 
+/* When capacity entries are valid an insert evicts one chosen by CLOCK:
+   the hand skips entries looked up since it last passed, clearing their
+   ref, and takes the first one that was not.
+
+   Lookups take no lock.  Writers hold lock and make seq odd while they
+   change entries; a reader copies an entry between two equal, even reads
+   of seq.  A resize swaps in a new table and retires the old one through
+   sr_epoch. */
 struct sr_arpcache {
-    struct sr_arpentry entries[SR_ARPCACHE_SZ];
+    struct sr_arptable *volatile table;
+    volatile uint32_t seq;
+    unsigned int capacity;      /* most valid entries */
+    unsigned int count;
+    unsigned int hand;
+    unsigned long evicted;
+    unsigned long arp_sent;       /* broadcast requests, first and resent */
+    unsigned long arp_suppressed; /* misses that joined a pending request */
     struct sr_arpreq *requests;
     pthread_mutex_t lock;
     pthread_mutexattr_t attr;
+    struct sr_pool *pool;       /* buffers for queued packets, borrowed */
+    volatile uint32_t gen;      /* bumped when an entry is added, changes
+                                   MAC, is removed or moves */
+    struct sr_timer_wheel timers; /* under lock */
+    pthread_cond_t wake;        /* timer thread waits here until wake_at */
+    uint64_t wake_at;
+    unsigned int retry_ms;
+    struct sr_instance *sr;     /* for request timers */
 };
 
-/* Checks if an IP->MAC mapping is in the cache. IP is in network byte order. 
-   You must free the returned structure if it is not NULL. */
-struct sr_arpentry *sr_arpcache_lookup(struct sr_arpcache *cache, uint32_t ip);
+/* Checks if an IP->MAC mapping is in the cache. IP is in network byte order.
+   On a hit the entry is copied to *entry and 1 is returned, otherwise 0. */
+int sr_arpcache_lookup(struct sr_arpcache *cache, uint32_t ip,
+                       struct sr_arpentry *entry);
+
+/* sr_arpcache_lookup that also gives the entry's slot.  Entries only move
+   when gen changes, so while gen is unchanged sr_arpcache_touch(slot)
+   marks the entry in use as a lookup would, without the probe.  Callers
+   of sr_arpcache_touch are in an epoch section. */
+int sr_arpcache_lookup_slot(struct sr_arpcache *cache, uint32_t ip,
+                            struct sr_arpentry *entry, unsigned int *slot);
+void sr_arpcache_touch(struct sr_arpcache *cache, unsigned int slot);
 
 /* Adds an ARP request to the ARP request queue. If the request is already on
    the queue, adds the packet to the linked list of packets for this sr_arpreq
@@ -138,6 +180,11 @@ void sr_arpreq_destroy(struct sr_arpcache *cache, struct sr_arpreq *entry);
 /* Prints out the ARP table. */
 void sr_arpcache_dump(struct sr_arpcache *cache);
 
+/* Changes how many entries the cache holds and rehashes the valid ones;
+   when shrinking, the surplus is evicted as on insert. Returns 0 on
+   success, -1 if out of memory (the old table is kept). */
+int sr_arpcache_resize(struct sr_arpcache *cache, unsigned int capacity);
+
 void send_arp_request(struct sr_instance *sr, struct sr_arpreq *req);
 /* You shouldn't have to call these methods--they're already called in the
    starter code for you. The init call is a constructor, the destroy call is
@@ -0,0 +1,445 @@
+/*-----------------------------------------------------------------------------
+ * file:  sr_bench.c
+ *
+ * Description:
+ *
+ * In-process benchmark of the forwarding path.  Frames from a pcap file
+ * (as written by sr -l) are fed straight into sr_handlepacket() in a
+ * tight loop; sr_send_packet is replaced by a counting sink, so there is
+ * no socket or server in the measurement:
+ *
+ *   sr_bench -N 2000000 capture.pcap
+ *   sr_bench -n capture.pcap               (through the NAT)
+ *
+ * The router's interfaces are set up the way sr_vnsd presents them:
+ * sw0-<if> entries of IP_CONFIG plus whatever else the rtable uses.
+ * Every frame enters on one interface (by default the one the default
+ * route leaves through).  IPv4 frames are cut or padded to their IP
+ * length, since sr_dump() truncates long frames and the router rejects
+ * Ethernet padding.  ARP requests the router sends are answered by the
+ * sink between frames.
+ *
+ *---------------------------------------------------------------------------*/
+
+#include <stdio.h>
+#include <stdlib.h>
+#include <assert.h>
+#include <string.h>
+#include <unistd.h>
+#include <time.h>
+#include <pthread.h>
+
+#include <sys/types.h>
+#include <netinet/in.h>
+#include <arpa/inet.h>
+
+#include "sr_protocol.h"
+#include "sr_router.h"
+#include "sr_if.h"
+#include "sr_rt.h"
+#include "sr_nat.h"
+#include "sr_arpcache.h"
+#include "sr_dumper.h"
+
+#define BENCH_COUNT     1000000
+#define BENCH_HIST_NS   10              /* histogram bucket width */
+#define BENCH_HIST_N    20000           /* up to 200 us */
+#define BENCH_ARP_MAX   64
+
+struct bench_frame
+{
+    uint8_t* buf;
+    unsigned int len;
+};
+
+/* -- the sink, see sr_send_packet below -- */
+static struct
+{
+    pthread_mutex_t lock;
+    const char* in;                     /* ingress interface */
+    volatile unsigned long forwarded;
+    volatile unsigned long returned;    /* back out the ingress, e.g. ICMP */
+    volatile unsigned long arp;
+    uint32_t arp_ip[BENCH_ARP_MAX];     /* requests to answer */
+    char arp_if[BENCH_ARP_MAX][sr_IFACE_NAMELEN];
+    uint8_t arp_mac[BENCH_ARP_MAX][ETHER_ADDR_LEN];
+    unsigned int n_arp;
+} sink = { PTHREAD_MUTEX_INITIALIZER };
+
+static unsigned long hist[BENCH_HIST_N + 1];
+
+static uint64_t now_ns(void)
+{
+    struct timespec ts;
+
+    clock_gettime(CLOCK_MONOTONIC, &ts);
+    return (uint64_t)ts.tv_sec * 1000000000ull + ts.tv_nsec;
+} /* -- now_ns -- */
+
+/*---------------------------------------------------------------------
+ * The part of sr_vns_comm.c the router calls, minus the server.
+ *---------------------------------------------------------------------*/
+
+int sr_send_packet(struct sr_instance* sr, uint8_t* buf, unsigned int len,
+                   const char* iface)
+{
+    sr_ethernet_hdr_t* e = (sr_ethernet_hdr_t*)buf;
+    sr_arp_hdr_t* a = (sr_arp_hdr_t*)(e + 1);
+
+    if (len < sizeof(*e))
+    { return -1; }
+
+    if (e->ether_type == htons(ethertype_arp))
+    {
+        __sync_fetch_and_add(&sink.arp, 1);
+        if (len >= sizeof(*e) + sizeof(*a) &&
+            a->ar_op == htons(arp_op_request))
+        {
+            pthread_mutex_lock(&sink.lock);
+            if (sink.n_arp < BENCH_ARP_MAX)
+            {
+                sink.arp_ip[sink.n_arp] = a->ar_tip;
+                memcpy(sink.arp_mac[sink.n_arp], a->ar_sha, ETHER_ADDR_LEN);
+                strncpy(sink.arp_if[sink.n_arp++], iface, sr_IFACE_NAMELEN - 1);
+            }
+            pthread_mutex_unlock(&sink.lock);
+        }
+    }
+    else if (!strcmp(iface, sink.in))
+    { __sync_fetch_and_add(&sink.returned, 1); }
+    else
+    { __sync_fetch_and_add(&sink.forwarded, 1); }
+    return 0;
+} /* -- sr_send_packet -- */
+
+int sr_send_flush(struct sr_instance* sr)
+{ return 0; }
+
+struct sr_txq* sr_txq_create(void)
+{ return 0; }
+
+void sr_txq_destroy(struct sr_txq* txq)
+{ }
+
+void sr_send_thread_queue(struct sr_txq* txq)
+{ }
+
+int sr_verify_routing_table(struct sr_instance* sr)
+{ return 0; }
+
+/* Answer the ARP requests the router made since the last call. */
+static void bench_arp_replies(struct sr_instance* sr)
+{
+    struct
+    {
+        sr_ethernet_hdr_t e;
+        sr_arp_hdr_t a;
+    } __attribute__ ((packed)) m;
+    struct sr_if* ifp;
+    unsigned int i, n;
+
+    if (sink.n_arp == 0)
+    { return; }
+
+    pthread_mutex_lock(&sink.lock);
+    n = sink.n_arp;
+    for (i = 0; i < n; i++)
+    {
+        if ((ifp = sr_get_interface(sr, sink.arp_if[i])) == 0)
+        { continue; }
+        memset(&m, 0, sizeof(m));
+        memcpy(m.e.ether_dhost, sink.arp_mac[i], ETHER_ADDR_LEN);
+        m.e.ether_shost[0] = 0x02;
+        m.e.ether_shost[1] = 0x56;
+        memcpy(m.e.ether_shost + 2, &sink.arp_ip[i], 4);
+        m.e.ether_type = htons(ethertype_arp);
+        m.a.ar_hrd = htons(arp_hrd_ethernet);
+        m.a.ar_pro = htons(ethertype_ip);
+        m.a.ar_hln = ETHER_ADDR_LEN;
+        m.a.ar_pln = 4;
+        m.a.ar_op = htons(arp_op_reply);
+        memcpy(m.a.ar_sha, m.e.ether_shost, ETHER_ADDR_LEN);
+        m.a.ar_sip = sink.arp_ip[i];
+        memcpy(m.a.ar_tha, ifp->addr, ETHER_ADDR_LEN);
+        m.a.ar_tip = ifp->ip;
+        sr_handlepacket(sr, (uint8_t*)&m, sizeof(m), sink.arp_if[i]);
+    }
+    sink.n_arp = 0;
+    pthread_mutex_unlock(&sink.lock);
+} /* -- bench_arp_replies -- */
+
+/*---------------------------------------------------------------------
+ * Method: bench_interfaces(..)
+ * Scope:  Local
+ *
+ * Same interfaces, addresses and MACs as sr_vnsd presents.
+ *
+ *---------------------------------------------------------------------*/
+
+static void bench_interfaces(struct sr_instance* sr, const char* ip_config,
+                             struct sr_rt* routes)
+{
+    FILE* fp;
+    char line[BUFSIZ], name[64], ip[32];
+    unsigned char mac[ETHER_ADDR_LEN];
+    struct in_addr addr;
+    struct sr_rt* rt;
+    unsigned int n = 0;
+
+    memset(mac, 0, sizeof(mac));
+    mac[0] = 0x02;
+
+    if ((fp = fopen(ip_config, "r")) != 0)
+    {
+        while (fgets(line, sizeof(line), fp))
+        {
+            if (sscanf(line, "%63s %31s", name, ip) != 2 ||
+                inet_aton(ip, &addr) == 0 || strncmp(name, "sw0-", 4) ||
+                n == SR_IF_MAX)
+            { continue; }
+            sr_add_interface(sr, name + 4);
+            mac[5] = (unsigned char)++n;
+            sr_set_ether_addr(sr, mac);
+            sr_set_ether_ip(sr, addr.s_addr);
+        }
+        fclose(fp);
+    }
+
+    for (rt = routes; rt; rt = rt->next)
+    {
+        if (sr_get_interface(sr, rt->interface) || n == SR_IF_MAX)
+        { continue; }
+        sr_add_interface(sr, rt->interface);
+        mac[5] = (unsigned char)(n + 1);
+        sr_set_ether_addr(sr, mac);
+        sr_set_ether_ip(sr, htonl(0x0afe0001 | (n << 8)));  /* 10.254.n.1 */
+        n++;
+    }
+    sr_index_interfaces(sr);
+} /* -- bench_interfaces -- */
+
+/*---------------------------------------------------------------------
+ * Method: bench_load(..)
+ * Scope:  Local
+ *
+ *---------------------------------------------------------------------*/
+
+static struct bench_frame* bench_load(const char* path, const uint8_t* mac,
+                                      unsigned int* n_frames)
+{
+    FILE* fp;
+    struct pcap_file_header fh;
+    struct pcap_sf_pkthdr ph;
+    struct bench_frame* frames = 0;
+    sr_ethernet_hdr_t* e;
+    sr_ip_hdr_t* ip;
+    uint8_t buf[65536];
+    unsigned int n = 0, cap = 0, caplen, len;
+    int swap;
+
+    if ((fp = fopen(path, "rb")) == 0)
+    {
+        perror("fopen(..):sr_bench");
+        return 0;
+    }
+    if (fread(&fh, sizeof(fh), 1, fp) != 1 ||
+        (fh.magic != TCPDUMP_MAGIC && fh.magic != 0xd4c3b2a1))
+    {
+        fprintf(stderr, "sr_bench: %s is not a pcap file\n", path);
+        fclose(fp);
+        return 0;
+    }
+    swap = fh.magic != TCPDUMP_MAGIC;
+
+    while (fread(&ph, sizeof(ph), 1, fp) == 1)
+    {
+        caplen = swap ? __builtin_bswap32(ph.caplen) : ph.caplen;
+        if (caplen > sizeof(buf) || fread(buf, 1, caplen, fp) != caplen)
+        { break; }
+
+        e = (sr_ethernet_hdr_t*)buf;
+        ip = (sr_ip_hdr_t*)(e + 1);
+        if (caplen < sizeof(*e))
+        { continue; }
+        len = caplen;
+        if (e->ether_type == htons(ethertype_ip))
+        {
+            if (caplen < sizeof(*e) + sizeof(*ip))
+            { continue; }
+            len = sizeof(*e) + ntohs(ip->ip_len);
+            if (len > 1514)
+            { continue; }
+            if (len > caplen)
+            { memset(buf + caplen, 0, len - caplen); }
+        }
+        else if (e->ether_type != htons(ethertype_arp))
+        { continue; }
+        if (!(e->ether_dhost[0] & 1))
+        { memcpy(e->ether_dhost, mac, ETHER_ADDR_LEN); }
+
+        if (n == cap)
+        {
+            cap = cap ? cap * 2 : 1024;
+            frames = (struct bench_frame*)
+                realloc(frames, cap * sizeof(struct bench_frame));
+            assert(frames);
+        }
+        frames[n].buf = (uint8_t*)malloc(len);
+        memcpy(frames[n].buf, buf, len);
+        frames[n++].len = len;
+    }
+    fclose(fp);
+
+    if (n == 0)
+    {
+        fprintf(stderr, "sr_bench: no IPv4 or ARP frames in %s\n", path);
+        return 0;
+    }
+    *n_frames = n;
+    return frames;
+} /* -- bench_load -- */
+
+static unsigned long bench_percentile(unsigned long n, double q)
+{
+    unsigned long want = (unsigned long)(n * q), seen = 0;
+    unsigned int i;
+
+    for (i = 0; i <= BENCH_HIST_N; i++)
+    {
+        seen += hist[i];
+        if (seen > want)
+        { return (unsigned long)i * BENCH_HIST_NS; }
+    }
+    return (unsigned long)BENCH_HIST_N * BENCH_HIST_NS;
+} /* -- bench_percentile -- */
+
+static void usage(char* argv0)
+{
+    printf("Format: %s [-h] [-n] [-N packets] [-r rtable] [-c IP_CONFIG] \n",
+           argv0);
+    printf("           [-i ingress interface] <pcap file> \n");
+} /* -- usage -- */
+
+int main(int argc, char** argv)
+{
+    char* rtable = "rtable";
+    char* ip_config = "IP_CONFIG";
+    char* ingress = 0;
+    unsigned long count = BENCH_COUNT, i, t_max = 0;
+    int use_nat = 0, c;
+    struct sr_instance sr;
+    struct sr_nat nat;
+    struct sr_rt* rt;
+    struct sr_if* in;
+    struct bench_frame* frames;
+    unsigned int n_frames, k;
+    uint8_t scratch[1514];
+    uint64_t t0, t1, start, total;
+
+    while ((c = getopt(argc, argv, "hnN:r:c:i:")) != EOF)
+    {
+        switch (c)
+        {
+            case 'n':
+                use_nat = 1;
+                break;
+            case 'N':
+                count = strtoul(optarg, 0, 10);
+                break;
+            case 'r':
+                rtable = optarg;
+                break;
+            case 'c':
+                ip_config = optarg;
+                break;
+            case 'i':
+                ingress = optarg;
+                break;
+            default:
+                usage(argv[0]);
+                return c == 'h' ? 0 : 2;
+        }
+    }
+    if (optind != argc - 1)
+    {
+        usage(argv[0]);
+        return 2;
+    }
+
+    /* -- a router with no server behind it, see sr_main.c -- */
+    memset(&sr, 0, sizeof(sr));
+    sr.sockfd = -1;
+    pthread_mutex_init(&sr.rt_lock, 0);
+    pthread_mutex_init(&sr.tx_lock, 0);
+    if (sr_rt_read(rtable, &rt) != 0)
+    { return 1; }
+    bench_interfaces(&sr, ip_config, rt);
+    sr_rt_free(rt);
+    if (sr_load_rt(&sr, rtable) != 0)
+    { return 1; }
+    sr_init(&sr);
+    if (use_nat)
+    {
+        memset(&nat, 0, sizeof(nat));
+        nat.icmpQueryTimeout = 60;
+        nat.tcpEstTimeout = 7440;
+        nat.tcpTransTimeout = 300;
+        sr_nat_init(&nat);
+        sr.nat = &nat;
+        nat.sr = &sr;
+    }
+
+    for (rt = sr.routing_table; rt && !ingress; rt = rt->next)
+    {
+        if (rt->mask.s_addr == 0)
+        { ingress = rt->interface; }
+    }
+    if ((in = ingress ? sr_get_interface(&sr, ingress) : sr.if_list) == 0)
+    {
+        fprintf(stderr, "sr_bench: no interface %s\n", ingress);
+        return 1;
+    }
+    sink.in = in->name;
+    if ((frames = bench_load(argv[optind], in->addr, &n_frames)) == 0)
+    { return 1; }
+
+    /* -- one pass to resolve next hops (and fill the NAT) -- */
+    for (k = 0; k < n_frames; k++)
+    {
+        memcpy(scratch, frames[k].buf, frames[k].len);
+        sr_handlepacket(&sr, scratch, frames[k].len, in->name);
+        bench_arp_replies(&sr);
+    }
+    sink.forwarded = sink.returned = sink.arp = 0;
+
+    start = now_ns();
+    for (i = 0, k = 0; i < count; i++)
+    {
+        memcpy(scratch, frames[k].buf, frames[k].len);
+        t0 = now_ns();
+        sr_handlepacket(&sr, scratch, frames[k].len, in->name);
+        t1 = now_ns() - t0;
+        hist[t1 / BENCH_HIST_NS < BENCH_HIST_N ? t1 / BENCH_HIST_NS :
+             BENCH_HIST_N]++;
+        if (t1 > t_max)
+        { t_max = t1; }
+        bench_arp_replies(&sr);
+        if (++k == n_frames)
+        { k = 0; }
+    }
+    total = now_ns() - start;
+
+    printf("%u frames from %s on %s, %s\n", n_frames, argv[optind], in->name,
+           use_nat ? "NAT" : "forwarding only");
+    printf("%lu packets in %.3f s: %.0f pps, %.1f ns/packet\n", count,
+           total * 1e-9, count / (total * 1e-9), (double)total / count);
+    printf("sr_handlepacket ns: p50 %lu p90 %lu p99 %lu p99.9 %lu max %lu\n",
+           bench_percentile(count, 0.5), bench_percentile(count, 0.9),
+           bench_percentile(count, 0.99), bench_percentile(count, 0.999),
+           t_max);
+    printf("sent: %lu forwarded, %lu back to the sender, %lu ARP\n",
+           sink.forwarded, sink.returned, sink.arp);
+
+    /* -- no sr_nat_destroy, it takes the process down with its thread -- */
+    return 0;
+} /* -- main -- */
@@ -0,0 +1,445 @@
+/*-----------------------------------------------------------------------------
+ * file:  sr_ctl.c
+ *
+ * Description:
+ *
+ * Control thread for run time route changes, see sr_ctl.h.
+ *
+ *---------------------------------------------------------------------------*/
+
+#include <stdio.h>
+#include <stdlib.h>
+#include <stdarg.h>
+#include <assert.h>
+#include <string.h>
+#include <unistd.h>
+#include <errno.h>
+#include <fcntl.h>
+#include <signal.h>
+#include <poll.h>
+
+#include <pthread.h>
+
+#include <sys/types.h>
+#include <sys/socket.h>
+#include <sys/un.h>
+#include <netinet/in.h>
+#include <arpa/inet.h>
+
+#include "sr_ctl.h"
+#include "sr_router.h"
+#include "sr_rt.h"
+#include "sr_if.h"
+#include "sr_epoch.h"
+#include "sr_fib.h"
+#include "sr_icmplim.h"
+
+#define CTL_LINE_MAX    512
+#define CTL_POLL_MS     1000    /* reclaim retired FIBs at least this often */
+
+struct sr_ctl
+{
+    struct sr_instance* sr;
+    char rtable[256];           /* file SIGHUP reloads */
+    int listen_fd;              /* -1 without a control socket */
+    int client_fd;              /* one client at a time, -1 if none */
+    char line[CTL_LINE_MAX];
+    unsigned int used;
+    pthread_t thread;
+};
+
+static int ctl_pipe[2] = { -1, -1 };   /* SIGHUP -> control thread */
+
+static void ctl_sighup(int sig)
+{
+    int saved = errno;
+    char c = 'h';
+
+    (void)sig;
+    if (write(ctl_pipe[1], &c, 1) < 0)
+    { /* already pending */ }
+    errno = saved;
+} /* -- ctl_sighup -- */
+
+static void ctl_reply(int fd, const char* fmt, ...)
+{
+    char buf[CTL_LINE_MAX];
+    va_list ap;
+    int len, off = 0, n;
+
+    va_start(ap, fmt);
+    len = vsnprintf(buf, sizeof(buf), fmt, ap);
+    va_end(ap);
+    if (len < 0)
+    { return; }
+    if (len >= (int)sizeof(buf))
+    { len = sizeof(buf) - 1; }
+
+    while (off < len)
+    {
+        n = write(fd, buf + off, len - off);
+        if (n < 0 && errno == EINTR)
+        { continue; }
+        if (n <= 0)
+        { return; }
+        off += n;
+    }
+} /* -- ctl_reply -- */
+
+static void ctl_show(struct sr_ctl* ctl, int fd)
+{
+    struct sr_rt* rt;
+    char dest[INET_ADDRSTRLEN], gw[INET_ADDRSTRLEN], mask[INET_ADDRSTRLEN];
+
+    pthread_mutex_lock(&ctl->sr->rt_lock);
+    for (rt = ctl->sr->routing_table; rt; rt = rt->next)
+    {
+        inet_ntop(AF_INET, &rt->dest, dest, sizeof(dest));
+        inet_ntop(AF_INET, &rt->gw, gw, sizeof(gw));
+        inet_ntop(AF_INET, &rt->mask, mask, sizeof(mask));
+        ctl_reply(fd, "%s %s %s %s\n", dest, gw, mask, rt->interface);
+    }
+    pthread_mutex_unlock(&ctl->sr->rt_lock);
+} /* -- ctl_show -- */
+
+/* Members of every multipath group in the current FIB with their counts. */
+static void ctl_nexthops(struct sr_ctl* ctl, int fd)
+{
+    const struct sr_fib* fib;
+    const struct sr_fib_group* g;
+    struct in_addr a;
+    char prefix[INET_ADDRSTRLEN], gw[INET_ADDRSTRLEN];
+    unsigned int i, k;
+
+    sr_epoch_enter();
+    fib = sr_fib_current(ctl->sr);
+    for (i = 0; fib && i < fib->n_groups; i++)
+    {
+        g = &fib->groups[i];
+        a.s_addr = htonl(g->prefix);
+        inet_ntop(AF_INET, &a, prefix, sizeof(prefix));
+        ctl_reply(fd, "%s/%u\n", prefix, g->len);
+        for (k = g->first; k < g->first + g->n; k++)
+        {
+            a.s_addr = htonl(fib->nh[k].gw);
+            inet_ntop(AF_INET, &a, gw, sizeof(gw));
+            ctl_reply(fd, "  %s %s %llu\n", gw, fib->ifnames[fib->nh[k].iface],
+                      (unsigned long long)fib->nh_pkts[k]);
+        }
+    }
+    sr_epoch_exit();
+} /* -- ctl_nexthops -- */
+
+/*---------------------------------------------------------------------
+ * Method: ctl_command(..)
+ * Scope:  Local
+ *
+ * Run one command line and answer on fd.
+ *
+ *---------------------------------------------------------------------*/
+
+static void ctl_command(struct sr_ctl* ctl, char* line, int fd)
+{
+    struct sr_instance* sr = ctl->sr;
+    char cmd[16], a[64], b[64], c[64], d[64];
+    struct in_addr dest, gw, mask;
+    int n, rc;
+
+    n = sscanf(line, "%15s %63s %63s %63s %63s", cmd, a, b, c, d);
+    if (n <= 0)
+    { return; }
+
+    if (strcmp(cmd, "add") == 0)
+    {
+        if (n != 5 || !inet_aton(a, &dest) || !inet_aton(b, &gw) ||
+            !inet_aton(c, &mask))
+        {
+            ctl_reply(fd, "error: usage add <dest> <gateway> <mask> <interface>\n");
+            return;
+        }
+        if (sr->if_list && !sr_get_interface(sr, d))
+        {
+            ctl_reply(fd, "error: no interface %s\n", d);
+            return;
+        }
+        pthread_mutex_lock(&sr->rt_lock);
+        sr_add_rt_entry(sr, dest, gw, mask, d);
+        sr_rt_commit(sr);
+        pthread_mutex_unlock(&sr->rt_lock);
+        ctl_reply(fd, "ok\n");
+    }
+    else if (strcmp(cmd, "del") == 0)
+    {
+        if (n < 3 || n > 4 || !inet_aton(a, &dest) || !inet_aton(b, &mask) ||
+            (n == 4 && !inet_aton(c, &gw)))
+        {
+            ctl_reply(fd, "error: usage del <dest> <mask> [gateway]\n");
+            return;
+        }
+        pthread_mutex_lock(&sr->rt_lock);
+        rc = sr_del_rt_entry(sr, dest, mask, n == 4 ? &gw : 0);
+        if (rc == 0)
+        { sr_rt_commit(sr); }
+        pthread_mutex_unlock(&sr->rt_lock);
+        ctl_reply(fd, rc == 0 ? "ok\n" : "error: no such route\n");
+    }
+    else if (strcmp(cmd, "reload") == 0)
+    {
+        const char* file = n >= 2 ? a : ctl->rtable;
+
+        if (sr_load_rt(sr, file) != 0)
+        { ctl_reply(fd, "error: could not load %s\n", file); }
+        else
+        { ctl_reply(fd, "ok\n"); }
+    }
+    else if (strcmp(cmd, "show") == 0)
+    {
+        ctl_show(ctl, fd);
+        ctl_reply(fd, "ok\n");
+    }
+    else if (strcmp(cmd, "nexthops") == 0)
+    {
+        ctl_nexthops(ctl, fd);
+        ctl_reply(fd, "ok\n");
+    }
+    else if (strcmp(cmd, "arp") == 0)
+    {
+        if (n == 2 && (atoi(a) <= 0 ||
+                       sr_arpcache_resize(&sr->cache, atoi(a)) != 0))
+        {
+            ctl_reply(fd, "error: could not resize to %s\n", a);
+            return;
+        }
+        pthread_mutex_lock(&sr->cache.lock);
+        ctl_reply(fd, "%u of %u entries, %lu evicted\n"
+                  "requests %lu sent %lu suppressed\n", sr->cache.count,
+                  sr->cache.capacity, sr->cache.evicted, sr->cache.arp_sent,
+                  sr->cache.arp_suppressed);
+        pthread_mutex_unlock(&sr->cache.lock);
+        ctl_reply(fd, "ok\n");
+    }
+    else if (strcmp(cmd, "icmp") == 0)
+    {
+        struct sr_icmplim* lim;
+        struct sr_icmplim copy;
+
+        /* -- copied out, so the reply is not written inside the section -- */
+        sr_epoch_enter();
+        if ((lim = *(struct sr_icmplim* volatile*)&sr->icmplim) != 0)
+        {
+            pthread_mutex_lock(&lim->lock);
+            copy.rate = lim->rate;
+            copy.src_rate = lim->src_rate;
+            copy.sent = lim->sent;
+            copy.limited = lim->limited;
+            copy.src_limited = lim->src_limited;
+            pthread_mutex_unlock(&lim->lock);
+        }
+        sr_epoch_exit();
+
+        if (lim)
+        {
+            ctl_reply(fd, "rate %u/s per source %u/s\n"
+                      "sent %lu limited %lu source limited %lu\n",
+                      copy.rate, copy.src_rate, copy.sent, copy.limited,
+                      copy.src_limited);
+        }
+        else
+        { ctl_reply(fd, "no limit\n"); }
+        ctl_reply(fd, "ok\n");
+    }
+    else
+    { ctl_reply(fd, "error: unknown command %s\n", cmd); }
+} /* -- ctl_command -- */
+
+/* Read what the client sent and run every complete line. */
+static void ctl_client_input(struct sr_ctl* ctl)
+{
+    char* nl;
+    char* start;
+    int n;
+
+    n = read(ctl->client_fd, ctl->line + ctl->used,
+             sizeof(ctl->line) - 1 - ctl->used);
+    if (n < 0 && errno == EINTR)
+    { return; }
+    if (n <= 0)
+    {
+        close(ctl->client_fd);
+        ctl->client_fd = -1;
+        ctl->used = 0;
+        return;
+    }
+    ctl->used += n;
+    ctl->line[ctl->used] = '\0';
+
+    start = ctl->line;
+    while ((nl = strchr(start, '\n')))
+    {
+        *nl = '\0';
+        ctl_command(ctl, start, ctl->client_fd);
+        start = nl + 1;
+    }
+    ctl->used -= start - ctl->line;
+    memmove(ctl->line, start, ctl->used);
+
+    if (ctl->used == sizeof(ctl->line) - 1)
+    {
+        ctl_reply(ctl->client_fd, "error: line too long\n");
+        ctl->used = 0;
+    }
+} /* -- ctl_client_input -- */
+
+/*---------------------------------------------------------------------
+ * Method: ctl_main(..)
+ * Scope:  Local
+ *
+ *---------------------------------------------------------------------*/
+
+static void* ctl_main(void* arg)
+{
+    struct sr_ctl* ctl = (struct sr_ctl*)arg;
+    struct pollfd pfd[3];
+    char drain[16];
+    int n;
+
+    while (1)
+    {
+        pfd[0].fd = ctl_pipe[0];
+        pfd[1].fd = ctl->client_fd < 0 ? ctl->listen_fd : -1;
+        pfd[2].fd = ctl->client_fd;
+        pfd[0].events = pfd[1].events = pfd[2].events = POLLIN;
+        pfd[0].revents = pfd[1].revents = pfd[2].revents = 0;
+
+        n = poll(pfd, 3, CTL_POLL_MS);
+        if (n < 0)
+        {
+            if (errno == EINTR)
+            { continue; }
+            perror("poll(..):ctl_main");
+            break;
+        }
+        if (n == 0)
+        {
+            sr_epoch_reclaim();
+            continue;
+        }
+
+        if (pfd[0].revents)
+        {
+            while (read(ctl_pipe[0], drain, sizeof(drain)) > 0)
+            { }
+            if (sr_load_rt(ctl->sr, ctl->rtable) == 0)
+            { printf("SIGHUP: reloaded routing table from %s\n", ctl->rtable); }
+            else
+            { fprintf(stderr, "SIGHUP: keeping current routes\n"); }
+        }
+        if (pfd[2].revents)
+        { ctl_client_input(ctl); }
+        else if (pfd[1].revents)
+        { ctl->client_fd = accept(ctl->listen_fd, 0, 0); }
+    }
+    return 0;
+} /* -- ctl_main -- */
+
+static int ctl_listen(const char* path)
+{
+    struct sockaddr_un addr;
+    int fd;
+
+    if (strlen(path) >= sizeof(addr.sun_path))
+    {
+        fprintf(stderr, "Error: control socket path too long\n");
+        return -1;
+    }
+
+    fd = socket(AF_UNIX, SOCK_STREAM, 0);
+    if (fd < 0)
+    {
+        perror("socket(..):ctl_listen");
+        return -1;
+    }
+    memset(&addr, 0, sizeof(addr));
+    addr.sun_family = AF_UNIX;
+    strcpy(addr.sun_path, path);
+    unlink(path);
+
+    if (bind(fd, (struct sockaddr*)&addr, sizeof(addr)) < 0 ||
+        listen(fd, 4) < 0)
+    {
+        perror("bind(..):ctl_listen");
+        close(fd);
+        return -1;
+    }
+    return fd;
+} /* -- ctl_listen -- */
+
+/*---------------------------------------------------------------------
+ * Method: sr_ctl_start(..)
+ * Scope:  Global
+ *
+ *---------------------------------------------------------------------*/
+
+int sr_ctl_start(struct sr_instance* sr, const char* rtable, const char* path)
+{
+    struct sr_ctl* ctl;
+    struct sigaction sa;
+
+    /* -- REQUIRES -- */
+    assert(sr);
+    assert(rtable);
+
+    ctl = (struct sr_ctl*)calloc(1, sizeof(struct sr_ctl));
+    assert(ctl);
+    ctl->sr = sr;
+    strncpy(ctl->rtable, rtable, sizeof(ctl->rtable) - 1);
+    ctl->client_fd = -1;
+    ctl->listen_fd = -1;
+
+    if (path && (ctl->listen_fd = ctl_listen(path)) < 0)
+    {
+        free(ctl);
+        return -1;
+    }
+
+    if (pipe(ctl_pipe) < 0)
+    {
+        perror("pipe(..):sr_ctl_start");
+        ctl_pipe[0] = ctl_pipe[1] = -1;
+        goto fail;
+    }
+    fcntl(ctl_pipe[0], F_SETFL, O_NONBLOCK);
+    fcntl(ctl_pipe[1], F_SETFL, O_NONBLOCK);
+
+    /* -- restart interrupted calls so the reader is not disturbed -- */
+    memset(&sa, 0, sizeof(sa));
+    sa.sa_handler = ctl_sighup;
+    sigemptyset(&sa.sa_mask);
+    sa.sa_flags = SA_RESTART;
+    sigaction(SIGHUP, &sa, 0);
+
+    if (pthread_create(&ctl->thread, 0, ctl_main, ctl))
+    {
+        perror("pthread_create(..):sr_ctl_start");
+        sa.sa_handler = SIG_DFL;
+        sigaction(SIGHUP, &sa, 0);
+        close(ctl_pipe[0]);
+        close(ctl_pipe[1]);
+        ctl_pipe[0] = ctl_pipe[1] = -1;
+        goto fail;
+    }
+    pthread_detach(ctl->thread);
+
+    if (path)
+    { printf("Control socket on %s\n", path); }
+    return 0;
+
+fail:
+    if (ctl->listen_fd >= 0)
+    {
+        close(ctl->listen_fd);
+        unlink(path);
+    }
+    free(ctl);
+    return -1;
+} /* -- sr_ctl_start -- */
@@ -0,0 +1,34 @@
+/*-----------------------------------------------------------------------------
+ * file:  sr_ctl.h
+ *
+ * Description:
+ *
+ * Run time route changes.  A control thread reloads the routing table
+ * file on SIGHUP and, when given a path, serves a UNIX stream socket that
+ * takes one command per line:
+ *
+ *   add <dest> <gateway> <mask> <interface>
+ *   del <dest> <mask> [gateway]
+ *   reload [file]
+ *   show
+ *   nexthops                   multipath groups and packets per member
+ *   icmp                       ICMP errors sent and rate limited
+ *   arp [capacity]             ARP cache and request counts, resized if given
+ *
+ * Each command is answered with "ok" or "error: <reason>".  Changes are
+ * compiled into a new FIB and published with sr_fib_publish, so the
+ * forwarding threads never wait on them.
+ *
+ *---------------------------------------------------------------------------*/
+
+#ifndef SR_CTL_H
+#define SR_CTL_H
+
+struct sr_instance;
+
+/* Start the control thread.  rtable is the file SIGHUP reloads; path may
+   be 0 for no control socket.  Returns 0 on success. */
+int sr_ctl_start(struct sr_instance* sr, const char* rtable,
+                 const char* path);
+
+#endif /* -- SR_CTL_H -- */
@@ -0,0 +1,83 @@
+/*-----------------------------------------------------------------------------
+ * file:  sr_dcache.c
+ *
+ * Description:
+ *
+ * Per-destination forwarding cache, see sr_dcache.h.
+ *
+ *---------------------------------------------------------------------------*/
+
+#include <stdlib.h>
+#include <assert.h>
+#include <string.h>
+
+#include <netinet/in.h>
+#include <arpa/inet.h>
+
+#include "sr_dcache.h"
+#include "sr_if.h"
+
+/* multiplicative hash, the top bits pick the slot */
+#define DCACHE_SLOT(ip)  (((ip) * 2654435761u) >> (32 - SR_DCACHE_BITS))
+
+static __thread struct sr_dcache* dcache_self;
+
+struct sr_dcache* sr_dcache_create(void)
+{
+    struct sr_dcache* dc;
+
+    dc = (struct sr_dcache*)calloc(1, sizeof(struct sr_dcache));
+    assert(dc);
+    return dc;
+} /* -- sr_dcache_create -- */
+
+void sr_dcache_destroy(struct sr_dcache* dc)
+{
+    free(dc);
+} /* -- sr_dcache_destroy -- */
+
+void sr_dcache_bind(struct sr_dcache* dc)
+{
+    dcache_self = dc;
+} /* -- sr_dcache_bind -- */
+
+struct sr_dcache* sr_dcache_self(void)
+{
+    return dcache_self;
+} /* -- sr_dcache_self -- */
+
+const struct sr_dcache_entry* sr_dcache_probe(struct sr_dcache* dc,
+                                              uint32_t dst, uint32_t fib_gen,
+                                              uint32_t arp_gen)
+{
+    const struct sr_dcache_entry* e = &dc->e[DCACHE_SLOT(dst)];
+
+    if (e->dst == dst && e->fib_gen == fib_gen && e->arp_gen == arp_gen &&
+        fib_gen != 0)
+    {
+        dc->hits++;
+        return e;
+    }
+    dc->misses++;
+    return NULL;
+} /* -- sr_dcache_probe -- */
+
+void sr_dcache_fill(struct sr_dcache* dc, uint32_t dst, uint32_t fib_gen,
+                    uint32_t arp_gen, const struct sr_if* out_if,
+                    const unsigned char* mac, unsigned int arp_slot)
+{
+    struct sr_dcache_entry* e = &dc->e[DCACHE_SLOT(dst)];
+
+    /* -- REQUIRES -- */
+    assert(out_if);
+    assert(mac);
+
+    e->dst = dst;
+    e->fib_gen = fib_gen;
+    e->arp_gen = arp_gen;
+    e->if_index = out_if->index;
+    e->arp_slot = arp_slot;
+    memcpy(e->eth.ether_dhost, mac, ETHER_ADDR_LEN);
+    memcpy(e->eth.ether_shost, out_if->addr, ETHER_ADDR_LEN);
+    e->eth.ether_type = htons(ethertype_ip);
+} /* -- sr_dcache_fill -- */
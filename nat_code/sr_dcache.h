@@ -0,0 +1,80 @@
+/*-----------------------------------------------------------------------------
+ * file:  sr_dcache.h
+ *
+ * Description:
+ *
+ * Per-destination forwarding cache.
+ *
+ * A direct-mapped table keyed by destination IP that remembers the result
+ * of the route lookup and the ARP lookup together: the output interface
+ * and a ready-made Ethernet header.  Entries carry the FIB and ARP cache
+ * generations they were built from and are ignored once either moves on,
+ * so route reloads and ARP expiry never need to walk the table.
+ *
+ * Each forwarding thread has its own cache, bound with sr_dcache_bind();
+ * threads without one (timers) simply do not cache.
+ *
+ *---------------------------------------------------------------------------*/
+
+#ifndef SR_DCACHE_H
+#define SR_DCACHE_H
+
+#ifdef _LINUX_
+#include <stdint.h>
+#endif /* _LINUX_ */
+
+#ifdef _DARWIN_
+#include <inttypes.h>
+#endif /* _DARWIN_ */
+
+#include "sr_protocol.h"
+
+#define SR_DCACHE_BITS  12
+#define SR_DCACHE_SZ    (1 << SR_DCACHE_BITS)
+
+struct sr_if;
+
+/* ----------------------------------------------------------------------------
+ * struct sr_dcache_entry
+ *
+ * fib_gen 0 marks an empty slot, FIB generations start at 1.
+ *
+ * -------------------------------------------------------------------------- */
+
+struct sr_dcache_entry
+{
+    uint32_t dst;               /* host byte order */
+    uint32_t fib_gen;
+    uint32_t arp_gen;
+    unsigned int if_index;      /* into sr->if_table */
+    unsigned int arp_slot;      /* of the next hop, see sr_arpcache_touch */
+    sr_ethernet_hdr_t eth;      /* dhost = next hop, shost = out_if */
+};
+
+struct sr_dcache
+{
+    struct sr_dcache_entry e[SR_DCACHE_SZ];
+    unsigned long hits;
+    unsigned long misses;
+};
+
+struct sr_dcache* sr_dcache_create(void);
+void sr_dcache_destroy(struct sr_dcache* dc);
+
+/* Cache of the calling thread, NULL if it has none. */
+void sr_dcache_bind(struct sr_dcache* dc);
+struct sr_dcache* sr_dcache_self(void);
+
+/* Entry for dst if it is still current, else NULL. */
+const struct sr_dcache_entry* sr_dcache_probe(struct sr_dcache* dc,
+                                              uint32_t dst, uint32_t fib_gen,
+                                              uint32_t arp_gen);
+
+/* Remember dst -> (out_if, mac) and the ARP slot mac came from.  The
+   generations must have been read before the lookups that produced the
+   result. */
+void sr_dcache_fill(struct sr_dcache* dc, uint32_t dst, uint32_t fib_gen,
+                    uint32_t arp_gen, const struct sr_if* out_if,
+                    const unsigned char* mac, unsigned int arp_slot);
+
+#endif /* -- SR_DCACHE_H -- */
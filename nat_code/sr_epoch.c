@@ -0,0 +1,166 @@
+/*-----------------------------------------------------------------------------
+ * file:  sr_epoch.c
+ *
+ * Description:
+ *
+ * Epoch based reclamation, see sr_epoch.h.
+ *
+ * Every registered thread has a slot holding the global epoch it saw when
+ * it entered its outermost section, or 0 while it is outside.  Retiring
+ * an object advances the global epoch and stamps the object with the new
+ * value; any reader that could still hold the object entered earlier, so
+ * the object is freed once no slot holds an epoch below its stamp.
+ *
+ *---------------------------------------------------------------------------*/
+
+#include <stdio.h>
+#include <stdlib.h>
+#include <assert.h>
+
+#include <pthread.h>
+
+#include "sr_epoch.h"
+
+struct epoch_slot
+{
+    volatile unsigned long epoch;   /* 0 outside a section */
+    unsigned int depth;             /* nesting, owner thread only */
+    struct epoch_slot* next;
+};
+
+struct epoch_limbo
+{
+    void* ptr;
+    void (*free_fn)(void*);
+    unsigned long epoch;            /* safe once every reader is here */
+    struct epoch_limbo* next;
+};
+
+static volatile unsigned long epoch_global = 1;
+static struct epoch_slot* volatile epoch_slots;
+static __thread struct epoch_slot* epoch_self;
+
+static pthread_mutex_t epoch_limbo_lock = PTHREAD_MUTEX_INITIALIZER;
+static struct epoch_limbo* epoch_limbo;
+
+static struct epoch_slot* epoch_register(void)
+{
+    struct epoch_slot* s;
+
+    s = (struct epoch_slot*)calloc(1, sizeof(struct epoch_slot));
+    assert(s);
+    do
+    { s->next = epoch_slots; }
+    while (!__sync_bool_compare_and_swap(&epoch_slots, s->next, s));
+
+    epoch_self = s;
+    return s;
+} /* -- epoch_register -- */
+
+void sr_epoch_enter(void)
+{
+    struct epoch_slot* s = epoch_self ? epoch_self : epoch_register();
+
+    if (s->depth++ == 0)
+    {
+        s->epoch = epoch_global;
+        /* publish the slot before loading any protected pointer */
+        __sync_synchronize();
+    }
+} /* -- sr_epoch_enter -- */
+
+void sr_epoch_exit(void)
+{
+    struct epoch_slot* s = epoch_self;
+
+    /* -- REQUIRES -- */
+    assert(s && s->depth > 0);
+
+    if (--s->depth == 0)
+    {
+        __sync_synchronize();   /* finish all reads before leaving */
+        s->epoch = 0;
+    }
+} /* -- sr_epoch_exit -- */
+
+/*---------------------------------------------------------------------
+ * Method: sr_epoch_reclaim(..)
+ * Scope:  Global
+ *
+ *---------------------------------------------------------------------*/
+
+unsigned int sr_epoch_reclaim(void)
+{
+    struct epoch_slot* s;
+    struct epoch_limbo** pp;
+    struct epoch_limbo* ready = 0;
+    struct epoch_limbo* l;
+    unsigned long oldest = ~0ul;
+    unsigned int waiting = 0;
+
+    pthread_mutex_lock(&epoch_limbo_lock);
+
+    __sync_synchronize();
+    for (s = epoch_slots; s; s = s->next)
+    {
+        unsigned long e = s->epoch;
+        if (e != 0 && e < oldest)
+        { oldest = e; }
+    }
+
+    pp = &epoch_limbo;
+    while ((l = *pp))
+    {
+        if (l->epoch <= oldest)
+        {
+            *pp = l->next;
+            l->next = ready;
+            ready = l;
+        }
+        else
+        {
+            pp = &l->next;
+            waiting++;
+        }
+    }
+
+    pthread_mutex_unlock(&epoch_limbo_lock);
+
+    while ((l = ready))
+    {
+        ready = l->next;
+        l->free_fn(l->ptr);
+        free(l);
+    }
+    return waiting;
+} /* -- sr_epoch_reclaim -- */
+
+/*---------------------------------------------------------------------
+ * Method: sr_epoch_retire(..)
+ * Scope:  Global
+ *
+ * The caller must already have replaced every shared pointer to ptr.
+ *
+ *---------------------------------------------------------------------*/
+
+void sr_epoch_retire(void* ptr, void (*free_fn)(void*))
+{
+    struct epoch_limbo* l;
+
+    if (!ptr)
+    { return; }
+
+    l = (struct epoch_limbo*)malloc(sizeof(struct epoch_limbo));
+    assert(l);
+    l->ptr = ptr;
+    l->free_fn = free_fn;
+
+    pthread_mutex_lock(&epoch_limbo_lock);
+    /* full barrier: the caller's pointer swap is visible before this */
+    l->epoch = __sync_add_and_fetch(&epoch_global, 1);
+    l->next = epoch_limbo;
+    epoch_limbo = l;
+    pthread_mutex_unlock(&epoch_limbo_lock);
+
+    sr_epoch_reclaim();
+} /* -- sr_epoch_retire -- */
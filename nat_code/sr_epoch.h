@@ -0,0 +1,31 @@
+/*-----------------------------------------------------------------------------
+ * file:  sr_epoch.h
+ *
+ * Description:
+ *
+ * Epoch based reclamation for data that is read without locks and
+ * replaced by swapping a pointer, such as the FIB.
+ *
+ * A reader brackets its use of shared pointers with sr_epoch_enter and
+ * sr_epoch_exit; sections nest and never block.  A writer publishes the
+ * new version, then hands the old one to sr_epoch_retire, which frees it
+ * once every thread that was inside a section at the time has left it.
+ * Threads register themselves on their first sr_epoch_enter.
+ *
+ *---------------------------------------------------------------------------*/
+
+#ifndef SR_EPOCH_H
+#define SR_EPOCH_H
+
+void sr_epoch_enter(void);
+void sr_epoch_exit(void);
+
+/* Free ptr with free_fn once no reader can still see it.  Also reclaims
+   whatever earlier retirements have become safe. */
+void sr_epoch_retire(void* ptr, void (*free_fn)(void*));
+
+/* Free every retired object that is safe now.  Returns how many are
+   still waiting on readers. */
+unsigned int sr_epoch_reclaim(void);
+
+#endif /* -- SR_EPOCH_H -- */
@@ -0,0 +1,1081 @@
+/*-----------------------------------------------------------------------------
+ * file:  sr_fib.c
+ *
+ * Description:
+ *
+ * Builds the 16-8-8 multibit trie from the routing table list and answers
+ * longest prefix match queries for the forwarding path.
+ *
+ *---------------------------------------------------------------------------*/
+
+#include <stdio.h>
+#include <stdlib.h>
+#include <assert.h>
+#include <string.h>
+#include <unistd.h>
+#include <fcntl.h>
+
+#include <sys/types.h>
+#include <sys/stat.h>
+#include <sys/mman.h>
+#include <netinet/in.h>
+#include <arpa/inet.h>
+
+#include "sr_fib.h"
+#include "sr_rt.h"
+#include "sr_if.h"
+#include "sr_router.h"
+#include "sr_epoch.h"
+
+static uint32_t fib_gen_last;  /* last generation handed out */
+
+static uint32_t fib_next_gen(void)
+{
+    uint32_t gen;
+
+    do
+    { gen = __sync_add_and_fetch(&fib_gen_last, 1); } while (gen == 0);
+    return gen;
+}
+
+/*---------------------------------------------------------------------
+ * Method: fib_prefix_len(..)
+ * Scope:  Local
+ *
+ * Number of leading one bits in a host byte order netmask.
+ *
+ *---------------------------------------------------------------------*/
+
+static int fib_prefix_len(uint32_t mask)
+{
+    int len = 0;
+
+    while (len < 32 && (mask & (0x80000000u >> len)))
+    { len++; }
+
+    if (len < 32 && (mask << len) != 0)
+    {
+        fprintf(stderr, "*warning* non-contiguous netmask %08x, using /%d\n",
+                mask, len);
+    }
+    return len;
+} /* -- fib_prefix_len -- */
+
+/*---------------------------------------------------------------------
+ * Method: fib_iface_slot(..)
+ * Scope:  Local
+ *
+ * Index of an interface name in the FIB interface table, adding it if
+ * it has not been seen yet.
+ *
+ *---------------------------------------------------------------------*/
+
+static uint16_t fib_iface_slot(struct sr_fib* fib, const char* name)
+{
+    unsigned int i;
+
+    for (i = 0; i < fib->n_ifs; i++)
+    {
+        if (!strncmp(fib->ifnames[i], name, sr_IFACE_NAMELEN))
+        { return i; }
+    }
+
+    fib->ifnames = realloc(fib->ifnames,
+                           (fib->n_ifs + 1) * sizeof(*fib->ifnames));
+    fib->ifs = realloc(fib->ifs, (fib->n_ifs + 1) * sizeof(*fib->ifs));
+    assert(fib->ifnames && fib->ifs);
+    strncpy(fib->ifnames[fib->n_ifs], name, sr_IFACE_NAMELEN);
+    fib->ifnames[fib->n_ifs][sr_IFACE_NAMELEN - 1] = '\0';
+    fib->ifs[fib->n_ifs] = 0;
+    return fib->n_ifs++;
+} /* -- fib_iface_slot -- */
+
+/* next hop index by (gw, iface) while building, slots hold index + 1 */
+struct fib_nh_index
+{
+    uint32_t* slot;
+    unsigned int mask;
+};
+
+static unsigned int fib_nh_hash(uint32_t gw, uint16_t iface)
+{
+    uint32_t h = (gw ^ ((uint32_t)iface << 24)) * 0x9e3779b1u;
+    return h ^ (h >> 16);
+}
+
+static void fib_nh_index_grow(struct fib_nh_index* idx,
+                              const struct sr_fib* fib)
+{
+    unsigned int i, h;
+
+    free(idx->slot);
+    idx->mask = idx->mask ? 2 * idx->mask + 1 : 63;
+    idx->slot = (uint32_t*)calloc(idx->mask + 1, sizeof(uint32_t));
+    assert(idx->slot);
+    for (i = 0; i < fib->n_nh; i++)
+    {
+        if (fib->nh[i].group)
+        { continue; }   /* -- group members are never shared -- */
+        h = fib_nh_hash(fib->nh[i].gw, fib->nh[i].iface);
+        while (idx->slot[h & idx->mask])
+        { h++; }
+        idx->slot[h & idx->mask] = i + 1;
+    }
+} /* -- fib_nh_index_grow -- */
+
+/*---------------------------------------------------------------------
+ * Method: fib_nh_slot(..)
+ * Scope:  Local
+ *
+ * Leaf value (index + 1) of the next hop (gw, iface), shared between all
+ * prefixes that use it.  Found through a hash so large tables with many
+ * next hops still build in linear time.
+ *
+ *---------------------------------------------------------------------*/
+
+static void fib_nh_reserve(struct sr_fib* fib, unsigned int n)
+{
+    while (fib->n_nh + n > fib->cap_nh)
+    {
+        fib->cap_nh = fib->cap_nh ? 2 * fib->cap_nh : 8;
+        fib->nh = realloc(fib->nh, fib->cap_nh * sizeof(struct sr_fib_nh));
+        assert(fib->nh);
+    }
+} /* -- fib_nh_reserve -- */
+
+static uint32_t fib_nh_slot(struct sr_fib* fib, struct fib_nh_index* idx,
+                            uint32_t gw, uint16_t iface)
+{
+    unsigned int h = fib_nh_hash(gw, iface);
+    uint32_t v;
+
+    while ((v = idx->slot[h & idx->mask]))
+    {
+        if (fib->nh[v - 1].gw == gw && fib->nh[v - 1].iface == iface)
+        { return v; }
+        h++;
+    }
+
+    fib_nh_reserve(fib, 1);
+    fib->nh[fib->n_nh].gw = gw;
+    fib->nh[fib->n_nh].iface = iface;
+    fib->nh[fib->n_nh].group = 0;
+    idx->slot[h & idx->mask] = ++fib->n_nh;
+
+    /* -- keep the index at most half full -- */
+    if (2 * fib->n_nh > idx->mask)
+    { fib_nh_index_grow(idx, fib); }
+    return fib->n_nh;
+} /* -- fib_nh_slot -- */
+
+static unsigned int fib_group_hash(const struct sr_fib_nh* m, unsigned int n)
+{
+    unsigned int i, h = n;
+
+    for (i = 0; i < n; i++)
+    { h = (h ^ fib_nh_hash(m[i].gw, m[i].iface)) * 0x9e3779b1u; }
+    return h ^ (h >> 16);
+}
+
+static void fib_group_index_grow(struct fib_nh_index* idx,
+                                 const struct sr_fib* fib)
+{
+    unsigned int i, h;
+
+    free(idx->slot);
+    idx->mask = idx->mask ? 2 * idx->mask + 1 : 15;
+    idx->slot = (uint32_t*)calloc(idx->mask + 1, sizeof(uint32_t));
+    assert(idx->slot);
+    for (i = 0; i < fib->n_groups; i++)
+    {
+        h = fib_group_hash(&fib->nh[fib->groups[i].first], fib->groups[i].n);
+        while (idx->slot[h & idx->mask])
+        { h++; }
+        idx->slot[h & idx->mask] = i + 1;
+    }
+} /* -- fib_group_index_grow -- */
+
+static int fib_nh_cmp(const void* x, const void* y)
+{
+    const struct sr_fib_nh* a = (const struct sr_fib_nh*)x;
+    const struct sr_fib_nh* b = (const struct sr_fib_nh*)y;
+
+    if (a->gw != b->gw)
+    { return a->gw < b->gw ? -1 : 1; }
+    return (int)a->iface - (int)b->iface;
+} /* -- fib_nh_cmp -- */
+
+/*---------------------------------------------------------------------
+ * Method: fib_group_slot(..)
+ * Scope:  Local
+ *
+ * Leaf value of the multipath group with next hops m[0..n), which are
+ * sorted and distinct.  A new group gets its own copies of the next
+ * hops, so a member's counter is only ever bumped through that group.
+ *
+ *---------------------------------------------------------------------*/
+
+static uint32_t fib_group_slot(struct sr_fib* fib, struct fib_nh_index* idx,
+                               const struct sr_fib_nh* m, unsigned int n,
+                               uint32_t prefix, int len)
+{
+    unsigned int h = fib_group_hash(m, n);
+    struct sr_fib_group* g;
+    unsigned int k;
+    uint32_t v;
+
+    while ((v = idx->slot[h & idx->mask]))
+    {
+        g = &fib->groups[v - 1];
+        for (k = 0; g->n == n && k < n; k++)
+        {
+            if (fib->nh[g->first + k].gw != m[k].gw ||
+                fib->nh[g->first + k].iface != m[k].iface)
+            { break; }
+        }
+        if (g->n == n && k == n)
+        { return v | SR_FIB_GROUP; }
+        h++;
+    }
+
+    if (fib->n_groups == fib->cap_groups)
+    {
+        fib->cap_groups = fib->cap_groups ? 2 * fib->cap_groups : 4;
+        fib->groups = realloc(fib->groups,
+                              fib->cap_groups * sizeof(struct sr_fib_group));
+        assert(fib->groups);
+    }
+    fib_nh_reserve(fib, n);
+
+    g = &fib->groups[fib->n_groups];
+    g->first = fib->n_nh;
+    g->n = n;
+    g->len = len;
+    g->pad = 0;
+    g->prefix = prefix;
+    for (k = 0; k < n; k++, fib->n_nh++)
+    {
+        fib->nh[fib->n_nh].gw = m[k].gw;
+        fib->nh[fib->n_nh].iface = m[k].iface;
+        fib->nh[fib->n_nh].group = fib->n_groups + 1;
+    }
+    idx->slot[h & idx->mask] = ++fib->n_groups;
+
+    if (2 * fib->n_groups > idx->mask)
+    { fib_group_index_grow(idx, fib); }
+    return fib->n_groups | SR_FIB_GROUP;
+} /* -- fib_group_slot -- */
+
+static uint32_t fib_new_chunk(struct sr_fib* fib, uint32_t fill)
+{
+    uint32_t c;
+    int i;
+
+    if (fib->n_chunks == fib->cap_chunks)
+    {
+        fib->cap_chunks = fib->cap_chunks ? 2 * fib->cap_chunks : 16;
+        fib->chunks = realloc(fib->chunks,
+                        fib->cap_chunks * SR_FIB_CHUNK * sizeof(uint32_t));
+        assert(fib->chunks);
+    }
+
+    c = fib->n_chunks++;
+    for (i = 0; i < SR_FIB_CHUNK; i++)
+    { fib->chunks[c * SR_FIB_CHUNK + i] = fill; }
+    return c;
+}
+
+/* overwrite n slots starting at slot lo of chunk c, descending into children */
+static void fib_fill_chunk(struct sr_fib* fib, uint32_t c, unsigned int lo,
+                           unsigned int n, uint32_t val)
+{
+    uint32_t* slot = fib->chunks + c * SR_FIB_CHUNK + lo;
+
+    for (; n > 0; n--, slot++)
+    {
+        if (*slot & SR_FIB_CHILD)
+        { fib_fill_chunk(fib, *slot & ~SR_FIB_CHILD, 0, SR_FIB_CHUNK, val); }
+        else
+        { *slot = val; }
+    }
+}
+
+/* chunk hanging off *slot, created from the leaf it replaces if needed */
+static uint32_t fib_child(struct sr_fib* fib, uint32_t* tbl, uint32_t idx)
+{
+    uint32_t c;
+
+    if (tbl[idx] & SR_FIB_CHILD)
+    { return tbl[idx] & ~SR_FIB_CHILD; }
+
+    c = fib_new_chunk(fib, tbl[idx]);
+    /* fib_new_chunk may have moved the chunk array */
+    if (tbl != fib->l0)
+    { tbl = fib->chunks; }
+    tbl[idx] = c | SR_FIB_CHILD;
+    return c;
+}
+
+/*---------------------------------------------------------------------
+ * Method: fib_insert(..)
+ * Scope:  Local
+ *
+ * Expand prefix/len into the trie.  Prefixes must be inserted in order
+ * of increasing length so that longer matches overwrite shorter ones.
+ *
+ *---------------------------------------------------------------------*/
+
+static void fib_insert(struct sr_fib* fib, uint32_t prefix, int len,
+                       uint32_t val)
+{
+    uint32_t i, c1, c2;
+
+    if (len <= 16)
+    {
+        uint32_t lo = prefix >> 16;
+        uint32_t n = 1u << (16 - len);
+        for (i = lo; i < lo + n; i++)
+        {
+            if (fib->l0[i] & SR_FIB_CHILD)
+            {
+                fib_fill_chunk(fib, fib->l0[i] & ~SR_FIB_CHILD, 0,
+                               SR_FIB_CHUNK, val);
+            }
+            else
+            { fib->l0[i] = val; }
+        }
+        return;
+    }
+
+    c1 = fib_child(fib, fib->l0, prefix >> 16);
+    if (len <= 24)
+    {
+        fib_fill_chunk(fib, c1, (prefix >> 8) & 0xff, 1u << (24 - len), val);
+        return;
+    }
+
+    c2 = fib_child(fib, fib->chunks, c1 * SR_FIB_CHUNK + ((prefix >> 8) & 0xff));
+    fib_fill_chunk(fib, c2, prefix & 0xff, 1u << (32 - len), val);
+} /* -- fib_insert -- */
+
+/* a route while building, ordered by prefix and then list position */
+struct fib_route
+{
+    uint32_t prefix;
+    unsigned int pos;
+    struct sr_rt* rt;
+};
+
+static int fib_route_cmp(const void* x, const void* y)
+{
+    const struct fib_route* a = (const struct fib_route*)x;
+    const struct fib_route* b = (const struct fib_route*)y;
+
+    if (a->prefix != b->prefix)
+    { return a->prefix < b->prefix ? -1 : 1; }
+    return a->pos < b->pos ? -1 : a->pos > b->pos;
+} /* -- fib_route_cmp -- */
+
+/*---------------------------------------------------------------------
+ * Method: fib_prefix_val(..)
+ * Scope:  Local
+ *
+ * Leaf value for routes r[0..n), which all have the same prefix: their
+ * next hop, or a group if they have more than one distinct next hop.
+ *
+ *---------------------------------------------------------------------*/
+
+static uint32_t fib_prefix_val(struct sr_fib* fib, struct fib_nh_index* nh_index,
+                               struct fib_nh_index* group_index,
+                               const struct fib_route* r, unsigned int n,
+                               int len)
+{
+    struct sr_fib_nh m[SR_FIB_ECMP_MAX];
+    unsigned int i, k, n_m = 0;
+    uint32_t gw;
+    uint16_t iface;
+
+    for (i = 0; i < n; i++)
+    {
+        gw = ntohl(r[i].rt->gw.s_addr);
+        iface = fib_iface_slot(fib, r[i].rt->interface);
+        for (k = 0; k < n_m; k++)
+        {
+            if (m[k].gw == gw && m[k].iface == iface)
+            { break; }
+        }
+        if (k < n_m)
+        { continue; }   /* -- listed twice -- */
+        if (n_m == SR_FIB_ECMP_MAX)
+        {
+            fprintf(stderr, "*warning* %s/%d has more than %d next hops, "
+                    "ignoring the rest\n", inet_ntoa(r[i].rt->dest), len,
+                    SR_FIB_ECMP_MAX);
+            break;
+        }
+        m[n_m].gw = gw;
+        m[n_m].iface = iface;
+        m[n_m].group = 0;
+        n_m++;
+    }
+
+    if (n_m == 1)
+    { return fib_nh_slot(fib, nh_index, m[0].gw, m[0].iface); }
+    qsort(m, n_m, sizeof(m[0]), fib_nh_cmp);
+    return fib_group_slot(fib, group_index, m, n_m, r[0].prefix, len);
+} /* -- fib_prefix_val -- */
+
+/*---------------------------------------------------------------------
+ * Method: sr_fib_build(..)
+ * Scope:  Global
+ *
+ * Compile a routing table list into a new FIB.  Routes are bucketed by
+ * prefix length and expanded shortest first.  Within a bucket they are
+ * sorted by prefix, and routes for the same prefix with different next
+ * hops become a multipath group.
+ *
+ *---------------------------------------------------------------------*/
+
+struct sr_fib* sr_fib_build(struct sr_rt* routes)
+{
+    struct sr_fib* fib;
+    struct sr_rt* rt;
+    struct fib_route* sorted;
+    struct fib_nh_index nh_index, group_index;
+    unsigned int start[34];
+    unsigned int n = 0;
+    int len;
+
+    fib = (struct sr_fib*)calloc(1, sizeof(struct sr_fib));
+    assert(fib);
+    fib->l0 = (uint32_t*)calloc(SR_FIB_L0_SIZE, sizeof(uint32_t));
+    assert(fib->l0);
+    memset(&nh_index, 0, sizeof(nh_index));
+    fib_nh_index_grow(&nh_index, fib);
+    memset(&group_index, 0, sizeof(group_index));
+    fib_group_index_grow(&group_index, fib);
+
+    /* -- counting sort on prefix length -- */
+    memset(start, 0, sizeof(start));
+    for (rt = routes; rt; rt = rt->next, n++)
+    { start[fib_prefix_len(ntohl(rt->mask.s_addr)) + 1]++; }
+    for (len = 1; len < 34; len++)
+    { start[len] += start[len - 1]; }
+
+    sorted = (struct fib_route*)malloc((n ? n : 1) * sizeof(struct fib_route));
+    assert(sorted);
+    for (rt = routes, n = 0; rt; rt = rt->next, n++)
+    {
+        struct fib_route* r;
+
+        len = fib_prefix_len(ntohl(rt->mask.s_addr));
+        r = &sorted[start[len]++];
+        r->prefix = ntohl(rt->dest.s_addr) &
+                    (len ? 0xffffffffu << (32 - len) : 0);
+        r->pos = n;
+        r->rt = rt;
+    }
+
+    /* start[len] now marks the end of bucket len */
+    for (len = 0; len <= 32; len++)
+    {
+        unsigned int lo = len ? start[len - 1] : 0;
+        unsigned int i, j;
+
+        qsort(sorted + lo, start[len] - lo, sizeof(struct fib_route),
+              fib_route_cmp);
+        for (i = lo; i < start[len]; i = j)
+        {
+            for (j = i + 1; j < start[len]; j++)
+            {
+                if (sorted[j].prefix != sorted[i].prefix)
+                { break; }
+            }
+            fib_insert(fib, sorted[i].prefix, len,
+                       fib_prefix_val(fib, &nh_index, &group_index,
+                                      sorted + i, j - i, len));
+        }
+    }
+
+    free(sorted);
+    free(nh_index.slot);
+    free(group_index.slot);
+    fib->nh_pkts = (uint64_t*)calloc(fib->n_nh ? fib->n_nh : 1,
+                                     sizeof(uint64_t));
+    assert(fib->nh_pkts);
+    fib->gen = fib_next_gen();
+    return fib;
+} /* -- sr_fib_build -- */
+
+/*---------------------------------------------------------------------
+ * Method: sr_fib_attach(..)
+ * Scope:  Global
+ *
+ * Resolve the FIB interface table against the router's interfaces.
+ * Returns the number of names that could not be resolved.  Gets a new
+ * generation so results cached against the old interfaces are dropped.
+ *
+ *---------------------------------------------------------------------*/
+
+int sr_fib_attach(struct sr_fib* fib, struct sr_instance* sr)
+{
+    unsigned int i;
+    int missing = 0;
+
+    /* -- REQUIRES -- */
+    assert(fib);
+    assert(sr);
+
+    for (i = 0; i < fib->n_ifs; i++)
+    {
+        fib->ifs[i] = sr_get_interface(sr, fib->ifnames[i]);
+        if (fib->ifs[i] == 0)
+        { missing++; }
+    }
+    fib->gen = fib_next_gen();
+    return missing;
+} /* -- sr_fib_attach -- */
+
+void sr_fib_destroy(struct sr_fib* fib)
+{
+    if (!fib)
+    { return; }
+
+    if (fib->map)
+    { munmap(fib->map, fib->map_len); }
+    else
+    {
+        free(fib->l0);
+        free(fib->chunks);
+        free(fib->nh);
+        free(fib->groups);
+        free(fib->ifnames);
+    }
+    free(fib->nh_pkts);
+    free(fib->ifs);
+    free(fib);
+} /* -- sr_fib_destroy -- */
+
+/* bytes a compiled file with these counts takes */
+static uint64_t fib_file_size(uint64_t n_chunks, uint64_t n_nh,
+                              uint64_t n_groups, uint64_t n_ifs,
+                              uint64_t n_routes)
+{
+    return sizeof(struct sr_fib_file)
+           + (SR_FIB_L0_SIZE + n_chunks * SR_FIB_CHUNK) * sizeof(uint32_t)
+           + n_nh * sizeof(struct sr_fib_nh)
+           + n_groups * sizeof(struct sr_fib_group)
+           + n_ifs * sr_IFACE_NAMELEN
+           + n_routes * sizeof(struct sr_fib_file_route);
+} /* -- fib_file_size -- */
+
+static int fib_write(FILE* fp, const void* buf, size_t len)
+{
+    return len == 0 || fwrite(buf, 1, len, fp) == len;
+} /* -- fib_write -- */
+
+int sr_fib_file_check(const char* path)
+{
+    char magic[sizeof(SR_FIB_MAGIC)];
+    FILE* fp;
+    int ok;
+
+    if ((fp = fopen(path, "r")) == 0)
+    { return 0; }
+    ok = fread(magic, 1, sizeof(magic), fp) == sizeof(magic) &&
+         memcmp(magic, SR_FIB_MAGIC, sizeof(magic)) == 0;
+    fclose(fp);
+    return ok;
+} /* -- sr_fib_file_check -- */
+
+/*---------------------------------------------------------------------
+ * Method: sr_fib_save(..)
+ * Scope:  Global
+ *
+ * Write fib and the routes it was built from as a compiled FIB file.
+ * The file is written next to path and renamed into place, so a router
+ * reloading path never sees half of it.  Returns 0 on success.
+ *
+ *---------------------------------------------------------------------*/
+
+int sr_fib_save(const struct sr_fib* fib, const struct sr_rt* routes,
+                const char* path)
+{
+    struct sr_fib_file hdr;
+    struct sr_fib_file_route rec;
+    const struct sr_rt* rt;
+    unsigned int n_routes = 0;
+    unsigned int i = 0;
+    char* tmp;
+    FILE* fp;
+    int ok;
+
+    /* -- REQUIRES -- */
+    assert(fib && !fib->map);
+    assert(path);
+
+    for (rt = routes; rt; rt = rt->next)
+    { n_routes++; }
+
+    memset(&hdr, 0, sizeof(hdr));
+    memcpy(hdr.magic, SR_FIB_MAGIC, sizeof(hdr.magic));
+    hdr.order = SR_FIB_ORDER;
+    hdr.l0_bits = SR_FIB_L0_BITS;
+    hdr.n_chunks = fib->n_chunks;
+    hdr.n_nh = fib->n_nh;
+    hdr.n_ifs = fib->n_ifs;
+    hdr.n_routes = n_routes;
+    hdr.n_groups = fib->n_groups;
+    hdr.size = fib_file_size(hdr.n_chunks, hdr.n_nh, hdr.n_groups, hdr.n_ifs,
+                             n_routes);
+
+    tmp = (char*)malloc(strlen(path) + 5);
+    assert(tmp);
+    sprintf(tmp, "%s.tmp", path);
+    if ((fp = fopen(tmp, "w")) == 0)
+    {
+        perror("fopen(..):sr_fib_save");
+        free(tmp);
+        return -1;
+    }
+
+    ok = fib_write(fp, &hdr, sizeof(hdr)) &&
+         fib_write(fp, fib->l0, SR_FIB_L0_SIZE * sizeof(uint32_t)) &&
+         fib_write(fp, fib->chunks,
+                   (size_t)fib->n_chunks * SR_FIB_CHUNK * sizeof(uint32_t)) &&
+         fib_write(fp, fib->nh, fib->n_nh * sizeof(struct sr_fib_nh)) &&
+         fib_write(fp, fib->groups,
+                   fib->n_groups * sizeof(struct sr_fib_group)) &&
+         fib_write(fp, fib->ifnames, fib->n_ifs * sr_IFACE_NAMELEN);
+
+    for (rt = routes; ok && rt; rt = rt->next)
+    {
+        /* -- routes mostly share interfaces, try the last one first -- */
+        if (i >= fib->n_ifs ||
+            strncmp(fib->ifnames[i], rt->interface, sr_IFACE_NAMELEN))
+        {
+            for (i = 0; i < fib->n_ifs; i++)
+            {
+                if (!strncmp(fib->ifnames[i], rt->interface, sr_IFACE_NAMELEN))
+                { break; }
+            }
+        }
+        assert(i < fib->n_ifs);
+        rec.dest = rt->dest.s_addr;
+        rec.gw = rt->gw.s_addr;
+        rec.mask = rt->mask.s_addr;
+        rec.iface = i;
+        ok = fib_write(fp, &rec, sizeof(rec));
+    }
+
+    if (fclose(fp) != 0)
+    { ok = 0; }
+    if (ok && rename(tmp, path) != 0)
+    {
+        perror("rename(..):sr_fib_save");
+        ok = 0;
+    }
+    if (!ok)
+    {
+        fprintf(stderr, "Error writing compiled FIB %s\n", path);
+        unlink(tmp);
+    }
+    free(tmp);
+    return ok ? 0 : -1;
+} /* -- sr_fib_save -- */
+
+/* every slot must be empty, a valid next hop, group or chunk */
+static int fib_slots_ok(const uint32_t* slot, size_t n, uint32_t n_chunks,
+                        uint32_t n_nh, uint32_t n_groups)
+{
+    size_t i;
+
+    for (i = 0; i < n; i++)
+    {
+        if (slot[i] & SR_FIB_CHILD)
+        {
+            if ((slot[i] & ~SR_FIB_CHILD) >= n_chunks)
+            { return 0; }
+        }
+        else if (slot[i] & SR_FIB_GROUP)
+        {
+            if ((slot[i] & ~SR_FIB_GROUP) == 0 ||
+                (slot[i] & ~SR_FIB_GROUP) > n_groups)
+            { return 0; }
+        }
+        else if (slot[i] > n_nh)
+        { return 0; }
+    }
+    return 1;
+} /* -- fib_slots_ok -- */
+
+/*---------------------------------------------------------------------
+ * Method: fib_levels_ok(..)
+ * Scope:  Local
+ *
+ * Chunks pointed at from l0 are level 1, chunks pointed at from those
+ * are level 2, and level 2 slots must be leaves.  A chunk at both levels
+ * or a child below level 2 would let a lookup go deeper than the three
+ * steps sr_fib_lookup takes, reading a tagged slot as a next hop.  Slot
+ * indices are already known to be in range.
+ *
+ *---------------------------------------------------------------------*/
+
+static int fib_levels_ok(const struct sr_fib* fib)
+{
+    unsigned char* level;
+    const uint32_t* slot;
+    uint32_t c, j;
+    size_t i;
+    int ok = 1;
+
+    level = (unsigned char*)calloc(fib->n_chunks ? fib->n_chunks : 1, 1);
+    assert(level);
+
+    for (i = 0; i < SR_FIB_L0_SIZE; i++)
+    {
+        if (fib->l0[i] & SR_FIB_CHILD)
+        { level[fib->l0[i] & ~SR_FIB_CHILD] = 1; }
+    }
+    for (c = 0; ok && c < fib->n_chunks; c++)
+    {
+        if (level[c] != 1)
+        { continue; }
+        slot = fib->chunks + (size_t)c * SR_FIB_CHUNK;
+        for (j = 0; j < SR_FIB_CHUNK; j++)
+        {
+            if (!(slot[j] & SR_FIB_CHILD))
+            { continue; }
+            if (level[slot[j] & ~SR_FIB_CHILD] == 1)
+            {
+                ok = 0;
+                break;
+            }
+            level[slot[j] & ~SR_FIB_CHILD] = 2;
+        }
+    }
+    for (c = 0; ok && c < fib->n_chunks; c++)
+    {
+        if (level[c] != 2)
+        { continue; }
+        slot = fib->chunks + (size_t)c * SR_FIB_CHUNK;
+        for (j = 0; j < SR_FIB_CHUNK; j++)
+        {
+            if (slot[j] & SR_FIB_CHILD)
+            {
+                ok = 0;
+                break;
+            }
+        }
+    }
+    free(level);
+    return ok;
+} /* -- fib_levels_ok -- */
+
+/* groups cover their members and nothing else */
+static int fib_groups_ok(const struct sr_fib* fib)
+{
+    const struct sr_fib_group* g;
+    unsigned int i;
+
+    for (i = 0; i < fib->n_groups; i++)
+    {
+        g = &fib->groups[i];
+        if (g->n < 2 || g->n > SR_FIB_ECMP_MAX || g->first > fib->n_nh ||
+            g->n > fib->n_nh - g->first)
+        { return 0; }
+    }
+    for (i = 0; i < fib->n_nh; i++)
+    {
+        if (fib->nh[i].group == 0)
+        { continue; }
+        if (fib->nh[i].group > fib->n_groups)
+        { return 0; }
+        g = &fib->groups[fib->nh[i].group - 1];
+        if (i < g->first || i >= g->first + g->n)
+        { return 0; }
+    }
+    return 1;
+} /* -- fib_groups_ok -- */
+
+/*---------------------------------------------------------------------
+ * Method: sr_fib_map(..)
+ * Scope:  Global
+ *
+ * Map a compiled FIB.  The trie is used in place, read only; only the
+ * interface pointers and the route list are allocated.  Every slot is
+ * checked once, for its index and for the trie level it sits at, which
+ * also faults the trie in before it carries traffic.  The interfaces are
+ * resolved when the FIB is published.
+ *
+ *---------------------------------------------------------------------*/
+
+struct sr_fib* sr_fib_map(const char* path, struct sr_rt** routes)
+{
+    const struct sr_fib_file* hdr;
+    const struct sr_fib_file_route* rec;
+    struct sr_fib* fib;
+    struct sr_rt** tail = routes;
+    struct sr_rt* rt;
+    struct stat st;
+    void* map;
+    unsigned int i;
+    int fd;
+
+    /* -- REQUIRES -- */
+    assert(path);
+    assert(routes);
+
+    *routes = 0;
+    if ((fd = open(path, O_RDONLY)) < 0)
+    {
+        perror("open(..):sr_fib_map");
+        return 0;
+    }
+    if (fstat(fd, &st) < 0 || st.st_size < (off_t)sizeof(struct sr_fib_file))
+    {
+        fprintf(stderr, "Error: %s is too short for a compiled FIB\n", path);
+        close(fd);
+        return 0;
+    }
+    map = mmap(0, st.st_size, PROT_READ, MAP_PRIVATE, fd, 0);
+    close(fd);
+    if (map == MAP_FAILED)
+    {
+        perror("mmap(..):sr_fib_map");
+        return 0;
+    }
+
+    hdr = (const struct sr_fib_file*)map;
+    if (memcmp(hdr->magic, SR_FIB_MAGIC, sizeof(hdr->magic)) ||
+        hdr->order != SR_FIB_ORDER || hdr->l0_bits != SR_FIB_L0_BITS ||
+        hdr->n_chunks >= SR_FIB_GROUP || hdr->n_nh >= SR_FIB_GROUP ||
+        hdr->n_groups >= SR_FIB_GROUP || hdr->n_ifs > 0xffff ||
+        hdr->size != (uint64_t)st.st_size ||
+        hdr->size != fib_file_size(hdr->n_chunks, hdr->n_nh, hdr->n_groups,
+                                   hdr->n_ifs, hdr->n_routes))
+    {
+        fprintf(stderr, "Error: %s is not a compiled FIB for this router\n",
+                path);
+        munmap(map, st.st_size);
+        return 0;
+    }
+
+    fib = (struct sr_fib*)calloc(1, sizeof(struct sr_fib));
+    assert(fib);
+    fib->map = map;
+    fib->map_len = st.st_size;
+    fib->l0 = (uint32_t*)(hdr + 1);
+    fib->chunks = fib->l0 + SR_FIB_L0_SIZE;
+    fib->n_chunks = fib->cap_chunks = hdr->n_chunks;
+    fib->nh = (struct sr_fib_nh*)(fib->chunks +
+                                  (size_t)hdr->n_chunks * SR_FIB_CHUNK);
+    fib->n_nh = fib->cap_nh = hdr->n_nh;
+    fib->groups = (struct sr_fib_group*)(fib->nh + hdr->n_nh);
+    fib->n_groups = fib->cap_groups = hdr->n_groups;
+    fib->ifnames = (char (*)[sr_IFACE_NAMELEN])(fib->groups + hdr->n_groups);
+    fib->n_ifs = hdr->n_ifs;
+    fib->ifs = (struct sr_if**)calloc(fib->n_ifs ? fib->n_ifs : 1,
+                                      sizeof(struct sr_if*));
+    fib->nh_pkts = (uint64_t*)calloc(fib->n_nh ? fib->n_nh : 1,
+                                     sizeof(uint64_t));
+    assert(fib->ifs && fib->nh_pkts);
+    rec = (const struct sr_fib_file_route*)(fib->ifnames + hdr->n_ifs);
+
+    /* -- a bad index would send lookups outside the mapping -- */
+    if (!fib_slots_ok(fib->l0, SR_FIB_L0_SIZE, hdr->n_chunks, hdr->n_nh,
+                      hdr->n_groups) ||
+        !fib_slots_ok(fib->chunks, (size_t)hdr->n_chunks * SR_FIB_CHUNK,
+                      hdr->n_chunks, hdr->n_nh, hdr->n_groups) ||
+        !fib_levels_ok(fib) || !fib_groups_ok(fib))
+    { goto corrupt; }
+    for (i = 0; i < fib->n_nh; i++)
+    {
+        if (fib->nh[i].iface >= fib->n_ifs)
+        { goto corrupt; }
+    }
+    for (i = 0; i < fib->n_ifs; i++)
+    {
+        if (memchr(fib->ifnames[i], '\0', sr_IFACE_NAMELEN) == 0)
+        { goto corrupt; }
+    }
+
+    for (i = 0; i < hdr->n_routes; i++, rec++)
+    {
+        if (rec->iface >= fib->n_ifs)
+        { goto corrupt; }
+        rt = (struct sr_rt*)malloc(sizeof(struct sr_rt));
+        assert(rt);
+        rt->dest.s_addr = rec->dest;
+        rt->gw.s_addr = rec->gw;
+        rt->mask.s_addr = rec->mask;
+        memcpy(rt->interface, fib->ifnames[rec->iface], sr_IFACE_NAMELEN);
+        rt->next = 0;
+        *tail = rt;
+        tail = &rt->next;
+    }
+
+    fib->gen = fib_next_gen();
+    return fib;
+
+corrupt:
+    fprintf(stderr, "Error: compiled FIB %s is corrupt\n", path);
+    sr_rt_free(*routes);
+    *routes = 0;
+    sr_fib_destroy(fib);
+    return 0;
+} /* -- sr_fib_map -- */
+
+static void fib_free(void* fib)
+{
+    sr_fib_destroy((struct sr_fib*)fib);
+} /* -- fib_free -- */
+
+/*---------------------------------------------------------------------
+ * Method: sr_fib_publish(..)
+ * Scope:  Global
+ *
+ * Make fib the one the forwarding path uses.  It is attached first if
+ * the interfaces are known; the previous FIB is retired and freed once
+ * no reader can still be using it.  Callers serialize on sr->rt_lock.
+ *
+ * Returns -1 without publishing if fib names an interface the router
+ * does not have, since forwarding would find no interface there; fib
+ * then still belongs to the caller.
+ *
+ *---------------------------------------------------------------------*/
+
+int sr_fib_publish(struct sr_instance* sr, struct sr_fib* fib)
+{
+    struct sr_fib* old;
+
+    /* -- REQUIRES -- */
+    assert(sr);
+
+    if (fib && sr->if_list && sr_fib_attach(fib, sr) != 0)
+    { return -1; }
+
+    __sync_synchronize();   /* fully built before anyone can load it */
+    old = __sync_lock_test_and_set(&sr->fib, fib);
+    sr_epoch_retire(old, fib_free);
+    return 0;
+} /* -- sr_fib_publish -- */
+
+struct sr_fib* sr_fib_current(struct sr_instance* sr)
+{
+    return *(struct sr_fib* volatile*)&sr->fib;
+} /* -- sr_fib_current -- */
+
+/* the trie went on to the copy sr_fib_reattach published */
+static void fib_shell_free(void* fib)
+{
+    free(((struct sr_fib*)fib)->nh_pkts);
+    free(((struct sr_fib*)fib)->ifs);
+    free(fib);
+} /* -- fib_shell_free -- */
+
+/*---------------------------------------------------------------------
+ * Method: sr_fib_reattach(..)
+ * Scope:  Global
+ *
+ * Readers may hold the current FIB, so its interface table cannot be
+ * rewritten in place.  A copy takes over the trie, mapped or built, and
+ * gets interface and counter arrays of its own; the old one is retired
+ * without the trie.  Used once the interfaces become known, so a FIB
+ * loaded before then, e.g. a compiled one, is not thrown away.  Callers
+ * hold sr->rt_lock.
+ *
+ *---------------------------------------------------------------------*/
+
+int sr_fib_reattach(struct sr_instance* sr)
+{
+    struct sr_fib* cur;
+    struct sr_fib* fib;
+
+    /* -- REQUIRES -- */
+    assert(sr);
+
+    if ((cur = sr_fib_current(sr)) == 0)
+    { return 0; }
+
+    fib = (struct sr_fib*)malloc(sizeof(struct sr_fib));
+    assert(fib);
+    *fib = *cur;
+    fib->ifs = (struct sr_if**)calloc(fib->n_ifs ? fib->n_ifs : 1,
+                                      sizeof(struct sr_if*));
+    fib->nh_pkts = (uint64_t*)malloc((fib->n_nh ? fib->n_nh : 1) *
+                                     sizeof(uint64_t));
+    assert(fib->ifs && fib->nh_pkts);
+    memcpy(fib->nh_pkts, cur->nh_pkts, fib->n_nh * sizeof(uint64_t));
+
+    if (sr_fib_attach(fib, sr) != 0)
+    {
+        fib_shell_free(fib);
+        return -1;
+    }
+
+    __sync_synchronize();
+    cur = __sync_lock_test_and_set(&sr->fib, fib);
+    sr_epoch_retire(cur, fib_shell_free);
+    return 0;
+} /* -- sr_fib_reattach -- */
+
+/*---------------------------------------------------------------------
+ * Method: sr_fib_lookup(..)
+ * Scope:  Global
+ *
+ * Longest prefix match on a host byte order address.
+ *
+ *---------------------------------------------------------------------*/
+
+const struct sr_fib_nh* sr_fib_lookup(const struct sr_fib* fib, uint32_t ip)
+{
+    uint32_t e;
+
+    if (!fib)
+    { return NULL; }
+
+    e = fib->l0[ip >> 16];
+    if (e & SR_FIB_CHILD)
+    {
+        e = fib->chunks[(e & ~SR_FIB_CHILD) * SR_FIB_CHUNK + ((ip >> 8) & 0xff)];
+        if (e & SR_FIB_CHILD)
+        { e = fib->chunks[(e & ~SR_FIB_CHILD) * SR_FIB_CHUNK + (ip & 0xff)]; }
+    }
+
+    if (e & SR_FIB_GROUP)
+    { return &fib->nh[fib->groups[(e & ~SR_FIB_GROUP) - 1].first]; }
+    return e ? &fib->nh[e - 1] : NULL;
+} /* -- sr_fib_lookup -- */
+
+struct sr_if* sr_fib_iface(const struct sr_fib* fib, const struct sr_fib_nh* nh)
+{
+    return fib->ifs[nh->iface];
+} /* -- sr_fib_iface -- */
+
+/*---------------------------------------------------------------------
+ * Method: sr_fib_member(..)
+ * Scope:  Global
+ *
+ * Uses the high half of the hash; the low bits already chose the worker
+ * thread, so they are the same for every flow a worker sees.
+ *
+ *---------------------------------------------------------------------*/
+
+const struct sr_fib_nh* sr_fib_member(const struct sr_fib* fib,
+                                      const struct sr_fib_nh* nh,
+                                      uint32_t hash)
+{
+    const struct sr_fib_group* g;
+
+    if (!nh->group)
+    { return nh; }
+    g = &fib->groups[nh->group - 1];
+    return &fib->nh[g->first + (hash >> 16) % g->n];
+} /* -- sr_fib_member -- */
+
+void sr_fib_count(const struct sr_fib* fib, const struct sr_fib_nh* nh)
+{
+    if (nh->group)
+    { __sync_fetch_and_add(&fib->nh_pkts[nh - fib->nh], 1); }
+} /* -- sr_fib_count -- */
@@ -0,0 +1,184 @@
+/*-----------------------------------------------------------------------------
+ * file:  sr_fib.h
+ *
+ * Description:
+ *
+ * Forwarding information base compiled from the routing table.
+ *
+ * The FIB is a fixed-stride (16-8-8) multibit trie built by controlled
+ * prefix expansion of the struct sr_rt entries.  A lookup touches at most
+ * three table slots no matter how many routes are installed.  Leaves point
+ * at a compact next hop which refers to the outgoing interface by index
+ * rather than by name.
+ *
+ * Routes for the same prefix with different gateways or interfaces form
+ * an equal cost multipath group.  Its members are contiguous next hops;
+ * the forwarding path picks one by flow hash (sr_fib_member), so a flow
+ * stays on one member, and counts what it sends through each
+ * (sr_fib_count).
+ *
+ * A FIB can also be compiled ahead of time (see sr_fibc) into a file that
+ * holds the trie arrays exactly as they sit in memory, followed by the
+ * routes it was built from.  Loading it maps the file and points the
+ * FIB at it, so start up does no parsing and no prefix expansion.
+ *
+ *---------------------------------------------------------------------------*/
+
+#ifndef SR_FIB_H
+#define SR_FIB_H
+
+#ifdef _LINUX_
+#include <stdint.h>
+#endif /* _LINUX_ */
+
+#ifdef _DARWIN_
+#include <inttypes.h>
+#endif /* _DARWIN_ */
+
+#include <stddef.h>
+
+#include "sr_protocol.h"
+
+#define SR_FIB_L0_BITS  16
+#define SR_FIB_L0_SIZE  (1 << SR_FIB_L0_BITS)
+#define SR_FIB_CHUNK    256
+#define SR_FIB_CHILD    0x80000000u  /* slot holds a child chunk index */
+#define SR_FIB_GROUP    0x40000000u  /* slot holds a group index plus one */
+#define SR_FIB_ECMP_MAX 16           /* members per group */
+
+struct sr_instance;
+struct sr_if;
+struct sr_rt;
+
+/* ----------------------------------------------------------------------------
+ * struct sr_fib_nh
+ *
+ * Next hop shared by every prefix that forwards through it.
+ *
+ * -------------------------------------------------------------------------- */
+
+struct sr_fib_nh
+{
+    uint32_t gw;        /* gateway, host byte order */
+    uint16_t iface;     /* index into the FIB interface table */
+    uint16_t group;     /* multipath group index plus one, 0 if none */
+};
+
+/* ----------------------------------------------------------------------------
+ * struct sr_fib_group
+ *
+ * Members are nh[first] .. nh[first + n - 1], ordered by gateway and
+ * interface, and belong to no other group or prefix.  Prefixes with the
+ * same set of next hops share the group.
+ *
+ * -------------------------------------------------------------------------- */
+
+struct sr_fib_group
+{
+    uint32_t first;
+    uint16_t n;
+    uint8_t len;        /* first prefix using the group, for display */
+    uint8_t pad;
+    uint32_t prefix;    /* host byte order */
+};
+
+/* ----------------------------------------------------------------------------
+ * struct sr_fib
+ *
+ * A slot value of 0 means no route, SR_FIB_CHILD|n points at chunk n and
+ * SR_FIB_GROUP|n is multipath group n - 1 and any other value is a next
+ * hop index plus one.
+ *
+ * -------------------------------------------------------------------------- */
+
+struct sr_fib
+{
+    uint32_t* l0;               /* SR_FIB_L0_SIZE slots, top 16 bits */
+    uint32_t* chunks;           /* SR_FIB_CHUNK slots per 8 bit stride */
+    unsigned int n_chunks;
+    unsigned int cap_chunks;
+    struct sr_fib_nh* nh;
+    unsigned int n_nh;
+    unsigned int cap_nh;
+    struct sr_fib_group* groups;
+    unsigned int n_groups;
+    unsigned int cap_groups;
+    uint64_t* nh_pkts;          /* per next hop, counted for members only */
+    char (*ifnames)[sr_IFACE_NAMELEN];
+    struct sr_if** ifs;         /* resolved by sr_fib_attach */
+    unsigned int n_ifs;
+    uint32_t gen;               /* new on every build and attach, never 0 */
+    void* map;                  /* compiled file the arrays live in, or 0 */
+    size_t map_len;
+};
+
+#define SR_FIB_MAGIC    "SRFIB02"
+#define SR_FIB_ORDER    0x01020304u  /* written in host byte order */
+
+/* ----------------------------------------------------------------------------
+ * struct sr_fib_file
+ *
+ * Header of a compiled FIB.  It is followed by l0, chunks, nh, groups,
+ * ifnames and then n_routes struct sr_fib_file_route, all in host byte
+ * order.
+ *
+ * -------------------------------------------------------------------------- */
+
+struct sr_fib_file
+{
+    char magic[8];              /* SR_FIB_MAGIC */
+    uint32_t order;             /* SR_FIB_ORDER, rejects foreign files */
+    uint32_t l0_bits;           /* SR_FIB_L0_BITS */
+    uint32_t n_chunks;
+    uint32_t n_nh;
+    uint32_t n_ifs;
+    uint32_t n_routes;
+    uint32_t n_groups;
+    uint32_t pad;
+    uint64_t size;              /* of the whole file */
+};
+
+struct sr_fib_file_route
+{
+    uint32_t dest;              /* network byte order, as in struct sr_rt */
+    uint32_t gw;
+    uint32_t mask;
+    uint32_t iface;             /* index into the file's ifnames */
+};
+
+struct sr_fib* sr_fib_build(struct sr_rt* routes);
+int sr_fib_attach(struct sr_fib* fib, struct sr_instance* sr);
+void sr_fib_destroy(struct sr_fib* fib);
+
+/* Compiled FIB files.  sr_fib_map returns the FIB and, in *routes, the
+   list it was compiled from; 0 if the file is not a valid compiled FIB. */
+int sr_fib_file_check(const char* path);
+int sr_fib_save(const struct sr_fib* fib, const struct sr_rt* routes,
+                const char* path);
+struct sr_fib* sr_fib_map(const char* path, struct sr_rt** routes);
+
+/* Swap in a new FIB without stopping readers.  Readers load the current
+   one once, with sr_fib_current, inside an sr_epoch_enter/exit section
+   and use only that pointer until they leave it.  Fails, returning -1,
+   if fib names an interface the router lacks. */
+int sr_fib_publish(struct sr_instance* sr, struct sr_fib* fib);
+struct sr_fib* sr_fib_current(struct sr_instance* sr);
+
+/* Publish the current FIB again against the router's interfaces as they
+   are now, without rebuilding the trie.  -1 if one is missing. */
+int sr_fib_reattach(struct sr_instance* sr);
+
+/* Longest prefix match, ip in host byte order.  Returns NULL if no route,
+   the first member for a multipath route. */
+const struct sr_fib_nh* sr_fib_lookup(const struct sr_fib* fib, uint32_t ip);
+struct sr_if* sr_fib_iface(const struct sr_fib* fib,
+                           const struct sr_fib_nh* nh);
+
+/* Member of nh's group for a flow hash (sr_flow_hash), nh itself if it is
+   not in a group.  Count a packet sent through nh if it is a member. */
+const struct sr_fib_nh* sr_fib_member(const struct sr_fib* fib,
+                                      const struct sr_fib_nh* nh,
+                                      uint32_t hash);
+void sr_fib_count(const struct sr_fib* fib, const struct sr_fib_nh* nh);
+
+#endif /* -- SR_FIB_H -- */
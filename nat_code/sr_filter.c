@@ -0,0 +1,350 @@
+/*-----------------------------------------------------------------------------
+ * file:  sr_filter.c
+ *
+ * Description:
+ *
+ * Capture filter for the packet log, see sr_filter.h.
+ *
+ *---------------------------------------------------------------------------*/
+
+#include <stdio.h>
+#include <stdlib.h>
+#include <assert.h>
+#include <string.h>
+#include <ctype.h>
+#include <netinet/in.h>
+#include <arpa/inet.h>
+
+#include "sr_protocol.h"
+#include "sr_filter.h"
+
+struct filter_parse
+{
+    const char* p;      /* rest of the expression */
+    char tok[64];       /* current token, "" at the end */
+    struct sr_filter* f;
+    int err;
+};
+
+static void filter_expr(struct filter_parse* ps);
+
+/*---------------------------------------------------------------------
+ * Method: filter_next(..)
+ * Scope:  Local
+ *
+ * Words are separated by blanks, parentheses are tokens of their own.
+ *
+ *---------------------------------------------------------------------*/
+
+static void filter_next(struct filter_parse* ps)
+{
+    unsigned int n = 0;
+
+    while (isspace((unsigned char)*ps->p))
+    { ps->p++; }
+    if (*ps->p == '(' || *ps->p == ')')
+    { ps->tok[n++] = *ps->p++; }
+    else
+    {
+        while (*ps->p && !isspace((unsigned char)*ps->p) &&
+               *ps->p != '(' && *ps->p != ')')
+        {
+            if (n < sizeof(ps->tok) - 1)
+            { ps->tok[n++] = *ps->p; }
+            ps->p++;
+        }
+    }
+    ps->tok[n] = 0;
+} /* -- filter_next -- */
+
+static void filter_error(struct filter_parse* ps, const char* what)
+{
+    if (!ps->err)
+    {
+        fprintf(stderr, "filter: %s at '%s'\n", what,
+                ps->tok[0] ? ps->tok : "end");
+    }
+    ps->err = 1;
+} /* -- filter_error -- */
+
+static void filter_emit(struct filter_parse* ps, enum sr_filter_op op,
+                        uint32_t addr, uint32_t mask, uint16_t val)
+{
+    struct sr_filter_insn* in;
+
+    if (ps->f->n == SR_FILTER_MAX)
+    { filter_error(ps, "expression too long"); return; }
+    in = &ps->f->insn[ps->f->n++];
+    in->op = op;
+    in->addr = addr & mask;
+    in->mask = mask;
+    in->val = val;
+} /* -- filter_emit -- */
+
+static int filter_number(const char* s, unsigned long max, unsigned long* v)
+{
+    char* end;
+
+    if (!isdigit((unsigned char)*s))
+    { return -1; }
+    *v = strtoul(s, &end, 10);
+    return (*end || *v > max) ? -1 : 0;
+} /* -- filter_number -- */
+
+/*---------------------------------------------------------------------
+ * Method: filter_prim(..)
+ * Scope:  Local
+ *
+ * One test, with its optional src/dst qualifier.
+ *
+ *---------------------------------------------------------------------*/
+
+static void filter_prim(struct filter_parse* ps)
+{
+    int dir = 0;    /* -- 1 src, 2 dst, 0 either -- */
+    unsigned long v;
+    struct in_addr a;
+    char* slash;
+
+    if (strcmp(ps->tok, "src") == 0 || strcmp(ps->tok, "dst") == 0)
+    {
+        dir = ps->tok[0] == 's' ? 1 : 2;
+        filter_next(ps);
+    }
+
+    if (dir == 0 && strcmp(ps->tok, "arp") == 0)
+    { filter_emit(ps, sr_filter_arp, 0, 0, 0); }
+    else if (dir == 0 && strcmp(ps->tok, "ip") == 0)
+    { filter_emit(ps, sr_filter_ip, 0, 0, 0); }
+    else if (dir == 0 && strcmp(ps->tok, "icmp") == 0)
+    { filter_emit(ps, sr_filter_proto, 0, 0, IPPROTO_ICMP); }
+    else if (dir == 0 && strcmp(ps->tok, "tcp") == 0)
+    { filter_emit(ps, sr_filter_proto, 0, 0, IPPROTO_TCP); }
+    else if (dir == 0 && strcmp(ps->tok, "udp") == 0)
+    { filter_emit(ps, sr_filter_proto, 0, 0, IPPROTO_UDP); }
+    else if (dir == 0 && strcmp(ps->tok, "proto") == 0)
+    {
+        filter_next(ps);
+        if (filter_number(ps->tok, 255, &v) != 0)
+        { filter_error(ps, "expected a protocol number"); return; }
+        filter_emit(ps, sr_filter_proto, 0, 0, (uint16_t)v);
+    }
+    else if (strcmp(ps->tok, "host") == 0 || strcmp(ps->tok, "net") == 0)
+    {
+        int is_net = ps->tok[0] == 'n';
+        uint32_t mask = 0xffffffff;
+
+        filter_next(ps);
+        if ((slash = strchr(ps->tok, '/')) != 0)
+        {
+            if (!is_net || filter_number(slash + 1, 32, &v) != 0)
+            { filter_error(ps, "bad prefix length"); return; }
+            *slash = 0;
+            mask = v ? 0xffffffff << (32 - v) : 0;
+        }
+        if (inet_pton(AF_INET, ps->tok, &a) != 1)
+        {
+            if (slash)
+            { *slash = '/'; }
+            filter_error(ps, "expected an address");
+            return;
+        }
+        filter_emit(ps, dir == 1 ? sr_filter_src_net :
+                        dir == 2 ? sr_filter_dst_net : sr_filter_net,
+                    a.s_addr, htonl(mask), 0);
+    }
+    else if (strcmp(ps->tok, "port") == 0)
+    {
+        filter_next(ps);
+        if (filter_number(ps->tok, 65535, &v) != 0)
+        { filter_error(ps, "expected a port number"); return; }
+        filter_emit(ps, dir == 1 ? sr_filter_src_port :
+                        dir == 2 ? sr_filter_dst_port : sr_filter_port,
+                    0, 0, (uint16_t)v);
+    }
+    else
+    { filter_error(ps, "unknown primitive"); return; }
+
+    filter_next(ps);
+} /* -- filter_prim -- */
+
+static void filter_fact(struct filter_parse* ps)
+{
+    if (ps->err)
+    { return; }
+    if (strcmp(ps->tok, "not") == 0)
+    {
+        filter_next(ps);
+        filter_fact(ps);
+        filter_emit(ps, sr_filter_not, 0, 0, 0);
+    }
+    else if (strcmp(ps->tok, "(") == 0)
+    {
+        filter_next(ps);
+        filter_expr(ps);
+        if (strcmp(ps->tok, ")") != 0)
+        { filter_error(ps, "expected ')'"); return; }
+        filter_next(ps);
+    }
+    else
+    { filter_prim(ps); }
+} /* -- filter_fact -- */
+
+static void filter_term(struct filter_parse* ps)
+{
+    filter_fact(ps);
+    while (!ps->err && strcmp(ps->tok, "and") == 0)
+    {
+        filter_next(ps);
+        filter_fact(ps);
+        filter_emit(ps, sr_filter_and, 0, 0, 0);
+    }
+} /* -- filter_term -- */
+
+static void filter_expr(struct filter_parse* ps)
+{
+    filter_term(ps);
+    while (!ps->err && strcmp(ps->tok, "or") == 0)
+    {
+        filter_next(ps);
+        filter_term(ps);
+        filter_emit(ps, sr_filter_or, 0, 0, 0);
+    }
+} /* -- filter_expr -- */
+
+/*---------------------------------------------------------------------
+ * Method: sr_filter_compile(..)
+ * Scope:  Global
+ *
+ *---------------------------------------------------------------------*/
+
+struct sr_filter* sr_filter_compile(const char* expr)
+{
+    struct filter_parse ps;
+
+    /* -- REQUIRES -- */
+    assert(expr);
+
+    ps.p = expr;
+    ps.err = 0;
+    ps.f = (struct sr_filter*)calloc(1, sizeof(struct sr_filter));
+    assert(ps.f);
+
+    filter_next(&ps);
+    filter_expr(&ps);
+    if (!ps.err && ps.tok[0])
+    { filter_error(&ps, "unexpected word"); }
+    if (ps.err)
+    {
+        free(ps.f);
+        return 0;
+    }
+    return ps.f;
+} /* -- sr_filter_compile -- */
+
+/*---------------------------------------------------------------------
+ * Method: sr_filter_match(..)
+ * Scope:  Global
+ *
+ * Decode the headers once, then run the program on a stack of results.
+ * Tests on fields the frame does not have are false.
+ *
+ *---------------------------------------------------------------------*/
+
+int sr_filter_match(const struct sr_filter* f, const uint8_t* frame,
+                    unsigned int len)
+{
+    const struct sr_ethernet_hdr* e = (const struct sr_ethernet_hdr*)frame;
+    const struct sr_filter_insn* in;
+    uint16_t type = 0;
+    int is_ip = 0, has_addr = 0, has_port = 0;
+    uint32_t src = 0, dst = 0;
+    uint16_t sport = 0, dport = 0;
+    uint8_t proto = 0;
+    uint8_t st[SR_FILTER_MAX];
+    unsigned int sp = 0, i;
+
+    if (len >= sizeof(struct sr_ethernet_hdr))
+    { type = ntohs(e->ether_type); }
+
+    if (type == ethertype_ip &&
+        len >= sizeof(struct sr_ethernet_hdr) + sizeof(struct sr_ip_hdr))
+    {
+        const struct sr_ip_hdr* ip = (const struct sr_ip_hdr*)(e + 1);
+        unsigned int hl = ip->ip_hl * 4;
+
+        is_ip = has_addr = 1;
+        src = ip->ip_src;
+        dst = ip->ip_dst;
+        proto = ip->ip_p;
+        if ((proto == IPPROTO_TCP || proto == IPPROTO_UDP) &&
+            (ntohs(ip->ip_off) & IP_OFFMASK) == 0 &&
+            len >= sizeof(struct sr_ethernet_hdr) + hl + 4)
+        {
+            const uint16_t* ports = (const uint16_t*)((const uint8_t*)ip + hl);
+
+            has_port = 1;
+            sport = ntohs(ports[0]);
+            dport = ntohs(ports[1]);
+        }
+    }
+    else if (type == ethertype_arp &&
+             len >= sizeof(struct sr_ethernet_hdr) + sizeof(struct sr_arp_hdr))
+    {
+        const struct sr_arp_hdr* arp = (const struct sr_arp_hdr*)(e + 1);
+
+        has_addr = 1;
+        src = arp->ar_sip;
+        dst = arp->ar_tip;
+    }
+
+    for (i = 0, in = f->insn; i < f->n; i++, in++)
+    {
+        switch (in->op)
+        {
+            case sr_filter_arp:
+                st[sp++] = type == ethertype_arp;
+                break;
+            case sr_filter_ip:
+                st[sp++] = is_ip;
+                break;
+            case sr_filter_proto:
+                st[sp++] = is_ip && proto == in->val;
+                break;
+            case sr_filter_src_net:
+                st[sp++] = has_addr && (src & in->mask) == in->addr;
+                break;
+            case sr_filter_dst_net:
+                st[sp++] = has_addr && (dst & in->mask) == in->addr;
+                break;
+            case sr_filter_net:
+                st[sp++] = has_addr && ((src & in->mask) == in->addr ||
+                                        (dst & in->mask) == in->addr);
+                break;
+            case sr_filter_src_port:
+                st[sp++] = has_port && sport == in->val;
+                break;
+            case sr_filter_dst_port:
+                st[sp++] = has_port && dport == in->val;
+                break;
+            case sr_filter_port:
+                st[sp++] = has_port && (sport == in->val || dport == in->val);
+                break;
+            case sr_filter_not:
+                st[sp - 1] = !st[sp - 1];
+                break;
+            case sr_filter_and:
+                sp--;
+                st[sp - 1] = st[sp - 1] && st[sp];
+                break;
+            case sr_filter_or:
+                sp--;
+                st[sp - 1] = st[sp - 1] || st[sp];
+                break;
+        }
+    }
+    return st[0];
+} /* -- sr_filter_match -- */
+
+void sr_filter_destroy(struct sr_filter* f)
+{ free(f); }
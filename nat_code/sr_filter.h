@@ -0,0 +1,74 @@
+/*-----------------------------------------------------------------------------
+ * file:  sr_filter.h
+ *
+ * Description:
+ *
+ * Capture filter for the packet log (-F).  A small tcpdump-like expression
+ * is compiled once into a postfix program over fields decoded from the
+ * Ethernet, IP and TCP/UDP headers:
+ *
+ *   expr  := term { "or" term }
+ *   term  := fact { "and" fact }
+ *   fact  := "not" fact | "(" expr ")" | prim
+ *   prim  := "arp" | "ip" | "icmp" | "tcp" | "udp" | "proto" N
+ *          | [ "src" | "dst" ] "host" A.B.C.D
+ *          | [ "src" | "dst" ] "net" A.B.C.D/len
+ *          | [ "src" | "dst" ] "port" N
+ *
+ * e.g. "udp and dst net 10.0.2.0/24" or "icmp or (tcp and port 80)".
+ *
+ *---------------------------------------------------------------------------*/
+
+#ifndef SR_FILTER_H
+#define SR_FILTER_H
+
+#ifdef _LINUX_
+#include <stdint.h>
+#endif /* _LINUX_ */
+
+#ifdef _DARWIN_
+#include <inttypes.h>
+#endif /* _DARWIN_ */
+
+#define SR_FILTER_MAX 64 /* instructions */
+
+enum sr_filter_op
+{
+    sr_filter_arp,
+    sr_filter_ip,
+    sr_filter_proto,
+    sr_filter_src_net,
+    sr_filter_dst_net,
+    sr_filter_net,
+    sr_filter_src_port,
+    sr_filter_dst_port,
+    sr_filter_port,
+    sr_filter_not,
+    sr_filter_and,
+    sr_filter_or
+};
+
+struct sr_filter_insn
+{
+    enum sr_filter_op op;
+    uint32_t addr;  /* network order, already masked */
+    uint32_t mask;  /* network order */
+    uint16_t val;   /* protocol or port, host order */
+};
+
+struct sr_filter
+{
+    struct sr_filter_insn insn[SR_FILTER_MAX];
+    unsigned int n;
+};
+
+/* Compile expr, 0 with a message on stderr if it does not parse. */
+struct sr_filter* sr_filter_compile(const char* expr);
+
+/* Non-zero if the frame matches. */
+int sr_filter_match(const struct sr_filter* f, const uint8_t* frame,
+                    unsigned int len);
+
+void sr_filter_destroy(struct sr_filter* f);
+
+#endif /* -- SR_FILTER_H -- */
@@ -0,0 +1,155 @@
+/*-----------------------------------------------------------------------------
+ * file:  sr_icmplim.c
+ *
+ * Description:
+ *
+ * Token buckets for generated ICMP errors, see sr_icmplim.h.
+ *
+ *---------------------------------------------------------------------------*/
+
+#include <stdio.h>
+#include <stdlib.h>
+#include <assert.h>
+#include <string.h>
+#include <time.h>
+
+#include "sr_icmplim.h"
+
+#define ICMPLIM_TOKEN   1000    /* one message in thousandths */
+
+static uint64_t icmplim_now(void)
+{
+    struct timespec ts;
+
+    clock_gettime(CLOCK_MONOTONIC, &ts);
+    return (uint64_t)ts.tv_sec * 1000000000ull + ts.tv_nsec;
+} /* -- icmplim_now -- */
+
+/*---------------------------------------------------------------------
+ * Method: icmplim_refill(..)
+ * Scope:  Local
+ *
+ * Add what rate earned since b->last, up to one second's worth.  last
+ * only moves by the time the added tokens stand for, so frequent calls
+ * at a low rate do not lose the fractions.
+ *
+ *---------------------------------------------------------------------*/
+
+static void icmplim_refill(struct sr_icmplim_bucket* b, unsigned int rate,
+                           uint64_t now)
+{
+    uint64_t full = (uint64_t)rate * ICMPLIM_TOKEN;
+    uint64_t add;
+
+    if (now - b->last >= 1000000000ull)
+    {
+        b->tokens = full;
+        b->last = now;
+        return;
+    }
+    add = (now - b->last) * rate / 1000000;
+    if (add == 0)
+    { return; }
+    b->last += add * 1000000 / rate;
+    b->tokens = b->tokens + add < full ? b->tokens + add : full;
+} /* -- icmplim_refill -- */
+
+/* source bucket for ip, the least recently used way if it has none */
+static struct sr_icmplim_bucket* icmplim_src(struct sr_icmplim* lim,
+                                             uint32_t ip)
+{
+    struct sr_icmplim_bucket* set;
+    struct sr_icmplim_bucket* old;
+    unsigned int w;
+
+    set = lim->src[(ip * 0x9e3779b1u) >> (32 - SR_ICMPLIM_SET_BITS)];
+    old = &set[0];
+    for (w = 0; w < SR_ICMPLIM_WAYS; w++)
+    {
+        if (set[w].ip == ip)
+        { return &set[w]; }
+        if (set[w].last < old->last)
+        { old = &set[w]; }
+    }
+    old->ip = ip;
+    old->last = 0;      /* -- refills to full -- */
+    return old;
+} /* -- icmplim_src -- */
+
+/*---------------------------------------------------------------------
+ * Method: sr_icmplim_create(..)
+ * Scope:  Global
+ *
+ *---------------------------------------------------------------------*/
+
+struct sr_icmplim* sr_icmplim_create(unsigned int rate, unsigned int src_rate)
+{
+    struct sr_icmplim* lim;
+
+    lim = (struct sr_icmplim*)calloc(1, sizeof(struct sr_icmplim));
+    assert(lim);
+    pthread_mutex_init(&lim->lock, 0);
+    /* -- a full bucket in thousandths has to fit 32 bits -- */
+    lim->rate = rate < 1000000 ? rate : 1000000;
+    lim->src_rate = src_rate < 1000000 ? src_rate : 1000000;
+    return lim;
+} /* -- sr_icmplim_create -- */
+
+void sr_icmplim_destroy(struct sr_icmplim* lim)
+{
+    if (lim == 0)
+    { return; }
+    pthread_mutex_destroy(&lim->lock);
+    free(lim);
+} /* -- sr_icmplim_destroy -- */
+
+/*---------------------------------------------------------------------
+ * Method: sr_icmplim_allow(..)
+ * Scope:  Global
+ *
+ * Both buckets are refilled and checked before either is charged, so a
+ * message one of them refuses costs the other nothing.
+ *
+ *---------------------------------------------------------------------*/
+
+int sr_icmplim_allow(struct sr_icmplim* lim, uint32_t src)
+{
+    struct sr_icmplim_bucket* b = 0;
+    uint64_t now;
+    int ok = 1;
+
+    if (lim == 0)
+    { return 1; }
+
+    now = icmplim_now();
+    pthread_mutex_lock(&lim->lock);
+    if (lim->src_rate)
+    {
+        b = icmplim_src(lim, src);
+        icmplim_refill(b, lim->src_rate, now);
+        if (b->tokens < ICMPLIM_TOKEN)
+        {
+            lim->src_limited++;
+            ok = 0;
+        }
+    }
+    if (ok && lim->rate)
+    {
+        icmplim_refill(&lim->global, lim->rate, now);
+        if (lim->global.tokens < ICMPLIM_TOKEN)
+        {
+            lim->limited++;
+            ok = 0;
+        }
+        else
+        { lim->global.tokens -= ICMPLIM_TOKEN; }
+    }
+    if (ok)
+    {
+        if (b)
+        { b->tokens -= ICMPLIM_TOKEN; }
+        lim->sent++;
+    }
+    pthread_mutex_unlock(&lim->lock);
+    return ok;
+} /* -- sr_icmplim_allow -- */
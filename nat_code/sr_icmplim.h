@@ -0,0 +1,60 @@
+/*-----------------------------------------------------------------------------
+ * file:  sr_icmplim.h
+ *
+ * Description:
+ *
+ * Rate limit for the ICMP errors the router generates (time exceeded,
+ * unreachable).  Two token buckets must both have a token: a global one
+ * and one for the source of the packet that caused the error.  Source
+ * buckets live in a fixed set associative table; a new source takes the
+ * least recently used way of its set and starts with a full bucket.
+ *
+ * Each bucket holds one second of its rate.  Checked before send_icmp()
+ * allocates or checksums anything.  Echo replies are not limited.
+ *
+ *---------------------------------------------------------------------------*/
+
+#ifndef SR_ICMPLIM_H
+#define SR_ICMPLIM_H
+
+#ifdef _LINUX_
+#include <stdint.h>
+#endif /* _LINUX_ */
+
+#ifdef _DARWIN_
+#include <inttypes.h>
+#endif /* _DARWIN_ */
+
+#include <pthread.h>
+
+#define SR_ICMPLIM_RATE     1000    /* default errors per second, all */
+#define SR_ICMPLIM_SRC_RATE 100     /* default errors per second, per source */
+#define SR_ICMPLIM_SET_BITS 8
+#define SR_ICMPLIM_WAYS     4
+
+struct sr_icmplim_bucket
+{
+    uint64_t last;      /* ns, tokens are added from here on */
+    uint32_t tokens;    /* thousandths */
+    uint32_t ip;        /* source, network byte order; 0 if unused */
+};
+
+struct sr_icmplim
+{
+    pthread_mutex_t lock;
+    unsigned int rate;          /* per second, 0 no limit */
+    unsigned int src_rate;
+    struct sr_icmplim_bucket global;
+    struct sr_icmplim_bucket src[1 << SR_ICMPLIM_SET_BITS][SR_ICMPLIM_WAYS];
+    unsigned long sent;
+    unsigned long limited;      /* global bucket empty */
+    unsigned long src_limited;  /* source bucket empty */
+};
+
+struct sr_icmplim* sr_icmplim_create(unsigned int rate, unsigned int src_rate);
+void sr_icmplim_destroy(struct sr_icmplim* lim);
+
+/* Non-zero if an error toward src may be sent now; takes the tokens. */
+int sr_icmplim_allow(struct sr_icmplim* lim, uint32_t src);
+
+#endif /* -- SR_ICMPLIM_H -- */
@@ -25,6 +25,21 @@
 #include "sr_if.h"
 #include "sr_router.h"
 
+static unsigned int sr_if_hash_name(const char* name)
+{
+    unsigned int h = 2166136261u; /* FNV-1a */
+    int i;
+
+    for(i = 0; i < sr_IFACE_NAMELEN && name[i]; i++)
+    { h = (h ^ (unsigned char)name[i]) * 16777619u; }
+    return h & (SR_IF_HASH_SZ - 1);
+}
+
+static unsigned int sr_if_hash_ip(uint32_t ip)
+{
+    return (ip * 2654435761u) >> 23 & (SR_IF_HASH_SZ - 1);
+}
+
 /*--------------------------------------------------------------------- 
  * Method: sr_get_interface
  * Scope: Global
@@ -37,11 +52,24 @@
 struct sr_if* sr_get_interface(struct sr_instance* sr, const char* name)
 {
     struct sr_if* if_walker = 0;
+    unsigned int h;
 
     /* -- REQUIRES -- */
     assert(name);
     assert(sr);
 
+    /* -- hashed once sr_index_interfaces(..) has run -- */
+    if(sr->if_count)
+    {
+        for(h = sr_if_hash_name(name); sr->if_name_hash[h];
+            h = (h + 1) & (SR_IF_HASH_SZ - 1))
+        {
+            if(!strncmp(sr->if_name_hash[h]->name,name,sr_IFACE_NAMELEN))
+            { return sr->if_name_hash[h]; }
+        }
+        return 0;
+    }
+
     if_walker = sr->if_list;
 
     while(if_walker)
@@ -54,6 +82,79 @@ struct sr_if* sr_get_interface(struct sr_instance* sr, const char* name)
     return 0;
 } /* -- sr_get_interface -- */
 
+/*--------------------------------------------------------------------- 
+ * Method: sr_get_interface_by_ip
+ * Scope: Global
+ *
+ * Return the interface that owns the given IP (network byte order) or 0
+ * if the address is not local to the router.
+ *
+ *---------------------------------------------------------------------*/
+
+struct sr_if* sr_get_interface_by_ip(struct sr_instance* sr, uint32_t ip_nbo)
+{
+    unsigned int h;
+
+    /* -- REQUIRES -- */
+    assert(sr);
+
+    for(h = sr_if_hash_ip(ip_nbo); sr->if_ip_hash[h];
+        h = (h + 1) & (SR_IF_HASH_SZ - 1))
+    {
+        if(sr->if_ip_hash[h]->ip == ip_nbo)
+        { return sr->if_ip_hash[h]; }
+    }
+
+    return 0;
+} /* -- sr_get_interface_by_ip -- */
+
+/*--------------------------------------------------------------------- 
+ * Method: sr_index_interfaces(..)
+ * Scope: Global
+ *
+ * Number the interfaces in list order and build the index table, the
+ * name hash and the local address set.  Called once the hardware info
+ * has been received.
+ *
+ *---------------------------------------------------------------------*/
+
+void sr_index_interfaces(struct sr_instance* sr)
+{
+    struct sr_if* if_walker = 0;
+    unsigned int h;
+
+    /* -- REQUIRES -- */
+    assert(sr);
+
+    sr->if_count = 0;
+    memset(sr->if_name_hash, 0, sizeof(sr->if_name_hash));
+    memset(sr->if_ip_hash, 0, sizeof(sr->if_ip_hash));
+
+    for(if_walker = sr->if_list; if_walker; if_walker = if_walker->next)
+    {
+        if(sr->if_count == SR_IF_MAX)
+        {
+            fprintf(stderr, "** Error, more than %d interfaces\n", SR_IF_MAX);
+            break;
+        }
+        if_walker->index = sr->if_count;
+        sr->if_table[sr->if_count++] = if_walker;
+
+        h = sr_if_hash_name(if_walker->name);
+        while(sr->if_name_hash[h])
+        { h = (h + 1) & (SR_IF_HASH_SZ - 1); }
+        sr->if_name_hash[h] = if_walker;
+
+        /* -- first interface with an address wins, as the list walk did -- */
+        if(sr_get_interface_by_ip(sr, if_walker->ip))
+        { continue; }
+        h = sr_if_hash_ip(if_walker->ip);
+        while(sr->if_ip_hash[h])
+        { h = (h + 1) & (SR_IF_HASH_SZ - 1); }
+        sr->if_ip_hash[h] = if_walker;
+    }
+} /* -- sr_index_interfaces -- */
+
 /*--------------------------------------------------------------------- 
  * Method: sr_add_interface(..)
  * Scope: Global
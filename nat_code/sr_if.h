@@ -28,6 +28,9 @@
 
 struct sr_instance;
 
+#define SR_IF_MAX      256   /* MAXHWENTRIES, the most VNSHWINFO can carry */
+#define SR_IF_HASH_SZ  512   /* power of two, at least twice SR_IF_MAX */
+
 /* ----------------------------------------------------------------------------
  * struct sr_if
  *
@@ -41,10 +44,13 @@ struct sr_if
   unsigned char addr[ETHER_ADDR_LEN];
   uint32_t ip;
   uint32_t speed;
+  unsigned int index;   /* dense, position in sr->if_table */
   struct sr_if* next;
 };
 
 struct sr_if* sr_get_interface(struct sr_instance* sr, const char* name);
+struct sr_if* sr_get_interface_by_ip(struct sr_instance* sr, uint32_t ip_nbo);
+void sr_index_interfaces(struct sr_instance*);
 void sr_add_interface(struct sr_instance*, const char*);
 void sr_set_ether_addr(struct sr_instance*, const unsigned char*);
 void sr_set_ether_ip(struct sr_instance*, uint32_t ip_nbo);
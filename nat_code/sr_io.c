@@ -0,0 +1,328 @@
+/*-----------------------------------------------------------------------------
+ * file:  sr_io.c
+ *
+ * Description:
+ *
+ * Local packet I/O: interface config, the receive loop and the glue under
+ * sr_send_packet, see sr_io.h.  The device specific parts live in
+ * sr_io_packet.c and sr_io_tap.c.
+ *
+ *---------------------------------------------------------------------------*/
+
+#include <stdio.h>
+#include <stdlib.h>
+#include <assert.h>
+#include <string.h>
+#include <errno.h>
+#include <poll.h>
+
+#include <netinet/in.h>
+#include <arpa/inet.h>
+
+#include "sr_io.h"
+#include "sr_router.h"
+#include "sr_if.h"
+#include "sr_worker.h"
+#include "sr_pool.h"
+
+#define SR_IO_POLL_MS   100
+
+struct sr_io
+{
+    struct sr_io_port ports[SR_IF_MAX];     /* by interface index */
+    struct pollfd pfd[SR_IF_MAX];
+    unsigned int n;
+    /* -- receive loop only -- */
+    struct sr_frame burst[SR_BURST_MAX];
+    unsigned int n_burst;
+};
+
+/* set while the receive loop runs the router, see sr_io_send() */
+static __thread int io_in_rx;
+
+/*---------------------------------------------------------------------
+ * Method: io_parse_config(..)
+ * Scope:  Local
+ *
+ * Fill io->ports from the config file, see sr_io.h for the format.
+ *
+ *---------------------------------------------------------------------*/
+
+static int io_parse_config(struct sr_io* io, const char* config,
+                           char (*names)[sr_IFACE_NAMELEN], uint32_t* ips)
+{
+    FILE* fp;
+    char line[BUFSIZ];
+    char name[32], mac[32], ip[32], dev[32];
+    unsigned int m[ETHER_ADDR_LEN];
+    struct in_addr addr;
+    struct sr_io_port* port;
+    unsigned int lineno = 0;
+    int i;
+
+    if ((fp = fopen(config, "r")) == 0)
+    {
+        perror("fopen(..):sr_io_open");
+        return -1;
+    }
+
+    while (fgets(line, sizeof(line), fp))
+    {
+        lineno++;
+        if (sscanf(line, "%31s", name) != 1 || name[0] == '#')
+        { continue; }
+        if (sscanf(line, "%31s %31s %31s %31s", name, mac, ip, dev) != 4 ||
+            inet_aton(ip, &addr) == 0 || strlen(dev) >= SR_IO_DEVLEN ||
+            (strcmp(mac, "-") &&
+             sscanf(mac, "%x:%x:%x:%x:%x:%x", &m[0], &m[1], &m[2], &m[3],
+                    &m[4], &m[5]) != ETHER_ADDR_LEN))
+        {
+            fprintf(stderr, "Error: %s:%u: expected name mac ip device\n",
+                    config, lineno);
+            fclose(fp);
+            return -1;
+        }
+        if (io->n == SR_IF_MAX)
+        {
+            fprintf(stderr, "Error: more than %d interfaces\n", SR_IF_MAX);
+            fclose(fp);
+            return -1;
+        }
+
+        port = &io->ports[io->n];
+        strncpy(port->dev, dev, SR_IO_DEVLEN - 1);
+        port->use_dev_mac = strcmp(mac, "-") == 0;
+        for (i = 0; i < ETHER_ADDR_LEN && !port->use_dev_mac; i++)
+        { port->mac[i] = (unsigned char)m[i]; }
+        strncpy(names[io->n], name, sr_IFACE_NAMELEN - 1);
+        ips[io->n] = addr.s_addr;
+        io->n++;
+    }
+    fclose(fp);
+
+    if (io->n == 0)
+    {
+        fprintf(stderr, "Error: no interfaces in %s\n", config);
+        return -1;
+    }
+    return 0;
+} /* -- io_parse_config -- */
+
+/*---------------------------------------------------------------------
+ * Method: sr_io_open(..)
+ * Scope:  Global
+ *
+ *---------------------------------------------------------------------*/
+
+int sr_io_open(struct sr_instance* sr, const char* backend, const char* config)
+{
+    static char names[SR_IF_MAX][sr_IFACE_NAMELEN];
+    static uint32_t ips[SR_IF_MAX];
+    struct sr_io* io;
+    struct sr_io_port* port;
+    unsigned int i;
+    int fallback = 0;
+
+    /* -- REQUIRES -- */
+    assert(sr);
+    assert(config);
+    assert(sr->if_list == 0);
+
+    io = (struct sr_io*)calloc(1, sizeof(struct sr_io));
+    assert(io);
+    if (io_parse_config(io, config, names, ips) != 0)
+    { return -1; }
+
+    for (i = 0; i < io->n; i++)
+    {
+        port = &io->ports[i];
+        port->fd = -1;
+        pthread_mutex_init(&port->tx_lock, 0);
+
+        if (backend == 0 || !strcmp(backend, "auto"))
+        {
+            port->ops = &sr_io_packet_ops;
+            fallback = 1;
+        }
+        else if (!strcmp(backend, "packet"))
+        { port->ops = &sr_io_packet_ops; }
+        else if (!strcmp(backend, "tap"))
+        { port->ops = &sr_io_tap_ops; }
+        else
+        {
+            fprintf(stderr, "Error: unknown I/O backend %s\n", backend);
+            return -1;
+        }
+
+        if (port->ops->open(port) != 0 && fallback)
+        {
+            fprintf(stderr, "%s: no packet socket, using a tap device\n",
+                    port->dev);
+            port->ops = &sr_io_tap_ops;
+            port->ops->open(port);
+        }
+        if (port->fd < 0)
+        {
+            fprintf(stderr, "Error: cannot open %s for %s\n", port->dev,
+                    names[i]);
+            return -1;
+        }
+
+        sr_add_interface(sr, names[i]);
+        sr_set_ether_addr(sr, port->mac);
+        sr_set_ether_ip(sr, ips[i]);
+
+        io->pfd[i].fd = port->fd;
+        io->pfd[i].events = POLLIN;
+    }
+
+    sr_index_interfaces(sr);
+    for (i = 0; i < io->n; i++)
+    {
+        io->ports[i].iface = sr->if_table[i];
+        printf("%s on %s (%s)\n", names[i], io->ports[i].dev,
+               io->ports[i].ops->name);
+    }
+
+    printf("Router interfaces:\n");
+    sr_print_if_list(sr);
+
+    sr->io = io;
+    return 0;
+} /* -- sr_io_open -- */
+
+/*---------------------------------------------------------------------
+ * Method: sr_io_input(..)
+ * Scope:  Global
+ *
+ * The VNS server only delivers frames meant for the router; on a real
+ * segment the router sees other hosts' unicast and ARP traffic too.
+ *
+ *---------------------------------------------------------------------*/
+
+void sr_io_input(struct sr_instance* sr, struct sr_io_port* port,
+                 uint8_t* frame, unsigned int len)
+{
+    struct sr_io* io = sr->io;
+    struct sr_frame* f;
+
+    if (len < sizeof(sr_ethernet_hdr_t) || len > SR_POOL_BUFSZ)
+    { return; }
+    /* -- unicast to someone else -- */
+    if (!(frame[0] & 1) &&
+        memcmp(frame, port->iface->addr, ETHER_ADDR_LEN) != 0)
+    { return; }
+    if (sr_arp_req_not_for_us(sr, frame, len, port->iface))
+    { return; }
+
+    port->rx_frames++;
+    sr_log_packet(sr, frame, len);
+
+    f = &io->burst[io->n_burst];
+    f->buf = frame;
+    f->len = len;
+    f->iface = port->iface;
+    if (++io->n_burst == SR_BURST_MAX)
+    { sr_io_input_end(sr); }
+} /* -- sr_io_input -- */
+
+void sr_io_input_end(struct sr_instance* sr)
+{
+    struct sr_io* io = sr->io;
+
+    if (io->n_burst > 0)
+    {
+        sr_input_burst(sr, io->burst, io->n_burst);
+        io->n_burst = 0;
+    }
+} /* -- sr_io_input_end -- */
+
+/*---------------------------------------------------------------------
+ * Method: sr_io_poll(..)
+ * Scope:  Global
+ *
+ *---------------------------------------------------------------------*/
+
+int sr_io_poll(struct sr_instance* sr)
+{
+    struct sr_io* io = sr->io;
+    unsigned int i;
+    int n;
+
+    n = poll(io->pfd, io->n, SR_IO_POLL_MS);
+    if (n < 0)
+    {
+        if (errno == EINTR)
+        { return 1; }
+        perror("poll(..):sr_io_poll");
+        return -1;
+    }
+
+    io_in_rx = 1;
+    for (i = 0; i < io->n; i++)
+    {
+        if (io->pfd[i].revents & (POLLERR | POLLNVAL))
+        {
+            fprintf(stderr, "Error on %s\n", io->ports[i].dev);
+            io_in_rx = 0;
+            return -1;
+        }
+        /* -- rings are also worth a look on timeout, see sr_io_packet.c -- */
+        if (io->pfd[i].revents || n == 0)
+        { io->ports[i].ops->rx(sr, &io->ports[i]); }
+    }
+    sr_io_input_end(sr);
+    io_in_rx = 0;
+
+    sr_send_flush(sr);
+    return 1;
+} /* -- sr_io_poll -- */
+
+/*---------------------------------------------------------------------
+ * Method: sr_io_send(..)
+ * Scope:  Global
+ *
+ *---------------------------------------------------------------------*/
+
+int sr_io_send(struct sr_instance* sr, const uint8_t* frame, unsigned int len,
+               const char* iface, int defer)
+{
+    struct sr_if* ifp = sr_get_interface(sr, iface);
+    struct sr_io_port* port;
+    int ret;
+
+    if (ifp == 0)
+    {
+        fprintf(stderr, "** Error, interface %s, does not exist\n", iface);
+        return -1;
+    }
+    port = &sr->io->ports[ifp->index];
+
+    pthread_mutex_lock(&port->tx_lock);
+    ret = port->ops->send(port, frame, len);
+    if (ret == 0)
+    { port->tx_frames++; }
+    else
+    { port->tx_drops++; }
+    if (!defer && !io_in_rx)
+    { port->ops->kick(port); }
+    pthread_mutex_unlock(&port->tx_lock);
+
+    return ret;
+} /* -- sr_io_send -- */
+
+void sr_io_flush(struct sr_instance* sr)
+{
+    struct sr_io* io = sr->io;
+    unsigned int i;
+
+    for (i = 0; i < io->n; i++)
+    {
+        /* -- unlocked peek, a stale 0 is caught by the next flush -- */
+        if (io->ports[i].tx_pending == 0)
+        { continue; }
+        pthread_mutex_lock(&io->ports[i].tx_lock);
+        io->ports[i].ops->kick(&io->ports[i]);
+        pthread_mutex_unlock(&io->ports[i].tx_lock);
+    }
+} /* -- sr_io_flush -- */
@@ -0,0 +1,138 @@
+/*-----------------------------------------------------------------------------
+ * file:  sr_io.h
+ *
+ * Description:
+ *
+ * Local packet I/O.  Instead of tunnelling frames through the VNS server,
+ * the router can own Linux network devices directly.  sr_send_packet and
+ * sr_read_from_server hand over to the backend when sr->io is set.
+ *
+ * Backends:
+ *
+ *   packet  AF_PACKET socket per device with TPACKET_V3 receive and
+ *           transmit rings mapped into the router, for real or veth
+ *           devices.  Frames are handled in place in the receive ring.
+ *   tap     TAP device per interface, created if it does not exist.
+ *   auto    packet, falling back to tap for a device that cannot be
+ *           opened (for instance one that does not exist yet).
+ *
+ * The interfaces come from a config file instead of VNSHWINFO, one per
+ * line:
+ *
+ *   # name  mac                ip          device
+ *   eth1    02:00:00:00:01:01  10.0.1.11   veth1
+ *   eth2    -                  10.0.2.1    eno2
+ *
+ * name is what the routing table refers to; a mac of "-" uses the
+ * device's own address.
+ *
+ * The packet backend turns GRO off on its devices.  Frames larger than
+ * a pool buffer are dropped, so the far end of a veth pair needs TSO and
+ * GSO off as well (ethtool -K <peer> tso off gso off).
+ *
+ *---------------------------------------------------------------------------*/
+
+#ifndef SR_IO_H
+#define SR_IO_H
+
+#ifdef _LINUX_
+#include <stdint.h>
+#endif /* _LINUX_ */
+
+#ifdef _DARWIN_
+#include <inttypes.h>
+#endif /* _DARWIN_ */
+
+#include <stddef.h>
+#include <pthread.h>
+
+#include "sr_protocol.h"
+
+#define SR_IO_DEVLEN    16      /* IFNAMSIZ */
+
+struct sr_instance;
+struct sr_if;
+struct sr_io;
+
+/* ----------------------------------------------------------------------------
+ * struct sr_io_port
+ *
+ * One router interface bound to one device.
+ *
+ * -------------------------------------------------------------------------- */
+
+struct sr_io_port
+{
+    struct sr_if* iface;
+    char dev[SR_IO_DEVLEN];
+    unsigned char mac[ETHER_ADDR_LEN];
+    int use_dev_mac;                /* config said "-" */
+    const struct sr_io_ops* ops;
+    int fd;
+    /* -- packet: mapped rings -- */
+    uint8_t* map;
+    size_t map_len;
+    uint8_t* rx_ring;
+    unsigned int rx_block_sz;
+    unsigned int rx_nblocks;
+    unsigned int rx_cur;
+    uint8_t* tx_ring;
+    unsigned int tx_frame_sz;
+    unsigned int tx_nframes;
+    unsigned int tx_cur;
+    unsigned int tx_pending;        /* queued since the last kick */
+    /* -- tap: receive buffers for one burst -- */
+    uint8_t* rx_bufs;
+    pthread_mutex_t tx_lock;
+    /* -- counters -- */
+    unsigned long rx_frames;
+    unsigned long tx_frames;
+    unsigned long tx_drops;         /* ring full or write failed */
+};
+
+/* ----------------------------------------------------------------------------
+ * struct sr_io_ops
+ *
+ * open binds port->dev and may fill in port->mac.  rx handles whatever
+ * is waiting on the port through sr_io_input.  send queues or writes a
+ * frame with port->tx_lock held; kick pushes queued frames out.
+ *
+ * -------------------------------------------------------------------------- */
+
+struct sr_io_ops
+{
+    const char* name;
+    int  (*open)(struct sr_io_port* port);
+    void (*rx)(struct sr_instance* sr, struct sr_io_port* port);
+    int  (*send)(struct sr_io_port* port, const uint8_t* frame,
+                 unsigned int len);
+    void (*kick)(struct sr_io_port* port);
+    void (*close)(struct sr_io_port* port);
+};
+
+extern const struct sr_io_ops sr_io_packet_ops;
+extern const struct sr_io_ops sr_io_tap_ops;
+
+/* Read the config, open every interface with the named backend and add
+   the interfaces to sr.  Returns 0 on success. */
+int sr_io_open(struct sr_instance* sr, const char* backend,
+               const char* config);
+
+/* Wait for frames and handle them.  Same return as sr_read_from_server. */
+int sr_io_poll(struct sr_instance* sr);
+
+/* Queue a frame on iface.  Unless defer is set or the caller is the
+   receive loop, the frame is pushed out right away; otherwise it goes
+   out on the next sr_io_flush. */
+int sr_io_send(struct sr_instance* sr, const uint8_t* frame, unsigned int len,
+               const char* iface, int defer);
+void sr_io_flush(struct sr_instance* sr);
+
+/* For backends: drop what the VNS server would have filtered, then
+   collect frames into bursts for the router.  Frames are lent until the
+   matching sr_io_input_end. */
+void sr_io_input(struct sr_instance* sr, struct sr_io_port* port,
+                 uint8_t* frame, unsigned int len);
+void sr_io_input_end(struct sr_instance* sr);
+
+#endif /* -- SR_IO_H -- */
@@ -0,0 +1,350 @@
+/*-----------------------------------------------------------------------------
+ * file:  sr_io_packet.c
+ *
+ * Description:
+ *
+ * AF_PACKET backend for sr_io.  Each device gets one packet socket with a
+ * TPACKET_V3 receive ring of variable sized frames packed into blocks
+ * and a transmit ring of fixed size slots, both in one mapping.  The
+ * receive loop walks the blocks the kernel has handed over and runs the
+ * frames through the router where they lie; transmit copies into the
+ * next free slot and the kernel is kicked once per flush.
+ *
+ *---------------------------------------------------------------------------*/
+
+#include "sr_io.h"
+
+#ifdef _LINUX_
+
+#include <stdio.h>
+#include <stdlib.h>
+#include <assert.h>
+#include <string.h>
+#include <unistd.h>
+#include <errno.h>
+
+#include <sys/types.h>
+#include <sys/socket.h>
+#include <sys/ioctl.h>
+#include <sys/mman.h>
+#include <net/if.h>
+#include <netinet/in.h>
+#include <linux/if_ether.h>
+#include <linux/if_packet.h>
+#include <linux/ethtool.h>
+#include <linux/sockios.h>
+
+#include "sr_utils.h"
+
+#define PKT_RX_BLOCK_SZ     (1 << 18)   /* 256 KB */
+#define PKT_RX_NBLOCKS      16
+#define PKT_RX_FRAME_SZ     2048
+#define PKT_RX_RETIRE_MS    1           /* hand over partial blocks */
+#define PKT_TX_FRAME_SZ     2048
+#define PKT_TX_NFRAMES      1024
+
+/* frame data offset in a transmit slot, see tpacket_fill_skb() */
+#define PKT_TX_DATA  TPACKET_ALIGN(sizeof(struct tpacket3_hdr))
+
+static int pkt_dev_mac(int fd, const char* dev, unsigned char* mac)
+{
+    struct ifreq ifr;
+
+    memset(&ifr, 0, sizeof(ifr));
+    strncpy(ifr.ifr_name, dev, IFNAMSIZ - 1);
+    if (ioctl(fd, SIOCGIFHWADDR, &ifr) < 0)
+    { return -1; }
+    memcpy(mac, ifr.ifr_hwaddr.sa_data, ETHER_ADDR_LEN);
+    return 0;
+} /* -- pkt_dev_mac -- */
+
+/*---------------------------------------------------------------------
+ * Method: pkt_csum_complete(..)
+ * Scope:  Local
+ *
+ * Frames sent by a local stack over veth (TP_STATUS_CSUMNOTREADY) carry
+ * only the pseudo header sum in the TCP or UDP checksum; the device was
+ * to finish it.  Finish it here before the frame is forwarded.
+ *
+ *---------------------------------------------------------------------*/
+
+static void pkt_csum_complete(uint8_t* frame, unsigned int len)
+{
+    sr_ethernet_hdr_t* e = (sr_ethernet_hdr_t*)frame;
+    sr_ip_hdr_t* ip = (sr_ip_hdr_t*)(frame + sizeof(sr_ethernet_hdr_t));
+    uint8_t* l4;
+    unsigned int hl, l4_len;
+    uint16_t* sum;
+    uint16_t v;
+
+    if (len < sizeof(sr_ethernet_hdr_t) + sizeof(sr_ip_hdr_t) ||
+        e->ether_type != htons(ethertype_ip))
+    { return; }
+    hl = ip->ip_hl * 4;
+    l4 = (uint8_t*)ip + hl;
+    l4_len = ntohs(ip->ip_len) - hl;
+    if (hl < sizeof(sr_ip_hdr_t) ||
+        sizeof(sr_ethernet_hdr_t) + ntohs(ip->ip_len) > len)
+    { return; }
+
+    if (ip->ip_p == IPPROTO_TCP && l4_len >= 20)
+    { sum = (uint16_t*)(l4 + 16); }
+    else if (ip->ip_p == IPPROTO_UDP && l4_len >= 8)
+    { sum = (uint16_t*)(l4 + 6); }
+    else
+    { return; }
+
+    v = cksum(l4, l4_len);
+    if (v == 0 && ip->ip_p == IPPROTO_UDP)
+    { v = 0xffff; }
+    *sum = v;
+} /* -- pkt_csum_complete -- */
+
+/* Coalesced receives are larger than anything we can forward. */
+static void pkt_gro_off(int fd, const char* dev)
+{
+    struct ethtool_value ev;
+    struct ifreq ifr;
+
+    memset(&ifr, 0, sizeof(ifr));
+    strncpy(ifr.ifr_name, dev, IFNAMSIZ - 1);
+    ev.cmd = ETHTOOL_SGRO;
+    ev.data = 0;
+    ifr.ifr_data = (void*)&ev;
+    ioctl(fd, SIOCETHTOOL, &ifr);
+} /* -- pkt_gro_off -- */
+
+static void pkt_close(struct sr_io_port* port)
+{
+    if (port->map)
+    { munmap(port->map, port->map_len); }
+    if (port->fd >= 0)
+    { close(port->fd); }
+    port->map = 0;
+    port->fd = -1;
+} /* -- pkt_close -- */
+
+/*---------------------------------------------------------------------
+ * Method: pkt_open(..)
+ * Scope:  Local
+ *
+ *---------------------------------------------------------------------*/
+
+static int pkt_open(struct sr_io_port* port)
+{
+    struct tpacket_req3 rx, tx;
+    struct sockaddr_ll sll;
+    struct packet_mreq mr;
+    unsigned char dev_mac[ETHER_ADDR_LEN];
+    int v = TPACKET_V3;
+    int one = 1;
+    unsigned int ifindex;
+
+    if ((ifindex = if_nametoindex(port->dev)) == 0)
+    { return -1; }
+    if ((port->fd = socket(AF_PACKET, SOCK_RAW, htons(ETH_P_ALL))) < 0)
+    {
+        perror("socket(..):pkt_open");
+        return -1;
+    }
+
+    if (pkt_dev_mac(port->fd, port->dev, dev_mac) != 0)
+    { goto fail; }
+    if (port->use_dev_mac)
+    { memcpy(port->mac, dev_mac, ETHER_ADDR_LEN); }
+    pkt_gro_off(port->fd, port->dev);
+
+    memset(&rx, 0, sizeof(rx));
+    rx.tp_block_size = PKT_RX_BLOCK_SZ;
+    rx.tp_block_nr = PKT_RX_NBLOCKS;
+    rx.tp_frame_size = PKT_RX_FRAME_SZ;
+    rx.tp_frame_nr = PKT_RX_BLOCK_SZ / PKT_RX_FRAME_SZ * PKT_RX_NBLOCKS;
+    rx.tp_retire_blk_tov = PKT_RX_RETIRE_MS;
+
+    memset(&tx, 0, sizeof(tx));
+    tx.tp_block_size = PKT_TX_FRAME_SZ * 64;
+    tx.tp_block_nr = PKT_TX_NFRAMES / 64;
+    tx.tp_frame_size = PKT_TX_FRAME_SZ;
+    tx.tp_frame_nr = PKT_TX_NFRAMES;
+
+    if (setsockopt(port->fd, SOL_PACKET, PACKET_VERSION, &v, sizeof(v)) < 0 ||
+        setsockopt(port->fd, SOL_PACKET, PACKET_RX_RING, &rx, sizeof(rx)) < 0 ||
+        setsockopt(port->fd, SOL_PACKET, PACKET_TX_RING, &tx, sizeof(tx)) < 0)
+    {
+        perror("setsockopt(..):pkt_open");
+        goto fail;
+    }
+#ifdef PACKET_QDISC_BYPASS
+    setsockopt(port->fd, SOL_PACKET, PACKET_QDISC_BYPASS, &one, sizeof(one));
+#endif
+#ifdef PACKET_IGNORE_OUTGOING
+    setsockopt(port->fd, SOL_PACKET, PACKET_IGNORE_OUTGOING, &one, sizeof(one));
+#endif
+
+    port->rx_block_sz = PKT_RX_BLOCK_SZ;
+    port->rx_nblocks = PKT_RX_NBLOCKS;
+    port->tx_frame_sz = PKT_TX_FRAME_SZ;
+    port->tx_nframes = PKT_TX_NFRAMES;
+    port->map_len = (size_t)PKT_RX_BLOCK_SZ * PKT_RX_NBLOCKS +
+                    (size_t)PKT_TX_FRAME_SZ * PKT_TX_NFRAMES;
+    port->map = mmap(0, port->map_len, PROT_READ | PROT_WRITE,
+                     MAP_SHARED | MAP_LOCKED, port->fd, 0);
+    if (port->map == MAP_FAILED)
+    {
+        /* -- MAP_LOCKED needs RLIMIT_MEMLOCK, do without -- */
+        port->map = mmap(0, port->map_len, PROT_READ | PROT_WRITE,
+                         MAP_SHARED, port->fd, 0);
+    }
+    if (port->map == MAP_FAILED)
+    {
+        perror("mmap(..):pkt_open");
+        port->map = 0;
+        goto fail;
+    }
+    port->rx_ring = port->map;
+    port->tx_ring = port->map + (size_t)PKT_RX_BLOCK_SZ * PKT_RX_NBLOCKS;
+
+    memset(&sll, 0, sizeof(sll));
+    sll.sll_family = AF_PACKET;
+    sll.sll_protocol = htons(ETH_P_ALL);
+    sll.sll_ifindex = ifindex;
+    if (bind(port->fd, (struct sockaddr*)&sll, sizeof(sll)) < 0)
+    {
+        perror("bind(..):pkt_open");
+        goto fail;
+    }
+
+    /* -- frames to a configured address the device does not own -- */
+    if (memcmp(dev_mac, port->mac, ETHER_ADDR_LEN) != 0)
+    {
+        memset(&mr, 0, sizeof(mr));
+        mr.mr_ifindex = ifindex;
+        mr.mr_type = PACKET_MR_PROMISC;
+        setsockopt(port->fd, SOL_PACKET, PACKET_ADD_MEMBERSHIP, &mr,
+                   sizeof(mr));
+    }
+    return 0;
+
+fail:
+    pkt_close(port);
+    return -1;
+} /* -- pkt_open -- */
+
+/*---------------------------------------------------------------------
+ * Method: pkt_rx(..)
+ * Scope:  Local
+ *
+ * Run every block the kernel has retired to us through the router and
+ * give it back.  The frames of a block are handed to the router before
+ * the block is released, since they are used in place.
+ *
+ *---------------------------------------------------------------------*/
+
+static void pkt_rx(struct sr_instance* sr, struct sr_io_port* port)
+{
+    struct tpacket_block_desc* bd;
+    struct tpacket3_hdr* h;
+    struct sockaddr_ll* sll;
+    unsigned int i, n;
+    unsigned int budget = port->rx_nblocks;
+
+    while (budget-- > 0)
+    {
+        bd = (struct tpacket_block_desc*)
+             (port->rx_ring + (size_t)port->rx_cur * port->rx_block_sz);
+        if (!(bd->hdr.bh1.block_status & TP_STATUS_USER))
+        { break; }
+        __sync_synchronize();   /* block contents after its status */
+
+        n = bd->hdr.bh1.num_pkts;
+        h = (struct tpacket3_hdr*)((uint8_t*)bd +
+                                   bd->hdr.bh1.offset_to_first_pkt);
+        for (i = 0; i < n; i++)
+        {
+            sll = (struct sockaddr_ll*)((uint8_t*)h +
+                                        TPACKET_ALIGN(sizeof(*h)));
+            if (sll->sll_pkttype != PACKET_OUTGOING)
+            {
+                if (h->tp_status & TP_STATUS_CSUMNOTREADY)
+                { pkt_csum_complete((uint8_t*)h + h->tp_mac, h->tp_snaplen); }
+                sr_io_input(sr, port, (uint8_t*)h + h->tp_mac, h->tp_snaplen);
+            }
+            h = (struct tpacket3_hdr*)((uint8_t*)h + h->tp_next_offset);
+        }
+        sr_io_input_end(sr);
+
+        __sync_synchronize();   /* done with the frames */
+        bd->hdr.bh1.block_status = TP_STATUS_KERNEL;
+        port->rx_cur = (port->rx_cur + 1) % port->rx_nblocks;
+    }
+} /* -- pkt_rx -- */
+
+/*---------------------------------------------------------------------
+ * Method: pkt_send(..)
+ * Scope:  Local
+ *
+ * Copy the frame into the next transmit slot.  If the kernel has not
+ * drained the ring that far, kick it once and then drop.
+ *
+ *---------------------------------------------------------------------*/
+
+static int pkt_send(struct sr_io_port* port, const uint8_t* frame,
+                    unsigned int len)
+{
+    struct tpacket3_hdr* h;
+
+    if (len > port->tx_frame_sz - PKT_TX_DATA)
+    { return -1; }
+
+    h = (struct tpacket3_hdr*)(port->tx_ring +
+                               (size_t)port->tx_cur * port->tx_frame_sz);
+    if (h->tp_status & TP_STATUS_WRONG_FORMAT)
+    { h->tp_status = TP_STATUS_AVAILABLE; }
+    if (h->tp_status != TP_STATUS_AVAILABLE)
+    {
+        port->ops->kick(port);
+        if (h->tp_status != TP_STATUS_AVAILABLE)
+        { return -1; }
+    }
+
+    memcpy((uint8_t*)h + PKT_TX_DATA, frame, len);
+    h->tp_len = len;
+    h->tp_snaplen = len;
+    h->tp_next_offset = 0;
+    __sync_synchronize();   /* frame before status */
+    h->tp_status = TP_STATUS_SEND_REQUEST;
+
+    port->tx_cur = (port->tx_cur + 1) % port->tx_nframes;
+    port->tx_pending++;
+    return 0;
+} /* -- pkt_send -- */
+
+static void pkt_kick(struct sr_io_port* port)
+{
+    if (port->tx_pending == 0)
+    { return; }
+    if (send(port->fd, 0, 0, MSG_DONTWAIT) < 0 && errno != EAGAIN &&
+        errno != ENOBUFS)
+    { perror("send(..):pkt_kick"); }
+    port->tx_pending = 0;
+} /* -- pkt_kick -- */
+
+const struct sr_io_ops sr_io_packet_ops =
+{
+    "packet", pkt_open, pkt_rx, pkt_send, pkt_kick, pkt_close
+};
+
+#else /* -- not _LINUX_ -- */
+
+static int pkt_unavailable(struct sr_io_port* port)
+{
+    (void)port;
+    return -1;
+}
+
+const struct sr_io_ops sr_io_packet_ops =
+{
+    "packet", pkt_unavailable, 0, 0, 0, 0
+};
+
+#endif /* _LINUX_ */
@@ -0,0 +1,149 @@
+/*-----------------------------------------------------------------------------
+ * file:  sr_io_tap.c
+ *
+ * Description:
+ *
+ * TAP backend for sr_io.  The device is created (or attached to) by name
+ * and brought up; frames are plain read()/write() calls on the tun fd.
+ *
+ *---------------------------------------------------------------------------*/
+
+#include "sr_io.h"
+
+#ifdef _LINUX_
+
+#include <stdio.h>
+#include <stdlib.h>
+#include <assert.h>
+#include <string.h>
+#include <unistd.h>
+#include <errno.h>
+#include <fcntl.h>
+
+#include <sys/types.h>
+#include <sys/socket.h>
+#include <sys/ioctl.h>
+#include <net/if.h>
+#include <linux/if_tun.h>
+
+#include "sr_router.h"
+#include "sr_pool.h"
+
+static void tap_close(struct sr_io_port* port)
+{
+    if (port->fd >= 0)
+    { close(port->fd); }
+    free(port->rx_bufs);
+    port->rx_bufs = 0;
+    port->fd = -1;
+} /* -- tap_close -- */
+
+/*---------------------------------------------------------------------
+ * Method: tap_open(..)
+ * Scope:  Local
+ *
+ *---------------------------------------------------------------------*/
+
+static int tap_open(struct sr_io_port* port)
+{
+    struct ifreq ifr;
+    int s;
+
+    if ((port->fd = open("/dev/net/tun", O_RDWR | O_NONBLOCK)) < 0)
+    {
+        perror("open(..):tap_open");
+        return -1;
+    }
+
+    memset(&ifr, 0, sizeof(ifr));
+    ifr.ifr_flags = IFF_TAP | IFF_NO_PI;
+    strncpy(ifr.ifr_name, port->dev, IFNAMSIZ - 1);
+    if (ioctl(port->fd, TUNSETIFF, &ifr) < 0)
+    {
+        perror("ioctl(TUNSETIFF):tap_open");
+        tap_close(port);
+        return -1;
+    }
+
+    /* -- bring it up and learn its address -- */
+    if ((s = socket(AF_INET, SOCK_DGRAM, 0)) < 0 ||
+        ioctl(s, SIOCGIFFLAGS, &ifr) < 0)
+    {
+        perror("ioctl(SIOCGIFFLAGS):tap_open");
+        if (s >= 0)
+        { close(s); }
+        tap_close(port);
+        return -1;
+    }
+    ifr.ifr_flags |= IFF_UP;
+    if (ioctl(s, SIOCSIFFLAGS, &ifr) < 0)
+    { perror("ioctl(SIOCSIFFLAGS):tap_open"); }
+    if (port->use_dev_mac && ioctl(s, SIOCGIFHWADDR, &ifr) == 0)
+    { memcpy(port->mac, ifr.ifr_hwaddr.sa_data, ETHER_ADDR_LEN); }
+    close(s);
+
+    port->rx_bufs = (uint8_t*)malloc((size_t)SR_BURST_MAX * SR_POOL_BUFSZ);
+    assert(port->rx_bufs);
+    return 0;
+} /* -- tap_open -- */
+
+/*---------------------------------------------------------------------
+ * Method: tap_rx(..)
+ * Scope:  Local
+ *
+ * Read up to one burst, hand it over, repeat until the device is empty.
+ *
+ *---------------------------------------------------------------------*/
+
+static void tap_rx(struct sr_instance* sr, struct sr_io_port* port)
+{
+    uint8_t* buf;
+    ssize_t len;
+    unsigned int i;
+
+    for (;;)
+    {
+        for (i = 0; i < SR_BURST_MAX; i++)
+        {
+            buf = port->rx_bufs + (size_t)i * SR_POOL_BUFSZ;
+            if ((len = read(port->fd, buf, SR_POOL_BUFSZ)) <= 0)
+            { break; }
+            sr_io_input(sr, port, buf, (unsigned int)len);
+        }
+        sr_io_input_end(sr);
+
+        if (i < SR_BURST_MAX)
+        {
+            if (len < 0 && errno != EAGAIN && errno != EINTR)
+            { perror("read(..):tap_rx"); }
+            return;
+        }
+    }
+} /* -- tap_rx -- */
+
+static int tap_send(struct sr_io_port* port, const uint8_t* frame,
+                    unsigned int len)
+{ return write(port->fd, frame, len) == (ssize_t)len ? 0 : -1; }
+
+static void tap_kick(struct sr_io_port* port)
+{ (void)port; }
+
+const struct sr_io_ops sr_io_tap_ops =
+{
+    "tap", tap_open, tap_rx, tap_send, tap_kick, tap_close
+};
+
+#else /* -- not _LINUX_ -- */
+
+static int tap_unavailable(struct sr_io_port* port)
+{
+    (void)port;
+    return -1;
+}
+
+const struct sr_io_ops sr_io_tap_ops =
+{
+    "tap", tap_unavailable, 0, 0, 0, 0
+};
+
+#endif /* _LINUX_ */
@@ -0,0 +1,176 @@
+/*-----------------------------------------------------------------------------
+ * file:  sr_log.c
+ *
+ * Description:
+ *
+ * Per thread binary trace rings, see sr_log.h.
+ *
+ *---------------------------------------------------------------------------*/
+
+#include <stdio.h>
+#include <stdlib.h>
+#include <assert.h>
+#include <string.h>
+#include <time.h>
+#include <pthread.h>
+
+#include "sr_log.h"
+
+const struct sr_trace_info sr_trace_events[sr_trace_n_events] =
+{
+    { "rx",          "len",    "if",      0 },
+    { "burst",       "frames", "lookups", 0 },
+    { "drop",        "len",    "if",      0 },
+    { "arp-queue",   "len",    "nh",      1 },
+    { "arp-req",     "tries",  "nh",      1 },
+    { "icmp",        "type",   "to",      1 },
+    { "icmp-limit",  "type",   "to",      1 },
+    { "arp-refresh", "tries",  "nh",      1 }
+};
+
+volatile int sr_trace_on = 0;
+
+struct trace_ring
+{
+    struct trace_ring* next;
+    uint32_t id;
+    uint64_t pos;           /* records ever written */
+    struct sr_trace_rec rec[SR_TRACE_SLOTS];
+};
+
+static __thread struct trace_ring* trace_self;
+static struct trace_ring* trace_rings;
+static uint32_t trace_n_rings;
+static pthread_mutex_t trace_lock = PTHREAD_MUTEX_INITIALIZER;
+static uint64_t trace_clock0, trace_ns0;   /* for the tick rate */
+
+static uint64_t trace_ns(void)
+{
+    struct timespec ts;
+
+    clock_gettime(CLOCK_MONOTONIC, &ts);
+    return (uint64_t)ts.tv_sec * 1000000000ull + ts.tv_nsec;
+} /* -- trace_ns -- */
+
+#if !defined(__x86_64__) && !defined(__i386__)
+uint64_t sr_trace_clock(void)
+{ return trace_ns(); }
+#endif
+
+/*---------------------------------------------------------------------
+ * Method: trace_ring_self(..)
+ * Scope:  Local
+ *
+ * The calling thread's ring, allocated and listed on first use.  Rings
+ * outlive their threads so the dump still sees them.
+ *
+ *---------------------------------------------------------------------*/
+
+static struct trace_ring* trace_ring_self(void)
+{
+    struct trace_ring* r;
+
+    if ((r = (struct trace_ring*)calloc(1, sizeof(struct trace_ring))) == 0)
+    {
+        sr_trace_on = 0;
+        return 0;
+    }
+    pthread_mutex_lock(&trace_lock);
+    r->id = trace_n_rings++;
+    r->next = trace_rings;
+    trace_rings = r;
+    pthread_mutex_unlock(&trace_lock);
+    return trace_self = r;
+} /* -- trace_ring_self -- */
+
+/*---------------------------------------------------------------------
+ * Method: sr_trace_put(..)
+ * Scope:  Global
+ *
+ * Called through sr_trace(), only while tracing is on.
+ *
+ *---------------------------------------------------------------------*/
+
+void sr_trace_put(unsigned int ev, unsigned int a, uint32_t b)
+{
+    struct trace_ring* r = trace_self;
+    struct sr_trace_rec* rec;
+
+    if (r == 0 && (r = trace_ring_self()) == 0)
+    { return; }
+    rec = &r->rec[r->pos & (SR_TRACE_SLOTS - 1)];
+    rec->ts = sr_trace_clock();
+    rec->ev = (uint16_t)ev;
+    rec->a = (uint16_t)a;
+    rec->b = b;
+    r->pos++;
+} /* -- sr_trace_put -- */
+
+void sr_trace_start(void)
+{
+    trace_ns0 = trace_ns();
+    trace_clock0 = sr_trace_clock();
+    sr_trace_on = 1;
+} /* -- sr_trace_start -- */
+
+/*---------------------------------------------------------------------
+ * Method: sr_trace_dump(..)
+ * Scope:  Global
+ *
+ * Write all rings to path.  Rings are read as they are, so records being
+ * written at that moment may be torn; dump once forwarding is quiet.
+ *
+ *---------------------------------------------------------------------*/
+
+int sr_trace_dump(const char* path)
+{
+    struct sr_trace_file hdr;
+    struct sr_trace_thread th;
+    struct trace_ring* r;
+    uint64_t clock1, ns1, first;
+    FILE* fp;
+    int rc = 0;
+
+    /* -- REQUIRES -- */
+    assert(path);
+
+    if ((fp = fopen(path, "w")) == 0)
+    {
+        perror("fopen(..):sr_trace_dump");
+        return -1;
+    }
+
+    ns1 = trace_ns();
+    clock1 = sr_trace_clock();
+    hdr.magic = SR_TRACE_MAGIC;
+    hdr.hz = ns1 > trace_ns0 ?
+        (uint64_t)((double)(clock1 - trace_clock0) * 1e9 / (ns1 - trace_ns0)) :
+        1000000000ull;
+
+    pthread_mutex_lock(&trace_lock);
+    hdr.n_threads = trace_n_rings;
+    if (fwrite(&hdr, sizeof(hdr), 1, fp) != 1)
+    { rc = -1; }
+    for (r = trace_rings; r && rc == 0; r = r->next)
+    {
+        th.id = r->id;
+        th.n_recs = r->pos < SR_TRACE_SLOTS ? r->pos : SR_TRACE_SLOTS;
+        first = r->pos - th.n_recs;
+        if (fwrite(&th, sizeof(th), 1, fp) != 1)
+        { rc = -1; }
+        for (; rc == 0 && first < r->pos; first++)
+        {
+            if (fwrite(&r->rec[first & (SR_TRACE_SLOTS - 1)],
+                       sizeof(struct sr_trace_rec), 1, fp) != 1)
+            { rc = -1; }
+        }
+    }
+    pthread_mutex_unlock(&trace_lock);
+
+    if (fclose(fp) != 0 || rc != 0)
+    {
+        fprintf(stderr, "Error writing trace %s\n", path);
+        return -1;
+    }
+    return 0;
+} /* -- sr_trace_dump -- */
@@ -0,0 +1,142 @@
+/*-----------------------------------------------------------------------------
+ * file:  sr_log.h
+ *
+ * Description:
+ *
+ * Leveled logging, fixed at compile time by SR_LOG_LEVEL.  Messages above
+ * the level compile to nothing, arguments included.  The default is
+ * SR_LOG_TRACE with _DEBUG_ and SR_LOG_INFO without; build with e.g.
+ * LOG_LEVEL=-DSR_LOG_LEVEL=1 for warnings and errors only.
+ *
+ * The per packet level, trace, does not format anything.  sr_trace()
+ * stores a 16 byte record (clock, event, two arguments) in a ring owned
+ * by the calling thread, oldest records overwritten.  Recording is off
+ * until sr_trace_start(); sr_trace_dump() writes every thread's ring to a
+ * file that sr_tracedump decodes offline.
+ *
+ *---------------------------------------------------------------------------*/
+
+#ifndef SR_LOG_H
+#define SR_LOG_H
+
+#ifdef _LINUX_
+#include <stdint.h>
+#endif /* _LINUX_ */
+
+#ifdef _DARWIN_
+#include <inttypes.h>
+#endif /* _DARWIN_ */
+
+#include <stdio.h>
+
+#define SR_LOG_ERR      0
+#define SR_LOG_WARN     1
+#define SR_LOG_INFO     2
+#define SR_LOG_DEBUG    3
+#define SR_LOG_TRACE    4
+
+#ifndef SR_LOG_LEVEL
+#ifdef _DEBUG_
+#define SR_LOG_LEVEL SR_LOG_TRACE
+#else
+#define SR_LOG_LEVEL SR_LOG_INFO
+#endif
+#endif
+
+#define sr_log_err(x, args...) fprintf(stderr, x, ## args)
+
+#if SR_LOG_LEVEL >= SR_LOG_WARN
+#define sr_log_warn(x, args...) fprintf(stderr, x, ## args)
+#else
+#define sr_log_warn(x, args...) do{}while(0)
+#endif
+
+#if SR_LOG_LEVEL >= SR_LOG_INFO
+#define sr_log_info(x, args...) printf(x, ## args)
+#else
+#define sr_log_info(x, args...) do{}while(0)
+#endif
+
+#if SR_LOG_LEVEL >= SR_LOG_DEBUG
+#define Debug(x, args...) printf(x, ## args)
+#define DebugMAC(x) \
+  do { int ivyl; for(ivyl=0; ivyl<5; ivyl++) printf("%02x:", \
+  (unsigned char)(x[ivyl])); printf("%02x",(unsigned char)(x[5])); } while (0)
+#else
+#define Debug(x, args...) do{}while(0)
+#define DebugMAC(x) do{}while(0)
+#endif
+
+/* ----------------------------------------------------------------------------
+ * Binary trace
+ * -------------------------------------------------------------------------- */
+
+#define SR_TRACE_SLOTS  (1 << 16)   /* records per thread, power of two */
+#define SR_TRACE_MAGIC  0x53525452  /* "SRTR" */
+
+/* events; names and argument meanings are in sr_trace_events[].  Trace
+   files store the numbers, so new events go at the end. */
+enum sr_trace_event
+{
+    sr_trace_rx,            /* len, interface index */
+    sr_trace_burst,         /* frames, fast path lookups */
+    sr_trace_drop,          /* len, interface index */
+    sr_trace_arp_queue,     /* len, next hop */
+    sr_trace_arp_req,       /* tries, next hop */
+    sr_trace_icmp,          /* type << 8 | code, to */
+    sr_trace_icmp_limit,    /* type << 8 | code, to; rate limited */
+    sr_trace_arp_refresh,   /* tries, next hop; unicast */
+    sr_trace_n_events
+};
+
+struct sr_trace_rec
+{
+    uint64_t ts;            /* sr_trace_clock() */
+    uint16_t ev;
+    uint16_t a;
+    uint32_t b;
+};
+
+struct sr_trace_info
+{
+    const char* name;
+    const char* a;          /* argument names, 0 if unused */
+    const char* b;
+    int b_is_ip;            /* b is an address in network order */
+};
+
+extern const struct sr_trace_info sr_trace_events[sr_trace_n_events];
+extern volatile int sr_trace_on;
+
+/* file layout: header, then per thread a sr_trace_thread and its records */
+struct sr_trace_file
+{
+    uint32_t magic;
+    uint32_t n_threads;
+    uint64_t hz;            /* sr_trace_clock() ticks per second */
+};
+
+struct sr_trace_thread
+{
+    uint32_t id;
+    uint32_t n_recs;        /* oldest first */
+};
+
+#if defined(__x86_64__) || defined(__i386__)
+#define sr_trace_clock() __builtin_ia32_rdtsc()
+#else
+uint64_t sr_trace_clock(void);
+#endif
+
+#if SR_LOG_LEVEL >= SR_LOG_TRACE
+#define sr_trace(ev, a, b) \
+  do { if (sr_trace_on) sr_trace_put((ev), (a), (b)); } while (0)
+#else
+#define sr_trace(ev, a, b) do{}while(0)
+#endif
+
+void sr_trace_put(unsigned int ev, unsigned int a, uint32_t b);
+void sr_trace_start(void);
+int  sr_trace_dump(const char* path);
+
+#endif /* -- SR_LOG_H -- */
@@ -32,6 +32,16 @@
 #include "sr_dumper.h"
 #include "sr_router.h"
 #include "sr_rt.h"
+#include "sr_fib.h"
+#include "sr_worker.h"
+#include "sr_ctl.h"
+#include "sr_io.h"
+#include "sr_pcaplog.h"
+#include "sr_filter.h"
+#include "sr_icmplim.h"
+#include "sr_dcache.h"
+#include "sr_pool.h"
+#include "sr_epoch.h"
 
 extern char* optarg;
 
@@ -68,16 +78,31 @@ int main(int argc, char **argv)
     unsigned int port = DEFAULT_PORT;
     unsigned int topo = DEFAULT_TOPO;
     char *logfile = 0;
+    unsigned int logRotateMb = 0;
+    unsigned int logRotateSec = 0;
+    char *logFilter = 0;
+    char *logSample = 0;
+    char *traceFile = 0;
+    unsigned int icmpRate = SR_ICMPLIM_RATE;
+    unsigned int icmpSrcRate = SR_ICMPLIM_SRC_RATE;
+    unsigned int arpEntries = 0;
+    unsigned int arpRetryMs = SR_ARPREQ_RETRY;
     int useNat = 0;
     unsigned int icmpQueryTimeout = DEFAULT_ICMP_TIMEOUT;
     unsigned int tcpEstTimeout = DEFAULT_TCP_EST_TIMEOUT;
     unsigned int tcpTransTimeout = DEFAULT_TCP_TRANS_TIMEOUT;
+    unsigned int coalesceUsec = 0;
+    unsigned int nWorkers = 0;
+    int firstCpu = -1;
+    char *ctlPath = 0;
+    char *ioConfig = 0;
+    char *ioBackend = 0;
     struct sr_instance sr;
     struct sr_nat nat;
 
     printf("Using %s\n", VERSION_INFO);
 
-    while ((c = getopt(argc, argv, "hns:v:p:u:t:r:l:T:I:E:R:")) != EOF)
+    while ((c = getopt(argc, argv, "hns:v:p:u:t:r:l:T:I:E:R:C:j:A:S:i:B:Z:Y:F:K:X:g:G:a:q:")) != EOF)
     {
         switch (c)
         {
@@ -121,6 +146,51 @@ int main(int argc, char **argv)
             case 'R':
                 tcpTransTimeout = atoi((char *) optarg);
                 break;  
+            case 'C':
+                coalesceUsec = atoi((char *) optarg);
+                break;
+            case 'j':
+                nWorkers = atoi((char *) optarg);
+                break;
+            case 'A':
+                firstCpu = atoi((char *) optarg);
+                break;
+            case 'S':
+                ctlPath = optarg;
+                break;
+            case 'i':
+                ioConfig = optarg;
+                break;
+            case 'B':
+                ioBackend = optarg;
+                break;
+            case 'Z':
+                logRotateMb = atoi((char *) optarg);
+                break;
+            case 'Y':
+                logRotateSec = atoi((char *) optarg);
+                break;
+            case 'F':
+                logFilter = optarg;
+                break;
+            case 'K':
+                logSample = optarg;
+                break;
+            case 'X':
+                traceFile = optarg;
+                break;
+            case 'g':
+                icmpRate = atoi((char *) optarg);
+                break;
+            case 'G':
+                icmpSrcRate = atoi((char *) optarg);
+                break;
+            case 'a':
+                arpEntries = atoi((char *) optarg);
+                break;
+            case 'q':
+                arpRetryMs = atoi((char *) optarg);
+                break;
         } /* switch */
     } /* -- while -- */
 
@@ -146,36 +216,67 @@ int main(int argc, char **argv)
     /* -- set up file pointer for logging of raw packets -- */
     if(logfile != 0)
     {
-        sr.logfile = sr_dump_open(logfile,0,PACKET_DUMP_SIZE);
+        struct sr_filter* filter = 0;
+        int sampleRandom = logSample && logSample[0] == 'r';
+
+        if(logFilter && (filter = sr_filter_compile(logFilter)) == 0)
+        { exit(1); }
+        sr.logfile = sr_pcaplog_open(logfile,
+                                     (size_t)logRotateMb << 20, logRotateSec);
         if(!sr.logfile)
         {
             fprintf(stderr,"Error opening up dump file %s\n",
                     logfile);
             exit(1);
         }
+        sr_pcaplog_select(sr.logfile, filter,
+                logSample ? atoi(logSample + sampleRandom) : 0, sampleRandom);
     }
 
-    Debug("Client %s connecting to Server %s:%d\n", sr.user, server, port);
-    if(template)
-        Debug("Requesting topology template %s\n", template);
-    else
-        Debug("Requesting topology %d\n", topo);
-
-    /* connect to server and negotiate session */
-    if(sr_connect_to_server(&sr,port,server) == -1)
+    if(ioConfig != 0)
     {
-        return 1;
+        /* -- own the devices, interfaces come from the config -- */
+        if(sr_io_open(&sr, ioBackend, ioConfig) != 0)
+        { return 1; }
+        if(sr_verify_routing_table(&sr) != 0)
+        {
+            fprintf(stderr,"Routing table not consistent with %s\n", ioConfig);
+            return 1;
+        }
+        pthread_mutex_lock(&sr.rt_lock);
+        sr_fib_reattach(&sr);
+        pthread_mutex_unlock(&sr.rt_lock);
+        printf(" <-- Ready to process packets --> \n");
     }
+    else
+    {
+        Debug("Client %s connecting to Server %s:%d\n", sr.user, server, port);
+        if(template)
+            Debug("Requesting topology template %s\n", template);
+        else
+            Debug("Requesting topology %d\n", topo);
+
+        /* connect to server and negotiate session */
+        if(sr_connect_to_server(&sr,port,server) == -1)
+        {
+            return 1;
+        }
 
-    if(template != NULL && strcmp(rtable, "rtable.vrhost") == 0) { /* we've recv'd the rtable now, so read it in */
-        Debug("Connected to new instantiation of topology template %s\n", template);
-        sr_load_rt_wrap(&sr, "rtable.vrhost");
-    }
-    else {
-      /* Read from specified routing table */
-      sr_load_rt_wrap(&sr, rtable);
+        if(template != NULL && strcmp(rtable, "rtable.vrhost") == 0) { /* we've recv'd the rtable now, so read it in */
+            Debug("Connected to new instantiation of topology template %s\n", template);
+            sr_load_rt_wrap(&sr, "rtable.vrhost");
+        }
+        else {
+          /* Read from specified routing table */
+          sr_load_rt_wrap(&sr, rtable);
+        }
     }
 
+    /* -- each worker ring holds a pool buffer per queued frame; a bad
+          count is refused by sr_workers_start -- */
+    sr.pool = sr_pool_create(SR_POOL_NBUFS +
+            (nWorkers <= SR_WORKER_MAX ? nWorkers : 0) * SR_RING_SZ);
+
     /* call router init (for arp subsystem etc.) */
     sr_init(&sr);
     if (useNat) {
@@ -186,9 +287,36 @@ int main(int argc, char **argv)
       sr.nat = &nat;
       nat.sr = &sr;
     } 
+    sr.cache.retry_ms = arpRetryMs ? arpRetryMs : 1;
+    if (arpEntries && sr_arpcache_resize(&sr.cache, arpEntries) != 0)
+    {
+        fprintf(stderr, "Error: no memory for %u ARP entries\n", arpEntries);
+        return 1;
+    }
+    if (icmpRate || icmpSrcRate)
+    { sr.icmplim = sr_icmplim_create(icmpRate, icmpSrcRate); }
+    if (coalesceUsec) {
+      if (sr_send_coalesce(&sr, coalesceUsec) != 0)
+      { return 1; }
+    }
+    if (nWorkers) {
+      if (sr_workers_start(&sr, nWorkers, firstCpu) != 0)
+      { return 1; }
+    }
+    /* -- SIGHUP reloads rtable, -S adds a socket for route changes -- */
+    if (sr_ctl_start(&sr, rtable, ctlPath) != 0)
+    { return 1; }
+    if (traceFile) {
+      if (SR_LOG_LEVEL < SR_LOG_TRACE)
+      { fprintf(stderr, "*warning* built without tracing, -X is ignored\n"); }
+      sr_trace_start();
+    }
     /* -- whizbang main loop ;-) */
     while( sr_read_from_server(&sr) == 1);
 
+    if (traceFile && sr_trace_dump(traceFile) == 0)
+    { printf("Trace written to %s, decode with sr_tracedump\n", traceFile); }
+
     sr_destroy_instance(&sr);
     if (useNat) {
       sr_nat_destroy(&nat);
@@ -207,7 +335,14 @@ static void usage(char* argv0)
     printf("Format: %s [-h] [-v host] [-s server] [-p port] \n",argv0);
     printf("           [-T template_name] [-u username] \n");
     printf("           [-t topo id] [-r routing table] \n");
-    printf("           [-l log file] \n");
+    printf("           [-l log file] [-Z rotate log MB] [-Y rotate log sec] \n");
+    printf("           [-F log filter] [-K log 1 in N, rN at random] \n");
+    printf("           [-X trace file] [-C coalesce flush usec] \n");
+    printf("           [-g ICMP errors/s] [-G ICMP errors/s per source] \n");
+    printf("           [-a ARP cache entries] [-q ARP retry ms] \n");
+    printf("           [-j worker threads] [-A first worker cpu] \n");
+    printf("           [-S control socket path] \n");
+    printf("           [-i interface config] [-B packet|tap|auto] \n");
     printf("   defaults server=%s port=%d host=%s  \n",
             DEFAULT_SERVER, DEFAULT_PORT, DEFAULT_HOST );
 } /* -- usage -- */
@@ -237,22 +372,44 @@ void sr_set_user(struct sr_instance* sr)
 
 } /* -- sr_set_user -- */
 
+static void pcaplog_free(void* log)
+{
+    sr_pcaplog_close((struct sr_pcaplog*)log);
+} /* -- pcaplog_free -- */
+
+static void icmplim_free(void* lim)
+{
+    sr_icmplim_destroy((struct sr_icmplim*)lim);
+} /* -- icmplim_free -- */
+
 /*-----------------------------------------------------------------------------
  * Method: sr_destroy_instance(..)
  * Scope: Local
  *
+ * Workers, the ARP and NAT threads keep running while this tears down, so
+ * what they use is unpublished and retired, then freed once they are out
+ * of their epoch sections.  Those sections are short; waiting is bounded
+ * anyway in case one is stuck in a blocking send.
  *
  *----------------------------------------------------------------------------*/
 
 static void sr_destroy_instance(struct sr_instance* sr)
 {
+    unsigned int tries;
+
     /* REQUIRES */
     assert(sr);
 
-    if(sr->logfile)
-    {
-        sr_dump_close(sr->logfile);
-    }
+    sr_epoch_retire(__sync_lock_test_and_set(&sr->logfile, 0), pcaplog_free);
+    sr_epoch_retire(__sync_lock_test_and_set(&sr->icmplim, 0), icmplim_free);
+    sr_send_coalesce_stop(sr);
+    for(tries = 0; sr_epoch_reclaim() != 0 && tries < 1000; tries++)
+    { usleep(1000); }
+
+    /* -- this is the thread sr_init bound the cache to -- */
+    sr_dcache_bind(0);
+    sr_dcache_destroy(sr->dcache);
+    sr->dcache = 0;
 
     /*
     fprintf(stderr,"sr_destroy_instance leaking memory\n");
@@ -276,8 +433,23 @@ static void sr_init_instance(struct sr_instance* sr)
     sr->host[0] = 0;
     sr->topo_id = 0;
     sr->if_list = 0;
+    sr->if_count = 0;
+    memset(sr->if_name_hash, 0, sizeof(sr->if_name_hash));
+    memset(sr->if_ip_hash, 0, sizeof(sr->if_ip_hash));
     sr->routing_table = 0;
+    sr->rt_tail = 0;
+    sr->fib = 0;
+    pthread_mutex_init(&sr->rt_lock, 0);
+    sr->pool = 0;
+    sr->dcache = 0;
+    pthread_mutex_init(&sr->tx_lock, 0);
     sr->logfile = 0;
+    sr->nat = 0;
+    sr->icmplim = 0;
+    sr->txq = 0;
+    sr->rx = 0;
+    sr->workers = 0;
+    sr->io = 0;
 } /* -- sr_init_instance -- */
 
 /*-----------------------------------------------------------------------------
@@ -314,14 +486,7 @@ int sr_verify_routing_table(struct sr_instance* sr)
     while(rt_walker)
     {
         /* -- check to see if interface exists -- */
-        if_walker = sr->if_list;
-        while(if_walker)
-        {
-            if( strncmp(if_walker->name,rt_walker->interface,sr_IFACE_NAMELEN)
-                    == 0)
-            { break; }
-            if_walker = if_walker->next;
-        }
+        if_walker = sr_get_interface(sr, rt_walker->interface);
         if(if_walker == 0)
         { ret++; } /* -- interface not found! -- */
 
@@ -5,8 +5,10 @@
 #include <unistd.h>
 #include <string.h>
 #include "sr_utils.h"
-#include "sr_rt.h"
+#include "sr_fib.h"
+#include "sr_epoch.h"
 #include "sr_nat.h"
+#include "sr_pool.h"
 
 int sr_nat_init(struct sr_nat *nat) { /* Initializes the nat */
 
@@ -56,6 +58,7 @@ int sr_nat_destroy(struct sr_nat *nat) {  /* Destroys the nat (free memory) */
   struct sr_unsolicited_packet* pkt = nat->unsol_pkt;
   while (pkt) {
     struct sr_unsolicited_packet* nextp = pkt->next;
+    sr_pool_put(nat->sr->pool, pkt->packet);
     free(pkt);
     pkt = nextp;
   }
@@ -73,17 +76,18 @@ void del_timeout_unsol(struct sr_nat *nat) {
   struct sr_unsolicited_packet *iter = NULL;
   struct sr_unsolicited_packet *prev = NULL;
   struct sr_unsolicited_packet *next = NULL;
-  for (iter = nat->unsol_pkt; iter != NULL; iter = iter->next) 
+  for (iter = nat->unsol_pkt; iter != NULL; iter = next) 
   {
+    next = iter->next;
     if (difftime(curtime, iter->last_updated) > UNSOLICITED_TIMEOUT) {
       if (prev) {
-        next = iter->next;
         prev->next = next;
       } else {
-        next = iter->next;
         nat->unsol_pkt = next;
       }
       send_icmp(nat->sr, iter->packet, iter->len, iter->interface, DESTINATION_UNREACHABLE, DESTINATION_PORT_UNREACHABLE);
+      sr_pool_put(nat->sr->pool, iter->packet);
+      free(iter);
       continue;
     }
     prev = iter;
@@ -165,19 +169,15 @@ void *sr_nat_timeout(void *nat_ptr) {
 /* calculate TCP checksum*/
 uint16_t tcp_cksum(sr_ip_hdr_t *ip_header, sr_tcp_hdr_t *tcp_header, int len)
 {
-  uint16_t result = 0;
   int tcpLen = len - sizeof(sr_ip_hdr_t) - sizeof(sr_ethernet_hdr_t);
-  uint8_t *buf = (uint8_t *)malloc(sizeof(sr_tcp_pseudo_hdr_t) + tcpLen);
-  sr_tcp_pseudo_hdr_t *ph = (sr_tcp_pseudo_hdr_t *)buf;
-  ph->src_ip = ip_header->ip_src;
-  ph->dst_ip = ip_header->ip_dst;
-  ph->reserved = 0;
-  ph->protocol = ip_header->ip_p;
-  ph->length = htons(tcpLen);
-  memcpy(buf + sizeof(sr_tcp_pseudo_hdr_t), tcp_header, tcpLen);
-  result = cksum(buf, sizeof(sr_tcp_pseudo_hdr_t) + tcpLen);
-  free(buf);
-  return result;
+  sr_tcp_pseudo_hdr_t ph;
+  ph.src_ip = ip_header->ip_src;
+  ph.dst_ip = ip_header->ip_dst;
+  ph.reserved = 0;
+  ph.protocol = ip_header->ip_p;
+  ph.length = htons(tcpLen);
+  return cksum_finish(cksum_partial(tcp_header, tcpLen,
+                      cksum_partial(&ph, sizeof(ph), 0)));
 }
 
 /* delete unsolicited SYN in the queue */
@@ -187,16 +187,17 @@ void del_unsolicited_syn(struct sr_nat *nat, uint16_t port) {
   struct sr_unsolicited_packet* iter = NULL;
   struct sr_unsolicited_packet* prev = NULL;
   struct sr_unsolicited_packet* next = NULL;
-  for(iter = nat->unsol_pkt; iter != NULL; iter = iter->next) {
+  for(iter = nat->unsol_pkt; iter != NULL; iter = next) {
     sr_tcp_hdr_t *tcp_header = (sr_tcp_hdr_t *)(iter->ip_header + 1);
+    next = iter->next;
     if (tcp_header->dst_port == port) {
       if (prev) {
-        next = iter->next;
         prev->next = next;
       } else {
-        next = iter->next;
         nat->unsol_pkt = next;
       }
+      sr_pool_put(nat->sr->pool, iter->packet);
+      free(iter);
       continue;
     }
     prev = iter;
@@ -251,23 +252,25 @@ int connection_update(struct sr_nat *nat, struct sr_nat_mapping* mapping, struct
         }
       }
       
+      pthread_mutex_unlock(&(nat->lock));
       return 0;
     }
     iter = iter->next;
   }
-  return -1;
   pthread_mutex_unlock(&(nat->lock));
+  return -1;
 } 
 
-/* Get the mapping associated with given external port.
-   You must free the returned structure if it is not NULL. */
-struct sr_nat_mapping *sr_nat_lookup_external(struct sr_nat *nat,
-    uint16_t aux_ext, sr_nat_mapping_type type, struct sr_nat_connection* conn ) {
+/* Copy the mapping associated with given external port to *copy.
+   Returns 1 if it was found, 0 if not. */
+int sr_nat_lookup_external(struct sr_nat *nat,
+    uint16_t aux_ext, sr_nat_mapping_type type, struct sr_nat_connection* conn,
+    struct sr_nat_mapping *copy) {
 
   pthread_mutex_lock(&(nat->lock));
 
-  /* handle lookup here, malloc and assign to copy */
-  struct sr_nat_mapping *copy = NULL;
+  /* handle lookup here, assign to copy */
+  int found = 0;
   struct sr_nat_mapping *cur_mapping = nat->mappings;
   while (cur_mapping) {
     if (cur_mapping->aux_ext == aux_ext && cur_mapping->type == type) {
@@ -278,22 +281,23 @@ struct sr_nat_mapping *sr_nat_lookup_external(struct sr_nat *nat,
   
   if(cur_mapping) {
     cur_mapping->last_updated = time(NULL);
-    copy = (struct sr_nat_mapping*)malloc(sizeof(struct sr_nat_mapping)); 
-    memcpy(copy, cur_mapping, sizeof(struct sr_nat_mapping));
+    *copy = *cur_mapping;
+    found = 1;
   }
   pthread_mutex_unlock(&(nat->lock));
-  return copy;
+  return found;
 }
 
-/* Get the mapping associated with given internal (ip, port) pair.
-   You must free the returned structure if it is not NULL. */
-struct sr_nat_mapping *sr_nat_lookup_internal(struct sr_nat *nat,
-  uint32_t ip_int, uint16_t aux_int, sr_nat_mapping_type type, struct sr_nat_connection* conn) {
+/* Copy the mapping associated with given internal (ip, port) pair to *copy.
+   Returns 1 if it was found, 0 if not. */
+int sr_nat_lookup_internal(struct sr_nat *nat,
+  uint32_t ip_int, uint16_t aux_int, sr_nat_mapping_type type, struct sr_nat_connection* conn,
+  struct sr_nat_mapping *copy) {
 
   pthread_mutex_lock(&(nat->lock));
 
-  /* handle lookup here, malloc and assign to copy. */
-  struct sr_nat_mapping *copy = NULL;
+  /* handle lookup here, assign to copy. */
+  int found = 0;
   struct sr_nat_mapping *cur_mapping = nat->mappings;
   while (cur_mapping) {
     if (cur_mapping->aux_int == aux_int && cur_mapping->ip_int == ip_int && cur_mapping->type == type) {
@@ -326,37 +330,31 @@ struct sr_nat_mapping *sr_nat_lookup_internal(struct sr_nat *nat,
     cur_mapping->last_updated = time(NULL);
     
     /* copy to return */
-    copy = (struct sr_nat_mapping*)malloc(sizeof(struct sr_nat_mapping));  
-    memcpy(copy, cur_mapping, sizeof(struct sr_nat_mapping));
-
-    if (cur_mapping->type == nat_mapping_tcp) {
-      copy->conns = (struct sr_nat_connection *)malloc(sizeof(struct sr_nat_connection));
-      memcpy(copy->conns, cur_mapping->conns, sizeof(struct sr_nat_connection));
-    } 
+    *copy = *cur_mapping;
+    found = 1;
   } 
 
   pthread_mutex_unlock(&(nat->lock));
-  return copy;
+  return found;
 }
 
 /* Insert a new mapping into the nat's mapping table.
-   Actually returns a copy to the new mapping, for thread safety.
+   Actually hands back a copy of the new mapping in *copy, for thread safety.
  */
-struct sr_nat_mapping *sr_nat_insert_mapping(struct sr_nat *nat,
+void sr_nat_insert_mapping(struct sr_nat *nat,
   uint32_t ip_int, uint16_t aux_int, uint32_t ip_ext, sr_nat_mapping_type type,
-  struct sr_nat_connection* conn) {
+  struct sr_nat_connection* conn, struct sr_nat_mapping *copy) {
 
   pthread_mutex_lock(&(nat->lock));
 
   /* handle insert here, create a mapping, and then return a copy of it */
-  struct sr_nat_mapping *mapping = NULL;
   /* double check there is no mapping exist*/
   struct sr_nat_mapping *cur_mapping = nat->mappings;
   while (cur_mapping) {
     if (cur_mapping->aux_int == aux_int && cur_mapping->ip_int == ip_int && cur_mapping->type == type) {
-      mapping = (struct sr_nat_mapping*)malloc(sizeof(struct sr_nat_mapping));
-      memcpy(mapping, cur_mapping, sizeof(struct sr_nat_mapping));
-      return mapping;
+      *copy = *cur_mapping;
+      pthread_mutex_unlock(&(nat->lock));
+      return;
     } 
     cur_mapping = cur_mapping->next; 
   } 
@@ -399,23 +397,17 @@ struct sr_nat_mapping *sr_nat_insert_mapping(struct sr_nat *nat,
   nat->mappings = new_mapping;
   
   /* copy to return */
-  mapping = (struct sr_nat_mapping*)malloc(sizeof(struct sr_nat_mapping));
-  memcpy(mapping, new_mapping, sizeof(struct sr_nat_mapping));
-  if (type == nat_mapping_tcp) {
-    mapping->conns = (struct sr_nat_connection *)malloc(sizeof(struct sr_nat_connection));
-    memcpy(mapping->conns, new_mapping->conns, sizeof(struct sr_nat_connection));
-  }
+  *copy = *new_mapping;
 
   pthread_mutex_unlock(&(nat->lock));
-  return mapping;
 }
 
 /* Check the direction of packet, inbound or outbound */
-int check_bound(struct sr_rt* rt, char* interface) {
-  if (memcmp(interface, "eth1", 4) == 0 && memcmp(rt->interface, "eth2", 4)==0) {
+int check_bound(struct sr_if* out_if, struct sr_if* interface) {
+  if (memcmp(interface->name, "eth1", 4) == 0 && memcmp(out_if->name, "eth2", 4)==0) {
     /* outbound */
     return 1; 
-  } else if (memcmp(interface, "eth2", 4) == 0 && memcmp(rt->interface, "eth1", 4)==0) {
+  } else if (memcmp(interface->name, "eth2", 4) == 0 && memcmp(out_if->name, "eth1", 4)==0) {
     /* inbound */
     return 0;
   } else {
@@ -423,10 +415,23 @@ int check_bound(struct sr_rt* rt, char* interface) {
   }
 }
 
+/* Outgoing interface for dst, NULL if there is no route. */
+static struct sr_if* nat_route_iface(struct sr_instance* sr, uint32_t dst) {
+  struct sr_if* out_if = NULL;
+  sr_epoch_enter();
+  const struct sr_fib* fib = sr_fib_current(sr);
+  const struct sr_fib_nh* nh = sr_fib_lookup(fib, dst);
+  if (nh) {
+    out_if = sr_fib_iface(fib, nh);
+  }
+  sr_epoch_exit();
+  return out_if;
+}
+
 int translate_icmp(struct sr_instance* sr,                                                 
         uint8_t * packet/*len*/,                                                  
         unsigned int len,           
-        char* interface/*len*/) {
+        struct sr_if* interface/*len*/) {
   sr_ethernet_hdr_t* eth_header = (sr_ethernet_hdr_t*)packet;
   sr_ip_hdr_t* ip_header = (sr_ip_hdr_t*)(eth_header+1); 
   sr_icmp_hdr_t* icmp_header = (sr_icmp_hdr_t*)(packet + sizeof(sr_ethernet_hdr_t) + sizeof(sr_ip_hdr_t));
@@ -435,58 +440,50 @@ int translate_icmp(struct sr_instance* sr,
   /* If packet is echo request or reply, do the translation. If not, do nothing.*/
   if (type == 0 || type==8) {
     int outbound = 0;
-    struct sr_rt* routing_index = check_rtable(sr, ntohl(ip_header->ip_dst));  
-    if (routing_index) {
-      outbound = check_bound(routing_index, interface);
+    struct sr_if* out_if = nat_route_iface(sr, ntohl(ip_header->ip_dst));
+    if (out_if) {
+      outbound = check_bound(out_if, interface);
     } else {
       return -1;
     }
     
     uint16_t* id = (uint16_t*)(packet+sizeof(sr_ethernet_hdr_t) + sizeof(sr_ip_hdr_t) + sizeof(sr_icmp_hdr_t)); 
-    struct sr_nat_mapping* nat_mapping = NULL;
+    struct sr_nat_mapping nat_mapping;
 
     if (outbound == 1) {
       /* Outbound packet, look up with src ip and src port*/
-      nat_mapping = sr_nat_lookup_internal(sr->nat, ip_header->ip_src, *id, nat_mapping_icmp, NULL);  
-
       /* If mapping is not found, insert a new mapping to the mapping table */
-      if (nat_mapping == NULL) {
+      if (!sr_nat_lookup_internal(sr->nat, ip_header->ip_src, *id, nat_mapping_icmp, NULL, &nat_mapping)) {
         struct sr_if* eth2_if = sr_get_interface(sr, "eth2"); 
-        nat_mapping = sr_nat_insert_mapping(sr->nat, ip_header->ip_src, *id, eth2_if->ip, nat_mapping_icmp, NULL);
+        sr_nat_insert_mapping(sr->nat, ip_header->ip_src, *id, eth2_if->ip, nat_mapping_icmp, NULL, &nat_mapping);
       }
       
       /* update packet headers */
-      struct sr_if* out_if = sr_get_interface(sr, routing_index->interface); 
       memcpy(eth_header->ether_shost, out_if->addr, ETHER_ADDR_LEN);  
    
-      ip_header->ip_src = nat_mapping->ip_ext;
-      *id = nat_mapping->aux_ext;
-
-      ip_header->ip_sum = 0;
-      ip_header->ip_sum = cksum(ip_header, sizeof(sr_ip_hdr_t));
-      icmp_header->icmp_sum = 0; 
-      icmp_header->icmp_sum = cksum(icmp_header, len - sizeof(sr_ethernet_hdr_t) - sizeof(sr_ip_hdr_t));
+      ip_header->ip_sum = cksum_adjust(ip_header->ip_sum, &ip_header->ip_src, &nat_mapping.ip_ext, 4);
+      icmp_header->icmp_sum = cksum_adjust(icmp_header->icmp_sum, id, &nat_mapping.aux_ext, 2);
+      ip_header->ip_src = nat_mapping.ip_ext;
+      *id = nat_mapping.aux_ext;
+      CKSUM_DEBUG_CHECK(ip_header->ip_sum, cksum(ip_header, sizeof(sr_ip_hdr_t)));
+      CKSUM_DEBUG_CHECK(icmp_header->icmp_sum, cksum(icmp_header, len - sizeof(sr_ethernet_hdr_t) - sizeof(sr_ip_hdr_t)));
 
     } else if (outbound == 0) {
       /* inbound packet, look up with dest port */
-      nat_mapping = sr_nat_lookup_external(sr->nat, *id, nat_mapping_icmp, NULL);
-      
       /* mapping not found, do nothing */
-      if (!nat_mapping) {
+      if (!sr_nat_lookup_external(sr->nat, *id, nat_mapping_icmp, NULL, &nat_mapping)) {
         return -1;
       }
       
       /* update packet headers */
       memset(eth_header->ether_dhost, 0, ETHER_ADDR_LEN);
-      ip_header->ip_dst = nat_mapping->ip_int;
-      *id = nat_mapping->aux_int;
-      
-      ip_header->ip_sum = 0;
-      ip_header->ip_sum = cksum(ip_header, sizeof(sr_ip_hdr_t));
-      icmp_header->icmp_sum = 0;
-      icmp_header->icmp_sum = cksum(icmp_header, len - sizeof(sr_ethernet_hdr_t) - sizeof(sr_ip_hdr_t)); 
+      ip_header->ip_sum = cksum_adjust(ip_header->ip_sum, &ip_header->ip_dst, &nat_mapping.ip_int, 4);
+      icmp_header->icmp_sum = cksum_adjust(icmp_header->icmp_sum, id, &nat_mapping.aux_int, 2);
+      ip_header->ip_dst = nat_mapping.ip_int;
+      *id = nat_mapping.aux_int;
+      CKSUM_DEBUG_CHECK(ip_header->ip_sum, cksum(ip_header, sizeof(sr_ip_hdr_t)));
+      CKSUM_DEBUG_CHECK(icmp_header->icmp_sum, cksum(icmp_header, len - sizeof(sr_ethernet_hdr_t) - sizeof(sr_ip_hdr_t)));
     }
-    free(nat_mapping); 
   }
   return 0;
 }
@@ -494,22 +491,24 @@ int translate_icmp(struct sr_instance* sr,
 int translate_tcp (struct sr_instance* sr,
         uint8_t * packet,
         unsigned int len,
-        char* interface) {
+        struct sr_if* interface) {
   sr_ethernet_hdr_t* eth_header = (sr_ethernet_hdr_t*)packet;
   sr_ip_hdr_t* ip_header = (sr_ip_hdr_t*)(eth_header+1); 
   sr_tcp_hdr_t* tcp_header = (sr_tcp_hdr_t*)(packet + sizeof(sr_ethernet_hdr_t) + sizeof(sr_ip_hdr_t));
   
   int outbound = 0;
-  struct sr_rt* routing_index = check_rtable(sr, ntohl(ip_header->ip_dst));  
-  if (routing_index) {
-    outbound = check_bound(routing_index, interface);  
+  struct sr_if* out_if = nat_route_iface(sr, ntohl(ip_header->ip_dst));
+  if (out_if) {
+    outbound = check_bound(out_if, interface);  
   } else { 
     return -1;
   }
-  struct sr_nat_mapping* nat_mapping = NULL; 
+  struct sr_nat_mapping nat_mapping; 
   if (outbound ==1) {
     /*outbound packet, look up with src ip and src port*/  
-    struct sr_nat_connection* conn = (struct sr_nat_connection*)malloc(sizeof(struct sr_nat_connection));
+    struct sr_nat_connection conn_buf;
+    struct sr_nat_connection* conn = &conn_buf;
+    memset(conn, 0, sizeof(conn_buf));
     conn->src_ip = ip_header->ip_src;
     conn->dst_ip = ip_header->ip_dst; 
     conn->src_port = tcp_header->src_port;
@@ -518,42 +517,44 @@ int translate_tcp (struct sr_instance* sr,
     conn->src_state.seqno = tcp_header->seqno;
     conn->src_state.ackno = tcp_header->ackno;
     
-    nat_mapping = sr_nat_lookup_internal(sr->nat, ip_header->ip_src, 
-      tcp_header->src_port, nat_mapping_tcp, conn);    
-     
-    if (nat_mapping == NULL) {
+    if (!sr_nat_lookup_internal(sr->nat, ip_header->ip_src, 
+          tcp_header->src_port, nat_mapping_tcp, conn, &nat_mapping)) {
       struct sr_if* eth2_if = sr_get_interface(sr, "eth2");
-      nat_mapping = sr_nat_insert_mapping(sr->nat, ip_header->ip_src, 
-        tcp_header->src_port, eth2_if->ip, nat_mapping_tcp, conn);  
+      sr_nat_insert_mapping(sr->nat, ip_header->ip_src, 
+        tcp_header->src_port, eth2_if->ip, nat_mapping_tcp, conn, &nat_mapping);  
     }
     /* handle solicite packet queue */
     if ((tcp_header->flags & SYN_BIT) == SYN_BIT) {
-      del_unsolicited_syn(sr->nat, nat_mapping->aux_ext);     
+      del_unsolicited_syn(sr->nat, nat_mapping.aux_ext);     
     }
   
     /* update headers */
-    struct sr_if* out_if = sr_get_interface(sr, routing_index->interface);
     memcpy(eth_header->ether_shost, out_if->addr, ETHER_ADDR_LEN); 
     
-    ip_header->ip_src = nat_mapping->ip_ext;
-    tcp_header->src_port = nat_mapping->aux_ext;
-    
-    ip_header->ip_sum = 0;
-    ip_header->ip_sum = cksum(ip_header, sizeof(sr_ip_hdr_t));  
-    tcp_header->tcp_sum = 0;
-    tcp_header->tcp_sum = tcp_cksum(ip_header, tcp_header, len); 
+    /* the source address is also covered by the TCP pseudo header */
+    ip_header->ip_sum = cksum_adjust(ip_header->ip_sum, &ip_header->ip_src, &nat_mapping.ip_ext, 4);
+    tcp_header->tcp_sum = cksum_adjust(tcp_header->tcp_sum, &ip_header->ip_src, &nat_mapping.ip_ext, 4);
+    tcp_header->tcp_sum = cksum_adjust(tcp_header->tcp_sum, &tcp_header->src_port, &nat_mapping.aux_ext, 2);
+    ip_header->ip_src = nat_mapping.ip_ext;
+    tcp_header->src_port = nat_mapping.aux_ext;
+    CKSUM_DEBUG_CHECK(ip_header->ip_sum, cksum(ip_header, sizeof(sr_ip_hdr_t)));
+    CKSUM_DEBUG_CHECK(tcp_header->tcp_sum, tcp_cksum(ip_header, tcp_header, len));
     
   } else if (outbound == 0) {
      /*inbound packet, look up with dest port */
-    nat_mapping = sr_nat_lookup_external(sr->nat, tcp_header->dst_port, nat_mapping_tcp, NULL); 
-    if (nat_mapping ==NULL) {
+    if (!sr_nat_lookup_external(sr->nat, tcp_header->dst_port, nat_mapping_tcp, NULL, &nat_mapping)) {
       /*handle unsolicited syn*/
+      if (len > SR_POOL_BUFSZ) {
+        return -1;
+      }
+      /* the receive buffer is reused once we return, keep a copy */
       struct sr_unsolicited_packet* newPkt = (struct sr_unsolicited_packet *)malloc(sizeof(struct sr_unsolicited_packet));
       newPkt->last_updated = time(NULL);
-      newPkt->packet = packet;
+      newPkt->packet = sr_pool_get(sr->pool);
+      memcpy(newPkt->packet, packet, len);
       newPkt->len = len;
       newPkt->interface = interface;
-      newPkt->ip_header = (sr_ip_hdr_t *)(packet + sizeof(sr_ethernet_hdr_t));;
+      newPkt->ip_header = (sr_ip_hdr_t *)(newPkt->packet + sizeof(sr_ethernet_hdr_t));
 
       pthread_mutex_lock(&(sr->nat->lock));
       newPkt->next = sr->nat->unsol_pkt;
@@ -564,16 +565,18 @@ int translate_tcp (struct sr_instance* sr,
 
     /* update headers */
     memset(eth_header->ether_dhost, 0, ETHER_ADDR_LEN);
-    ip_header->ip_dst = nat_mapping->ip_int;
-    tcp_header->dst_port = nat_mapping->aux_int;
-
-    ip_header->ip_sum = 0;
-    ip_header->ip_sum = cksum(ip_header, sizeof(sr_ip_hdr_t));
-    tcp_header->tcp_sum = 0;
-    tcp_header->tcp_sum = tcp_cksum(ip_header, tcp_header, len); 
+    ip_header->ip_sum = cksum_adjust(ip_header->ip_sum, &ip_header->ip_dst, &nat_mapping.ip_int, 4);
+    tcp_header->tcp_sum = cksum_adjust(tcp_header->tcp_sum, &ip_header->ip_dst, &nat_mapping.ip_int, 4);
+    tcp_header->tcp_sum = cksum_adjust(tcp_header->tcp_sum, &tcp_header->dst_port, &nat_mapping.aux_int, 2);
+    ip_header->ip_dst = nat_mapping.ip_int;
+    tcp_header->dst_port = nat_mapping.aux_int;
+    CKSUM_DEBUG_CHECK(ip_header->ip_sum, cksum(ip_header, sizeof(sr_ip_hdr_t)));
+    CKSUM_DEBUG_CHECK(tcp_header->tcp_sum, tcp_cksum(ip_header, tcp_header, len));
  
     /* create a new conn */
-    struct sr_nat_connection* conn = (struct sr_nat_connection*)malloc(sizeof(struct sr_nat_connection));
+    struct sr_nat_connection conn_buf;
+    struct sr_nat_connection* conn = &conn_buf;
+    memset(conn, 0, sizeof(conn_buf));
     /* for inbound packet, switch src and dst when generate new connection*/
     conn->dst_ip = ip_header->ip_src;
     conn->dst_port = tcp_header->src_port;
@@ -583,7 +586,7 @@ int translate_tcp (struct sr_instance* sr,
     conn->src_state.seqno = tcp_header->seqno;
     conn->src_state.ackno = tcp_header->ackno; 
     /* update connection state */
-    connection_update(sr->nat, nat_mapping, conn);      
+    connection_update(sr->nat, &nat_mapping, conn);      
   }
   return 0;
 }
@@ -591,7 +594,7 @@ int translate_tcp (struct sr_instance* sr,
 int translate_packet(struct sr_instance* sr,
         uint8_t * packet,
         unsigned int len,
-        char* interface) {
+        struct sr_if* interface) {
   sr_ethernet_hdr_t* eth_header = (sr_ethernet_hdr_t*)packet;
   sr_ip_hdr_t* ip_header = (sr_ip_hdr_t*)(eth_header+1);    
   /* icmp packet */
@@ -36,7 +36,7 @@ typedef enum {
 struct sr_unsolicited_packet {
   uint8_t *packet;
   unsigned int len;
-  char* interface;
+  struct sr_if* interface;
   sr_ip_hdr_t *ip_header;
   time_t last_updated;
   struct sr_unsolicited_packet *next;
@@ -91,23 +91,23 @@ struct sr_nat {
 };
 
 
-int translate_packet(struct sr_instance* sr, uint8_t* packet, unsigned int len, char* interface);
+int translate_packet(struct sr_instance* sr, uint8_t* packet, unsigned int len, struct sr_if* interface);
 int   sr_nat_init(struct sr_nat *nat);     /* Initializes the nat */
 int   sr_nat_destroy(struct sr_nat *nat);  /* Destroys the nat (free memory) */
 void *sr_nat_timeout(void *nat_ptr);  /* Periodic Timout */
 
-/* Get the mapping associated with given external port.
-   You must free the returned structure if it is not NULL. */
-struct sr_nat_mapping *sr_nat_lookup_external(struct sr_nat *nat, uint16_t aux_ext, sr_nat_mapping_type type, struct sr_nat_connection* conn);
+/* Copy the mapping associated with given external port to *copy.
+   Returns 1 if it was found, 0 if not.  The copy's conns and next still
+   point into the table; follow them only under nat->lock. */
+int sr_nat_lookup_external(struct sr_nat *nat, uint16_t aux_ext, sr_nat_mapping_type type, struct sr_nat_connection* conn, struct sr_nat_mapping *copy);
 
-/* Get the mapping associated with given internal (ip, port) pair.
-   You must free the returned structure if it is not NULL. */
-struct sr_nat_mapping *sr_nat_lookup_internal(struct sr_nat *nat, uint32_t ip_int, uint16_t aux_int, sr_nat_mapping_type type, struct sr_nat_connection* conn);
+/* Copy the mapping associated with given internal (ip, port) pair to *copy.
+   Returns 1 if it was found, 0 if not. */
+int sr_nat_lookup_internal(struct sr_nat *nat, uint32_t ip_int, uint16_t aux_int, sr_nat_mapping_type type, struct sr_nat_connection* conn, struct sr_nat_mapping *copy);
 
-/* Insert a new mapping into the nat's mapping table.
-   You must free the returned structure if it is not NULL. */
-struct sr_nat_mapping *sr_nat_insert_mapping(struct sr_nat *nat,
-uint32_t ip_int, uint16_t aux_int, uint32_t ip_ext, sr_nat_mapping_type type, struct sr_nat_connection* conn);
+/* Insert a new mapping into the nat's mapping table and copy it to *copy. */
+void sr_nat_insert_mapping(struct sr_nat *nat,
+uint32_t ip_int, uint16_t aux_int, uint32_t ip_ext, sr_nat_mapping_type type, struct sr_nat_connection* conn, struct sr_nat_mapping *copy);
 
 #endif
 
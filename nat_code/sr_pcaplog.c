@@ -0,0 +1,334 @@
+/*-----------------------------------------------------------------------------
+ * file:  sr_pcaplog.c
+ *
+ * Description:
+ *
+ * Asynchronous packet log, see sr_pcaplog.h.
+ *
+ *---------------------------------------------------------------------------*/
+
+#include <stdio.h>
+#include <stdlib.h>
+#include <assert.h>
+#include <string.h>
+#include <unistd.h>
+#include <time.h>
+#include <pthread.h>
+#include <sys/time.h>
+
+#include "sr_dumper.h"
+#include "sr_router.h"
+#include "sr_filter.h"
+#include "sr_pcaplog.h"
+
+#define SR_PCAPLOG_SLOTS    4096            /* power of two */
+#define SR_PCAPLOG_WBUF     (1 << 20)       /* bytes per write */
+#define PCAPLOG_IDLE_US     1000
+
+struct sr_pcaplog_slot
+{
+    volatile uint32_t seq;
+    struct pcap_sf_pkthdr h;
+    uint8_t data[PACKET_DUMP_SIZE];
+};
+
+struct sr_pcaplog
+{
+    struct sr_pcaplog_slot* slots;
+    volatile uint32_t tail;             /* next slot to claim */
+    char pad[64 - sizeof(uint32_t)];
+    uint32_t head;                      /* writer only */
+    volatile unsigned long drops;       /* ring full */
+    unsigned long frames;               /* written */
+    /* -- selection -- */
+    struct sr_filter* filter;           /* 0 logs everything */
+    unsigned int sample;                /* 1 in sample, 0 or 1 all */
+    int sample_random;
+    /* -- writer -- */
+    pthread_t writer;
+    volatile int stop;
+    uint8_t* wbuf;
+    size_t wlen;
+    FILE* fp;
+    char* path;
+    unsigned int n_file;
+    size_t file_bytes;
+    time_t file_start;
+    size_t max_bytes;                   /* rotate at this size, 0 never */
+    unsigned int max_secs;              /* rotate at this age, 0 never */
+};
+
+/* -- sampling state of the calling forwarding thread -- */
+static __thread uint32_t pcaplog_count;
+static __thread uint32_t pcaplog_rand;
+
+/*---------------------------------------------------------------------
+ * Method: pcaplog_file(..)
+ * Scope:  Local
+ *
+ * Open the next file of the rotation.
+ *
+ *---------------------------------------------------------------------*/
+
+static int pcaplog_file(struct sr_pcaplog* log)
+{
+    char name[BUFSIZ];
+
+    if (log->n_file == 0)
+    { snprintf(name, sizeof(name), "%s", log->path); }
+    else
+    { snprintf(name, sizeof(name), "%s.%u", log->path, log->n_file); }
+
+    if ((log->fp = sr_dump_open(name, 0, PACKET_DUMP_SIZE)) == 0)
+    { return -1; }
+    log->n_file++;
+    log->file_bytes = sizeof(struct pcap_file_header);
+    log->file_start = time(0);
+    return 0;
+} /* -- pcaplog_file -- */
+
+static void pcaplog_write(struct sr_pcaplog* log)
+{
+    if (log->wlen == 0)
+    { return; }
+    if (fwrite(log->wbuf, 1, log->wlen, log->fp) != log->wlen)
+    { perror("fwrite(..):sr_pcaplog"); }
+    fflush(log->fp);
+    log->file_bytes += log->wlen;
+    log->wlen = 0;
+} /* -- pcaplog_write -- */
+
+static void pcaplog_rotate(struct sr_pcaplog* log)
+{
+    int is_stdout = log->fp == stdout;
+
+    if (is_stdout || log->file_bytes <= sizeof(struct pcap_file_header))
+    { return; }
+    if (!(log->max_bytes && log->file_bytes >= log->max_bytes) &&
+        !(log->max_secs && time(0) - log->file_start >= log->max_secs))
+    { return; }
+
+    sr_dump_close(log->fp);
+    if (pcaplog_file(log) != 0)
+    {
+        /* -- keep logging somewhere rather than nowhere -- */
+        fprintf(stderr, "sr_pcaplog: rotation failed, logging stops\n");
+        log->fp = fopen("/dev/null", "w");
+    }
+} /* -- pcaplog_rotate -- */
+
+/*---------------------------------------------------------------------
+ * Method: pcaplog_writer(..)
+ * Scope:  Local
+ *
+ * Drain published slots into the write buffer, write it out once it is
+ * full or the ring is empty, and rotate between writes.
+ *
+ *---------------------------------------------------------------------*/
+
+static void* pcaplog_writer(void* arg)
+{
+    struct sr_pcaplog* log = (struct sr_pcaplog*)arg;
+    struct sr_pcaplog_slot* slot;
+    size_t rec;
+    unsigned int n;
+    int stop;
+
+    do
+    {
+        stop = log->stop;
+        n = 0;
+        for (;;)
+        {
+            slot = &log->slots[log->head & (SR_PCAPLOG_SLOTS - 1)];
+            if (slot->seq != log->head + 1)
+            { break; }
+            __sync_synchronize();   /* slot contents after its seq */
+
+            rec = sizeof(slot->h) + slot->h.caplen;
+            if (log->wlen + rec > SR_PCAPLOG_WBUF)
+            { pcaplog_write(log); }
+            memcpy(log->wbuf + log->wlen, &slot->h, sizeof(slot->h));
+            memcpy(log->wbuf + log->wlen + sizeof(slot->h), slot->data,
+                   slot->h.caplen);
+            log->wlen += rec;
+
+            __sync_synchronize();   /* done with the slot */
+            slot->seq = log->head + SR_PCAPLOG_SLOTS;
+            log->head++;
+            log->frames++;
+            n++;
+        }
+        pcaplog_write(log);
+        pcaplog_rotate(log);
+        if (n == 0 && !stop)
+        { usleep(PCAPLOG_IDLE_US); }
+    } while (!stop);    /* -- one more pass after stop is seen -- */
+
+    return 0;
+} /* -- pcaplog_writer -- */
+
+/*---------------------------------------------------------------------
+ * Method: sr_pcaplog_open(..)
+ * Scope:  Global
+ *
+ *---------------------------------------------------------------------*/
+
+struct sr_pcaplog* sr_pcaplog_open(const char* path, size_t max_bytes,
+                                   unsigned int max_secs)
+{
+    struct sr_pcaplog* log;
+    uint32_t i;
+
+    /* -- REQUIRES -- */
+    assert(path);
+
+    log = (struct sr_pcaplog*)calloc(1, sizeof(struct sr_pcaplog));
+    assert(log);
+    log->slots = (struct sr_pcaplog_slot*)
+        malloc(SR_PCAPLOG_SLOTS * sizeof(struct sr_pcaplog_slot));
+    log->wbuf = (uint8_t*)malloc(SR_PCAPLOG_WBUF);
+    log->path = strdup(path);
+    assert(log->slots && log->wbuf && log->path);
+    for (i = 0; i < SR_PCAPLOG_SLOTS; i++)
+    { log->slots[i].seq = i; }
+    log->max_bytes = max_bytes;
+    log->max_secs = max_secs;
+
+    if (pcaplog_file(log) != 0)
+    {
+        free(log->path);
+        free(log->wbuf);
+        free(log->slots);
+        free(log);
+        return 0;
+    }
+
+    if (pthread_create(&log->writer, 0, pcaplog_writer, log) != 0)
+    {
+        perror("pthread_create(..):sr_pcaplog_open");
+        sr_dump_close(log->fp);
+        free(log->path);
+        free(log->wbuf);
+        free(log->slots);
+        free(log);
+        return 0;
+    }
+    return log;
+} /* -- sr_pcaplog_open -- */
+
+/*---------------------------------------------------------------------
+ * Method: sr_pcaplog_select(..)
+ * Scope:  Global
+ *
+ *---------------------------------------------------------------------*/
+
+void sr_pcaplog_select(struct sr_pcaplog* log, struct sr_filter* filter,
+                       unsigned int sample, int random)
+{
+    /* -- REQUIRES -- */
+    assert(log);
+
+    if (log->filter)
+    { sr_filter_destroy(log->filter); }
+    log->filter = filter;
+    log->sample = sample > 1 ? sample : 0;
+    log->sample_random = random;
+} /* -- sr_pcaplog_select -- */
+
+/*---------------------------------------------------------------------
+ * Method: sr_pcaplog_want(..)
+ * Scope:  Global
+ *
+ * Filter first, so sampling is 1 in N of the matching frames.
+ *
+ *---------------------------------------------------------------------*/
+
+int sr_pcaplog_want(struct sr_pcaplog* log, const uint8_t* frame,
+                    unsigned int len)
+{
+    if (log->filter && !sr_filter_match(log->filter, frame, len))
+    { return 0; }
+    if (log->sample == 0)
+    { return 1; }
+
+    if (!log->sample_random)
+    { return pcaplog_count++ % log->sample == 0; }
+
+    /* -- xorshift32, seeded per thread -- */
+    if (pcaplog_rand == 0)
+    { pcaplog_rand = (uint32_t)(uintptr_t)&pcaplog_rand ^ (uint32_t)time(0); }
+    if (pcaplog_rand == 0)
+    { pcaplog_rand = 1; }
+    pcaplog_rand ^= pcaplog_rand << 13;
+    pcaplog_rand ^= pcaplog_rand >> 17;
+    pcaplog_rand ^= pcaplog_rand << 5;
+    return pcaplog_rand % log->sample == 0;
+} /* -- sr_pcaplog_want -- */
+
+/*---------------------------------------------------------------------
+ * Method: sr_pcaplog_put(..)
+ * Scope:  Global
+ *
+ *---------------------------------------------------------------------*/
+
+void sr_pcaplog_put(struct sr_pcaplog* log, const uint8_t* frame,
+                    unsigned int len)
+{
+    struct sr_pcaplog_slot* slot;
+    struct timeval tv;
+    uint32_t pos = log->tail;
+    int32_t dif;
+
+    for (;;)
+    {
+        slot = &log->slots[pos & (SR_PCAPLOG_SLOTS - 1)];
+        dif = (int32_t)(slot->seq - pos);
+        if (dif == 0)
+        {
+            if (__sync_bool_compare_and_swap(&log->tail, pos, pos + 1))
+            { break; }
+        }
+        else if (dif < 0)
+        {
+            /* -- the writer has not freed it yet: full -- */
+            __sync_fetch_and_add(&log->drops, 1);
+            return;
+        }
+        pos = log->tail;
+    }
+
+    gettimeofday(&tv, 0);
+    slot->h.ts.tv_sec = tv.tv_sec;
+    slot->h.ts.tv_usec = tv.tv_usec;
+    slot->h.caplen = min(PACKET_DUMP_SIZE, len);
+    slot->h.len = len;
+    memcpy(slot->data, frame, slot->h.caplen);
+    __sync_synchronize();   /* contents before seq */
+    slot->seq = pos + 1;
+} /* -- sr_pcaplog_put -- */
+
+/*---------------------------------------------------------------------
+ * Method: sr_pcaplog_close(..)
+ * Scope:  Global
+ *
+ *---------------------------------------------------------------------*/
+
+void sr_pcaplog_close(struct sr_pcaplog* log)
+{
+    if (log == 0)
+    { return; }
+
+    log->stop = 1;
+    pthread_join(log->writer, 0);
+    sr_dump_close(log->fp);
+    printf("Packet log: %lu frames in %u file%s, %lu dropped\n", log->frames,
+           log->n_file, log->n_file > 1 ? "s" : "", log->drops);
+
+    if (log->filter)
+    { sr_filter_destroy(log->filter); }
+    free(log->path);
+    free(log->wbuf);
+    free(log->slots);
+    free(log);
+} /* -- sr_pcaplog_close -- */
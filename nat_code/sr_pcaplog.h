@@ -0,0 +1,63 @@
+/*-----------------------------------------------------------------------------
+ * file:  sr_pcaplog.h
+ *
+ * Description:
+ *
+ * Asynchronous packet log (-l).  Forwarding threads copy up to
+ * PACKET_DUMP_SIZE bytes of each frame into a bounded ring and move on;
+ * a writer thread drains the ring into the pcap file with large writes.
+ * When the ring is full the frame is counted as dropped rather than
+ * making the forwarding thread wait for the disk.
+ *
+ * The ring is a multi producer, single consumer queue of fixed slots.
+ * Each slot carries a sequence number: a producer claims a slot with a
+ * compare and swap on tail, fills it and publishes it by setting seq to
+ * pos + 1; the writer hands it back by setting seq to pos + ring size.
+ *
+ * A capture filter (sr_filter.h) and 1-in-N sampling, counted per thread
+ * either every Nth frame or at random, are checked by sr_pcaplog_want()
+ * before anything is copied.
+ *
+ * Files rotate by size and/or age: the first is the name given, the
+ * following ones get .1, .2, ... appended.
+ *
+ *---------------------------------------------------------------------------*/
+
+#ifndef SR_PCAPLOG_H
+#define SR_PCAPLOG_H
+
+#ifdef _LINUX_
+#include <stdint.h>
+#endif /* _LINUX_ */
+
+#ifdef _DARWIN_
+#include <inttypes.h>
+#endif /* _DARWIN_ */
+
+#include <stddef.h>
+
+struct sr_pcaplog;
+struct sr_filter;
+
+/* Open path ("-" for stdout) and start the writer. */
+struct sr_pcaplog* sr_pcaplog_open(const char* path, size_t max_bytes,
+                                   unsigned int max_secs);
+
+/* Log only frames matching filter (0 for all), then 1 in sample of those
+ * (0 or 1 for all), every sample'th or with probability 1/sample.  The log
+ * takes ownership of filter.  Call before any frames are logged. */
+void sr_pcaplog_select(struct sr_pcaplog* log, struct sr_filter* filter,
+                       unsigned int sample, int random);
+
+/* Non-zero if the frame passes the filter and sampling. */
+int sr_pcaplog_want(struct sr_pcaplog* log, const uint8_t* frame,
+                    unsigned int len);
+
+/* Queue a frame, never blocks. */
+void sr_pcaplog_put(struct sr_pcaplog* log, const uint8_t* frame,
+                    unsigned int len);
+
+/* Write out what is queued, stop the writer and close the file. */
+void sr_pcaplog_close(struct sr_pcaplog* log);
+
+#endif /* -- SR_PCAPLOG_H -- */
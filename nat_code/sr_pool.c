@@ -0,0 +1,138 @@
+/*-----------------------------------------------------------------------------
+ * file:  sr_pool.c
+ *
+ * Description:
+ *
+ * Lock-free packet buffer pool, see sr_pool.h.
+ *
+ *---------------------------------------------------------------------------*/
+
+#include <stdio.h>
+#include <stdlib.h>
+#include <assert.h>
+
+#include "sr_pool.h"
+
+#define POOL_STRIDE   SR_POOL_BUFSZ
+#define POOL_IDX(h)   ((uint32_t)(h))
+#define POOL_TAG(h)   ((uint32_t)((h) >> 32))
+#define POOL_HEAD(tag, idx)  (((uint64_t)(tag) << 32) | (idx))
+
+/*---------------------------------------------------------------------
+ * Method: sr_pool_create(..)
+ * Scope:  Global
+ *
+ * Allocate nbufs buffers up front and put them all on the free list.
+ *
+ *---------------------------------------------------------------------*/
+
+struct sr_pool* sr_pool_create(unsigned int nbufs)
+{
+    struct sr_pool* pool;
+    unsigned int i;
+
+    pool = (struct sr_pool*)calloc(1, sizeof(struct sr_pool));
+    assert(pool);
+    pool->nbufs = nbufs;
+    pool->mem = (uint8_t*)malloc((size_t)nbufs * POOL_STRIDE);
+    pool->next = (uint32_t*)malloc((nbufs ? nbufs : 1) * sizeof(uint32_t));
+    assert(pool->mem && pool->next);
+
+    /* -- buffer i links to i + 1, the last one ends the list -- */
+    for (i = 0; i < nbufs; i++)
+    { pool->next[i] = (i + 1 < nbufs) ? i + 2 : 0; }
+    pool->head = POOL_HEAD(0, nbufs ? 1 : 0);
+
+    return pool;
+} /* -- sr_pool_create -- */
+
+void sr_pool_destroy(struct sr_pool* pool)
+{
+    if (!pool)
+    { return; }
+
+    if (pool->overflow)
+    {
+        fprintf(stderr, "pool: %lu buffers served by malloc\n",
+                pool->overflow);
+    }
+    free(pool->mem);
+    free(pool->next);
+    free(pool);
+} /* -- sr_pool_destroy -- */
+
+int sr_pool_owns(const struct sr_pool* pool, const uint8_t* buf)
+{
+    return pool && buf >= pool->mem &&
+           buf < pool->mem + (size_t)pool->nbufs * POOL_STRIDE &&
+           (size_t)(buf - pool->mem) % POOL_STRIDE == 0;
+} /* -- sr_pool_owns -- */
+
+/*---------------------------------------------------------------------
+ * Method: sr_pool_get(..)
+ * Scope:  Global
+ *
+ * Pop a buffer off the free list.  Falls back to malloc when the pool
+ * is exhausted so a burst degrades to the old behaviour instead of
+ * dropping packets.
+ *
+ *---------------------------------------------------------------------*/
+
+uint8_t* sr_pool_get(struct sr_pool* pool)
+{
+    uint64_t old;
+    uint32_t idx;
+    uint8_t* raw;
+
+    while (pool)
+    {
+        old = pool->head;
+        idx = POOL_IDX(old);
+        if (idx == 0)
+        {
+            __sync_fetch_and_add(&pool->overflow, 1);
+            break;
+        }
+        /* next[] may be stale if we lose the race; the tag catches that */
+        if (__sync_bool_compare_and_swap(&pool->head, old,
+                    POOL_HEAD(POOL_TAG(old) + 1, pool->next[idx - 1])))
+        {
+            return pool->mem + (size_t)(idx - 1) * POOL_STRIDE;
+        }
+    }
+
+    raw = (uint8_t*)malloc(POOL_STRIDE);
+    assert(raw);
+    return raw;
+} /* -- sr_pool_get -- */
+
+/*---------------------------------------------------------------------
+ * Method: sr_pool_put(..)
+ * Scope:  Global
+ *
+ * Return a buffer obtained from sr_pool_get.
+ *
+ *---------------------------------------------------------------------*/
+
+void sr_pool_put(struct sr_pool* pool, uint8_t* buf)
+{
+    uint64_t old;
+    uint32_t idx;
+
+    if (!buf)
+    { return; }
+
+    if (!sr_pool_owns(pool, buf))
+    {
+        free(buf);
+        return;
+    }
+
+    idx = (buf - pool->mem) / POOL_STRIDE + 1;
+    do
+    {
+        old = pool->head;
+        pool->next[idx - 1] = POOL_IDX(old);
+    } while (!__sync_bool_compare_and_swap(&pool->head, old,
+                                           POOL_HEAD(POOL_TAG(old) + 1, idx)));
+} /* -- sr_pool_put -- */
@@ -0,0 +1,59 @@
+/*-----------------------------------------------------------------------------
+ * file:  sr_pool.h
+ *
+ * Description:
+ *
+ * Preallocated pool of fixed size packet buffers.
+ *
+ * The free list is a lock-free stack of buffer indices; the head carries
+ * a generation tag next to the index so a pop racing with a pop and push
+ * of the same buffer (ABA) fails its compare and swap.
+ *
+ * When the pool is empty, or no pool is given, buffers of the same layout
+ * come from malloc and sr_pool_put frees them, so callers never need to
+ * know where a buffer came from.
+ *
+ *---------------------------------------------------------------------------*/
+
+#ifndef SR_POOL_H
+#define SR_POOL_H
+
+#ifdef _LINUX_
+#include <stdint.h>
+#endif /* _LINUX_ */
+
+#ifdef _DARWIN_
+#include <inttypes.h>
+#endif /* _DARWIN_ */
+
+#define SR_POOL_BUFSZ     2048  /* largest frame a buffer can hold */
+#define SR_POOL_NBUFS     1024  /* default number of buffers */
+
+/* ----------------------------------------------------------------------------
+ * struct sr_pool
+ *
+ * head packs (tag << 32) | (index + 1); an index of 0 means empty.
+ *
+ * -------------------------------------------------------------------------- */
+
+struct sr_pool
+{
+    volatile uint64_t head;
+    uint32_t* next;             /* free list link, index + 1 */
+    uint8_t* mem;               /* nbufs * SR_POOL_BUFSZ */
+    unsigned int nbufs;
+    volatile unsigned long overflow;    /* gets served by malloc */
+};
+
+struct sr_pool* sr_pool_create(unsigned int nbufs);
+void sr_pool_destroy(struct sr_pool* pool);
+
+/* Frame buffer of SR_POOL_BUFSZ bytes. */
+uint8_t* sr_pool_get(struct sr_pool* pool);
+void sr_pool_put(struct sr_pool* pool, uint8_t* buf);
+
+/* Non zero if buf is the start of one of the preallocated buffers.
+   Buffers handed out by the malloc fallback return 0. */
+int sr_pool_owns(const struct sr_pool* pool, const uint8_t* buf);
+
+#endif /* -- SR_POOL_H -- */
@@ -18,11 +18,17 @@
 
 #include "sr_if.h"
 #include "sr_rt.h"
+#include "sr_fib.h"
+#include "sr_epoch.h"
 #include "sr_router.h"
 #include "sr_protocol.h"
 #include "sr_arpcache.h"
 #include "sr_utils.h"
 #include "sr_nat.h"
+#include "sr_pool.h"
+#include "sr_dcache.h"
+#include "sr_worker.h"
+#include "sr_icmplim.h"
 #include <stdbool.h>
 
 #define MIN(A, B) (((A) < (B)) ? (A) : (B))
@@ -40,16 +46,25 @@ void sr_init(struct sr_instance* sr)
     /* REQUIRES */
     assert(sr);
 
+    /* Buffers for generated and queued packets, unless the caller sized
+       the pool already */
+    if (!sr->pool)
+    { sr->pool = sr_pool_create(SR_POOL_NBUFS); }
+    /* the thread calling sr_init reads from the server and forwards; the
+       cache is never shared, other threads find none bound and skip it */
+    sr->dcache = sr_dcache_create();
+    sr_dcache_bind(sr->dcache);
+
     /* Initialize cache and cache cleanup thread */
     sr_arpcache_init(&(sr->cache));
+    sr->cache.pool = sr->pool;
+    sr->cache.sr = sr;
 
     pthread_attr_init(&(sr->attr));
     pthread_attr_setdetachstate(&(sr->attr), PTHREAD_CREATE_JOINABLE);
     pthread_attr_setscope(&(sr->attr), PTHREAD_SCOPE_SYSTEM);
     pthread_attr_setscope(&(sr->attr), PTHREAD_SCOPE_SYSTEM);
-    pthread_t thread;
-
-    pthread_create(&thread, &(sr->attr), sr_arpcache_timeout, sr);
+    pthread_create(&(sr->arp_thread), &(sr->attr), sr_arpcache_timeout, sr);
     
     /* Add initialization code here! */
 } /* -- sr_init -- */
@@ -66,55 +81,29 @@ bool check_sanity (sr_ip_hdr_t* ip_packet, unsigned int len) {
   uint16_t cksum_num = cksum(ip_packet, ip_packet->ip_hl*4);
   ip_packet->ip_sum = ori_cksum;
   if (cksum_num != ori_cksum) return false;
-  /* update ttl */
+  /* update ttl, ttl and protocol share a 16 bit word */
+  uint8_t old_word[2], new_word[2];
+  memcpy(old_word, &ip_packet->ip_ttl, 2);
   ip_packet->ip_ttl--;
-  
-  /* recompute checksum */
-  ip_packet->ip_sum = 0;  
-  uint16_t new_cksum = cksum(ip_packet, ip_packet->ip_hl*4);
-  ip_packet->ip_sum = new_cksum;
+  memcpy(new_word, &ip_packet->ip_ttl, 2);
 
-  return true;
-}
+  /* adjust checksum */
+  ip_packet->ip_sum = cksum_adjust(ip_packet->ip_sum, old_word, new_word, 2);
+  CKSUM_DEBUG_CHECK(ip_packet->ip_sum, cksum(ip_packet, ip_packet->ip_hl*4));
 
-/* check dest ip in routing table */
-struct sr_rt* check_rtable(struct sr_instance* sr, uint32_t ip) {
-  struct sr_rt* rt_pt = sr->routing_table;
-  struct sr_rt* routing_index = NULL;
-  bool is_matched = false;
-  while (rt_pt) {
-    if ( ntohl(rt_pt->dest.s_addr) == (ip & rt_pt->mask.s_addr)) {
-      if (is_matched) {
-        if (ntohl(rt_pt->mask.s_addr) > ntohl(routing_index->mask.s_addr)) {
-          routing_index = rt_pt;
-        }
-      } else {
-        is_matched = true;
-        routing_index = rt_pt;
-      }
-    }
-    rt_pt = rt_pt->next;
-  } 
-  return routing_index;
+  return true;
 }
 
 /* check to ME or not to ME */
-char* should_process(struct sr_instance* sr, sr_ip_hdr_t * ip_packet) {
-  struct sr_if* ifpt = sr->if_list;
-  while(ifpt!=NULL) {
-    if (ifpt->ip == ip_packet->ip_dst) {
-      return ifpt->name;
-    }
-    ifpt = ifpt->next;
-  }
-  return NULL;
+struct sr_if* should_process(struct sr_instance* sr, sr_ip_hdr_t * ip_packet) {
+  return sr_get_interface_by_ip(sr, ip_packet->ip_dst);
 }
 
 /* send ICMP */
 void send_icmp(struct sr_instance* sr,
         uint8_t* packet, 
         unsigned int len, 
-        char* interface,
+        struct sr_if* out_if,
         uint8_t type, 
         uint8_t code) {
  
@@ -122,9 +111,20 @@ void send_icmp(struct sr_instance* sr,
   sr_ethernet_hdr_t* eth_header = (sr_ethernet_hdr_t*)packet; 
   /* get ip header */
   sr_ip_hdr_t* ip_header = (sr_ip_hdr_t*)(eth_header+1); 
-  /* get outgoing interface */
-  struct sr_if* out_if = sr_get_interface(sr, interface); 
   
+  /* errors are rate limited before any work is done for them; the
+     limiter is retired at shutdown, so it is only used in a section */
+  if (type != 0) {
+    sr_epoch_enter();
+    int allowed = sr_icmplim_allow(*(struct sr_icmplim* volatile*)&sr->icmplim,
+                                   ip_header->ip_src);
+    sr_epoch_exit();
+    if (!allowed) {
+      sr_trace(sr_trace_icmp_limit, type << 8 | code, ip_header->ip_src);
+      return;
+    }
+  }
+
   uint8_t icmp_len;
   uint8_t payload_len;
   /* echo reply */
@@ -137,7 +137,7 @@ void send_icmp(struct sr_instance* sr,
   }
   
   uint8_t total_len = sizeof(sr_ethernet_hdr_t)+sizeof(sr_ip_hdr_t)+icmp_len;
-  uint8_t* icmp_pkt = (uint8_t*)malloc(total_len); 
+  uint8_t* icmp_pkt = sr_pool_get(sr->pool);
    
   /* generate ICMP header */  
   sr_icmp_t3_hdr_t* icmp_header = (sr_icmp_t3_hdr_t*)(icmp_pkt+sizeof(sr_ethernet_hdr_t)+sizeof(sr_ip_hdr_t));
@@ -170,16 +170,16 @@ void send_icmp(struct sr_instance* sr,
   new_eth_header->ether_type = htons(ethertype_ip);  
   
   /* send ICMP packet*/
-  sr_ip_forward(sr, icmp_pkt, total_len, interface, true);
-  /* free extra memory */
-  free(icmp_pkt);
+  sr_trace(sr_trace_icmp, type << 8 | code, new_ip_header->ip_dst);
+  sr_ip_forward(sr, icmp_pkt, total_len, out_if, true);
+  sr_pool_put(sr->pool, icmp_pkt);
 }
 
 /* To me */
 void sr_ip_process(struct sr_instance* sr,
         uint8_t * packet/* lent */,
         unsigned int len,
-        char* interface/* lent */) {
+        struct sr_if* iface/* lent */) {
   sr_ethernet_hdr_t* eth_header = (sr_ethernet_hdr_t*)packet;
   sr_ip_hdr_t* ip_header = (sr_ip_hdr_t*)(eth_header+1);
   /* ICMP echo req*/
@@ -189,55 +189,111 @@ void sr_ip_process(struct sr_instance* sr,
     uint8_t code = icmp_header->icmp_code;
     if (type==8 && code==0) {
       /* send echo reply*/
-      send_icmp(sr, packet, len, interface, 0, 0);      
+      send_icmp(sr, packet, len, iface, 0, 0);      
     }  
   } else {
     /* TCP or UDP packet, send ICMP port unreachable */
-    send_icmp(sr, packet, len, interface, 3, 3);
+    send_icmp(sr, packet, len, iface, 3, 3);
   } 
 }
 
+/* Send through the destination cache, false if dst has no current entry */
+static bool sr_dcache_send(struct sr_instance* sr,
+        const struct sr_fib* fib,
+        uint8_t * packet,
+        unsigned int len,
+        uint32_t dst) {
+  struct sr_dcache* dc = sr_dcache_self();
+  const struct sr_dcache_entry* e;
+
+  if (!dc || !fib) {
+    return false;
+  }
+  e = sr_dcache_probe(dc, dst, fib->gen, sr->cache.gen);
+  if (!e) {
+    return false;
+  }
+  /* a hit skips the ARP lookup, but the entry is still in use */
+  sr_arpcache_touch(&sr->cache, e->arp_slot);
+  memcpy(packet, &e->eth, sizeof(sr_ethernet_hdr_t));
+  sr_send_packet(sr, packet, len, sr->if_table[e->if_index]->name);
+  return true;
+}
+
 /* Not to me */
 void sr_ip_forward(struct sr_instance* sr,
         uint8_t * packet,
         unsigned int len,
-        char* interface/* lent */,
+        struct sr_if* iface/* lent */,
         bool ICMP) {
   sr_ethernet_hdr_t* eth_header = (sr_ethernet_hdr_t*)packet;  
   sr_ip_hdr_t* ip_header = (sr_ip_hdr_t*)(eth_header+1);  
+  uint32_t dst = ntohl(ip_header->ip_dst);
+  /* the FIB stays valid until sr_epoch_exit, even if a new one is published */
+  sr_epoch_enter();
+  const struct sr_fib* fib = sr_fib_current(sr);
+  /* generations first, so a concurrent change invalidates what we cache */
+  uint32_t fib_gen = fib ? fib->gen : 0;
+  uint32_t arp_gen = sr->cache.gen;
+  if (sr_dcache_send(sr, fib, packet, len, dst)) {
+    sr_epoch_exit();
+    return;
+  }
   /* check dest IP in routing table */ 
-  struct sr_rt* routing_index = check_rtable(sr, ntohl(ip_header->ip_dst));
-  if (routing_index) {
-    uint32_t next_hop_ip = ntohl(routing_index->gw.s_addr);
-    char* next_hop_if = routing_index->interface;
+  const struct sr_fib_nh* nh = sr_fib_lookup(fib, dst);
+  if (nh && nh->group) {
+    nh = sr_fib_member(fib, nh, sr_flow_hash(packet, len));
+  }
+  if (nh) {
+    uint32_t next_hop_ip = nh->gw;
+    struct sr_if* out_if = sr_fib_iface(fib, nh);
+    char* next_hop_if = out_if->name;
     /* check ARP in cache */
-    struct sr_arpentry *entry = sr_arpcache_lookup(&sr->cache, next_hop_ip);
-    if (entry && entry->valid) {
-      struct sr_if* out_if = sr_get_interface(sr, next_hop_if);
+    struct sr_arpentry entry;
+    unsigned int arp_slot;
+    if (sr_arpcache_lookup_slot(&sr->cache, next_hop_ip, &entry, &arp_slot) &&
+        entry.valid) {
       /* update ethernet header */
       memcpy(eth_header->ether_shost, out_if->addr, ETHER_ADDR_LEN);
-      memcpy(eth_header->ether_dhost, entry->mac, ETHER_ADDR_LEN); 
+      memcpy(eth_header->ether_dhost, entry.mac, ETHER_ADDR_LEN); 
+      /* multipath picks per flow, a per destination entry would pin it */
+      if (sr_dcache_self() && !nh->group) {
+        sr_dcache_fill(sr_dcache_self(), dst, fib_gen, arp_gen, out_if, entry.mac,
+                       arp_slot);
+      }
       /* send packet to next hop*/ 
       sr_send_packet(sr, packet, len, next_hop_if);
+      sr_fib_count(fib, nh);
     } else {
-      /* save packet in the request queue */
+      /* save packet in the request queue; hold the lock so another
+         thread's ARP reply cannot free req before we use it */
+      pthread_mutex_lock(&sr->cache.lock);
       struct sr_arpreq * req =  sr_arpcache_queuereq(&sr->cache, next_hop_ip, packet, len, next_hop_if);
-      send_arp_request(sr, req);
+      sr_trace(sr_trace_arp_queue, len, htonl(next_hop_ip));
+      /* only the first miss asks, the request's timer does the rest */
+      if (req->times_sent == 0) {
+        send_arp_request(sr, req);
+        req->sent = time(NULL);
+        req->times_sent++;
+      } else {
+        sr->cache.arp_suppressed++;
+      }
+      pthread_mutex_unlock(&sr->cache.lock);
+      sr_fib_count(fib, nh);
     }
-    free(entry);
   } else {
     /* ICMP destination unreachable*/
     if (!ICMP) {
-      send_icmp(sr, packet, len, interface, 3, 0);
+      send_icmp(sr, packet, len, iface, 3, 0);
     }
   }
- 
+  sr_epoch_exit();
 }
 
 void handle_arp_reply (struct sr_instance* sr,
         uint8_t * packet/* lent */,
         unsigned int len,
-        char* interface/* lent */) {
+        struct sr_if* iface/* lent */) {
   sr_ethernet_hdr_t* eth_header = (sr_ethernet_hdr_t*)packet;
   sr_arp_hdr_t* arp_header = (sr_arp_hdr_t*)(eth_header+1);
   if (arp_header->ar_sha) {
@@ -245,7 +301,8 @@ void handle_arp_reply (struct sr_instance* sr,
     if (waiting_req) {
       struct sr_packet* waiting_pkt = waiting_req->packets;
       while (waiting_pkt) {
-        sr_ip_forward(sr, waiting_pkt->buf, waiting_pkt->len, waiting_pkt->iface, false); 
+        sr_ip_forward(sr, waiting_pkt->buf, waiting_pkt->len,
+                      sr_get_interface(sr, waiting_pkt->iface), false); 
         waiting_pkt = waiting_pkt->next;
       }
       sr_arpreq_destroy(&sr->cache, waiting_req); 
@@ -254,23 +311,21 @@ void handle_arp_reply (struct sr_instance* sr,
 }
 
 bool check_my_if(struct sr_instance* sr, uint32_t req_ip) {
-  struct sr_if* if_pt = sr->if_list;
-  while (if_pt) {
-    if (if_pt->ip == req_ip) return true;
-    if_pt = if_pt->next;
-  } 
-  return false;
+  return sr_get_interface_by_ip(sr, req_ip) != NULL;
 }
 
 void send_arp_reply(struct sr_instance* sr,
         uint8_t * packet/* lent */,
         unsigned int len,
-        char* interface/* lent */) {
+        struct sr_if* if_pt/* lent */) {
   sr_ethernet_hdr_t* eth_header = (sr_ethernet_hdr_t*)packet;
   sr_arp_hdr_t* arp_header = (sr_arp_hdr_t*)(eth_header+1);
-  struct sr_if* if_pt = sr_get_interface(sr, interface);;
+  /* build the reply straight into one buffer */
+  uint8_t* new_arp_packet = sr_pool_get(sr->pool);
+  sr_ethernet_hdr_t *new_eth_header = (sr_ethernet_hdr_t*)new_arp_packet;
+  sr_arp_hdr_t* new_arp_header = (sr_arp_hdr_t*)(new_eth_header+1);
+
   /* generate arp reply header*/ 
-  sr_arp_hdr_t* new_arp_header = (sr_arp_hdr_t*)malloc(sizeof(sr_arp_hdr_t));
   new_arp_header->ar_hrd = htons(arp_hrd_ethernet);  
   new_arp_header->ar_pro = htons(ethertype_ip); 
   new_arp_header->ar_hln = ETHER_ADDR_LEN; 
@@ -283,21 +338,13 @@ void send_arp_reply(struct sr_instance* sr,
   new_arp_header->ar_tip = arp_header->ar_sip;
    
   /* generate ethernet frame*/
-  sr_ethernet_hdr_t *new_eth_header = (sr_ethernet_hdr_t*)malloc(sizeof(sr_ethernet_hdr_t));
-  memcpy(new_eth_header, eth_header, sizeof(sr_ethernet_hdr_t));
+  new_eth_header->ether_type = eth_header->ether_type;
   memcpy(new_eth_header->ether_shost, if_pt->addr, ETHER_ADDR_LEN);
   memcpy(new_eth_header->ether_dhost, eth_header->ether_shost, ETHER_ADDR_LEN); 
-  
-  /* generate arp packet*/
-  uint8_t* new_arp_packet = (uint8_t*)malloc(sizeof(sr_ethernet_hdr_t)+sizeof(sr_arp_hdr_t));
-  memcpy(new_arp_packet, new_eth_header, sizeof(sr_ethernet_hdr_t));
-  memcpy(new_arp_packet+sizeof(sr_ethernet_hdr_t), new_arp_header, sizeof(sr_arp_hdr_t)); 
 
   /* send arp reply */
-  sr_send_packet(sr, new_arp_packet, sizeof(sr_arp_hdr_t)+sizeof(sr_ethernet_hdr_t), interface);
-  free(new_arp_packet);
-  free(new_arp_header);
-  free(new_eth_header);
+  sr_send_packet(sr, new_arp_packet, sizeof(sr_arp_hdr_t)+sizeof(sr_ethernet_hdr_t), if_pt->name);
+  sr_pool_put(sr->pool, new_arp_packet);
   return; 
 }
 
@@ -305,26 +352,35 @@ void send_arp_reply(struct sr_instance* sr,
 void sr_handle_ip(struct sr_instance* sr,
         uint8_t * packet/* lent */,
         unsigned int len,
-        char* interface/* lent */) {
+        struct sr_if* iface/* lent */) {
   sr_ip_hdr_t *iphdr = (sr_ip_hdr_t *)(packet + sizeof(sr_ethernet_hdr_t));
   if (!check_sanity(iphdr, len)) return;
+  sr_handle_ip_checked(sr, packet, len, iface);
+}
+
+/* IP packet that already passed check_sanity (TTL decremented) */
+void sr_handle_ip_checked(struct sr_instance* sr,
+        uint8_t * packet/* lent */,
+        unsigned int len,
+        struct sr_if* iface/* lent */) {
+  sr_ip_hdr_t *iphdr = (sr_ip_hdr_t *)(packet + sizeof(sr_ethernet_hdr_t));
   /* check ttl */
   if (iphdr->ip_ttl == 0) {
-    send_icmp(sr, packet, len, interface, 11, 0);
+    send_icmp(sr, packet, len, iface, 11, 0);
     return;
   }
 
   if (sr->nat) {
-    if (translate_packet(sr, packet, len, interface) == -1) {
+    if (translate_packet(sr, packet, len, iface) == -1) {
       return;
     }
   }
 
-  char* dest_if = NULL;
+  struct sr_if* dest_if = NULL;
   if ((dest_if = should_process(sr, iphdr))) {
     sr_ip_process(sr, packet, len, dest_if); /*To me*/
   } else {
-    sr_ip_forward(sr, packet, len, interface, false); /*Not to me */
+    sr_ip_forward(sr, packet, len, iface, false); /*Not to me */
   }
 
 }
@@ -332,14 +388,14 @@ void sr_handle_ip(struct sr_instance* sr,
 void sr_handle_arp(struct sr_instance* sr,
         uint8_t * packet/* lent */,
         unsigned int len,
-        char* interface) {
+        struct sr_if* iface) {
   sr_arp_hdr_t* arp_header = (sr_arp_hdr_t*)(packet+sizeof(sr_ethernet_hdr_t));
   if (ntohs(arp_header->ar_op) == 1) {
     /* arp request to me */ 
-    send_arp_reply(sr, packet, len, interface);
+    send_arp_reply(sr, packet, len, iface);
   } else if (ntohs(arp_header->ar_op) == 2) {
     /* arp reply to me*/
-    handle_arp_reply(sr, packet, len, interface);
+    handle_arp_reply(sr, packet, len, iface);
   }
 }
 
@@ -369,15 +425,42 @@ void sr_handlepacket(struct sr_instance* sr,
   assert(packet);
   assert(interface);
 
-  printf("*** -> Received packet of length %d \n",len);
+  struct sr_if* iface = sr_get_interface(sr, interface);
+  if (iface) {
+    sr_handlepacket_if(sr, packet, len, iface);
+  }
+
+}/* end sr_ForwardPacket */
+
+/*---------------------------------------------------------------------
+ * Method: sr_handlepacket_if(..)
+ * Scope:  Global
+ *
+ * Same as sr_handlepacket but with the receiving interface already
+ * resolved, so the name carried in the VNS header is looked up once per
+ * frame rather than in every handler.
+ *
+ *---------------------------------------------------------------------*/
+
+void sr_handlepacket_if(struct sr_instance* sr,
+        uint8_t * packet/* lent */,
+        unsigned int len,
+        struct sr_if* iface/* lent */)
+{
+  /* REQUIRES */
+  assert(sr);
+  assert(packet);
+  assert(iface);
+
+  sr_trace(sr_trace_rx, len, iface->index);
   /* fill in code here */
   if (ethertype(packet) == ethertype_ip) {
-    sr_handle_ip(sr, packet, len, interface);  
+    sr_handle_ip(sr, packet, len, iface);  
   } else if (ethertype(packet) == ethertype_arp) {
-    sr_handle_arp(sr, packet, len, interface);
+    sr_handle_arp(sr, packet, len, iface);
   }
 
-}/* end sr_ForwardPacket */
+}/* end sr_handlepacket_if */
 
 
 
@@ -389,3 +472,174 @@ void sr_handlepacket(struct sr_instance* sr,
 
 
 
+
+/*---------------------------------------------------------------------
+ * Method: sr_handlepacket_burst(..)
+ * Scope:  Global
+ *
+ * Process a vector of received frames in passes instead of one frame
+ * end to end:
+ *
+ *   1. classify: sanity check, TTL, ARP / to me / NAT go to the slow
+ *      path, plain IP forwarding probes the destination cache and goes
+ *      to the fast path on a miss
+ *   2. longest prefix match for every fast path frame, prefetching the
+ *      next frame's first level FIB slot
+ *   3. ARP lookups for the whole vector, results are written to the
+ *      frames and the destination cache
+ *   4. emit in arrival order, under one nat->lock when NAT is on
+ *
+ * A fast path frame whose next hop was not in the ARP cache goes
+ * through sr_ip_forward at emit time, so an ARP reply earlier in the
+ * same burst is still seen.  Frames are lent, as in sr_handlepacket.
+ *
+ *---------------------------------------------------------------------*/
+
+enum { burst_drop, burst_arp, burst_ip, burst_fwd };
+
+static void sr_handlepacket_vec(struct sr_instance* sr,
+        struct sr_frame* frames/* lent */,
+        unsigned int n)
+{
+  uint8_t cls[SR_BURST_MAX];
+  uint32_t dst[SR_BURST_MAX];
+  const struct sr_fib_nh* nh[SR_BURST_MAX];
+  struct sr_arpentry arp[SR_BURST_MAX];
+  unsigned int arp_slot[SR_BURST_MAX];
+  struct sr_if* out[SR_BURST_MAX]; /* set once the frame is ready to send */
+  unsigned int fwd[SR_BURST_MAX]; /* indices of fast path frames */
+  unsigned int i, k, n_fwd = 0;
+  struct sr_dcache* dc = sr_dcache_self();
+  const struct sr_dcache_entry* e;
+  const struct sr_fib* fib = sr_fib_current(sr); /* caller is in an epoch */
+  /* generations first, so a concurrent change invalidates what we cache */
+  uint32_t fib_gen = fib ? fib->gen : 0;
+  uint32_t arp_gen = sr->cache.gen;
+
+  /* -- pass 1: classify -- */
+  for (i = 0; i < n; i++) {
+    struct sr_frame* f = &frames[i];
+    sr_ip_hdr_t* iphdr = (sr_ip_hdr_t*)(f->buf + sizeof(sr_ethernet_hdr_t));
+
+    if (i + 2 < n) {
+      __builtin_prefetch(frames[i + 2].buf);
+    }
+
+    cls[i] = burst_drop;
+    out[i] = NULL;
+    nh[i] = NULL;
+    if (f->len < sizeof(sr_ethernet_hdr_t)) {
+      continue;
+    }
+    if (ethertype(f->buf) == ethertype_arp) {
+      cls[i] = burst_arp;
+      continue;
+    }
+    if (ethertype(f->buf) != ethertype_ip ||
+        f->len < sizeof(sr_ethernet_hdr_t) + sizeof(sr_ip_hdr_t) ||
+        !check_sanity(iphdr, f->len)) {
+      continue;
+    }
+    if (iphdr->ip_ttl == 0 || sr->nat || should_process(sr, iphdr)) {
+      cls[i] = burst_ip;
+      continue;
+    }
+    cls[i] = burst_fwd;
+    dst[i] = ntohl(iphdr->ip_dst);
+    if (dc && (e = sr_dcache_probe(dc, dst[i], fib_gen, arp_gen))) {
+      sr_arpcache_touch(&sr->cache, e->arp_slot);
+      memcpy(f->buf, &e->eth, sizeof(sr_ethernet_hdr_t));
+      out[i] = sr->if_table[e->if_index];
+      continue;
+    }
+    fwd[n_fwd++] = i;
+  }
+
+  /* -- pass 2: route lookups -- */
+  for (k = 0; k < n_fwd; k++) {
+    if (k + 1 < n_fwd && fib) {
+      __builtin_prefetch(&fib->l0[dst[fwd[k + 1]] >> SR_FIB_L0_BITS]);
+    }
+    i = fwd[k];
+    nh[i] = sr_fib_lookup(fib, dst[i]);
+    if (nh[i] && nh[i]->group) {
+      nh[i] = sr_fib_member(fib, nh[i], sr_flow_hash(frames[i].buf, frames[i].len));
+    }
+  }
+
+  /* -- pass 3: next hop MACs -- */
+  for (k = 0; k < n_fwd; k++) {
+    i = fwd[k];
+    if (nh[i] && sr_arpcache_lookup_slot(&sr->cache, nh[i]->gw, &arp[i],
+                                         &arp_slot[i]) && arp[i].valid) {
+      out[i] = sr_fib_iface(fib, nh[i]);
+    }
+  }
+
+  for (k = 0; k < n_fwd; k++) {
+    sr_ethernet_hdr_t* eth_header;
+    i = fwd[k];
+    if (!out[i]) {
+      continue;
+    }
+    eth_header = (sr_ethernet_hdr_t*)frames[i].buf;
+    memcpy(eth_header->ether_shost, out[i]->addr, ETHER_ADDR_LEN);
+    memcpy(eth_header->ether_dhost, arp[i].mac, ETHER_ADDR_LEN);
+    if (dc && !nh[i]->group) {
+      sr_dcache_fill(dc, dst[i], fib_gen, arp_gen, out[i], arp[i].mac,
+                     arp_slot[i]);
+    }
+  }
+
+  /* -- pass 4: emit in order -- */
+  if (sr->nat) {
+    pthread_mutex_lock(&sr->nat->lock);
+  }
+  for (i = 0; i < n; i++) {
+    struct sr_frame* f = &frames[i];
+    switch (cls[i]) {
+      case burst_arp:
+        sr_handle_arp(sr, f->buf, f->len, f->iface);
+        break;
+      case burst_ip:
+        sr_handle_ip_checked(sr, f->buf, f->len, f->iface);
+        break;
+      case burst_fwd:
+        if (out[i]) {
+          sr_send_packet(sr, f->buf, f->len, out[i]->name);
+          if (nh[i]) {
+            sr_fib_count(fib, nh[i]);
+          }
+        } else {
+          /* no route (ICMP net unreachable) or ARP miss (queue) */
+          sr_ip_forward(sr, f->buf, f->len, f->iface, false);
+        }
+        break;
+      default:
+        sr_trace(sr_trace_drop, f->len, f->iface->index);
+        break;
+    }
+  }
+  if (sr->nat) {
+    pthread_mutex_unlock(&sr->nat->lock);
+  }
+  sr_trace(sr_trace_burst, n, n_fwd);
+}
+
+void sr_handlepacket_burst(struct sr_instance* sr,
+        struct sr_frame* frames/* lent */,
+        unsigned int n)
+{
+  /* REQUIRES */
+  assert(sr);
+  assert(frames || n == 0);
+
+  sr_epoch_enter();
+  while (n > 0) {
+    unsigned int chunk = MIN(n, SR_BURST_MAX);
+    sr_handlepacket_vec(sr, frames, chunk);
+    frames += chunk;
+    n -= chunk;
+  }
+  sr_epoch_exit();
+}/* end sr_handlepacket_burst */
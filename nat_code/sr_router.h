@@ -15,20 +15,13 @@
 #include <stdbool.h>
 #include "sr_protocol.h"
 #include "sr_arpcache.h"
+#include "sr_if.h"
 #include "sr_nat.h"
 
-/* we dont like this debug , but what to do for varargs ? */
-#ifdef _DEBUG_
-#define Debug(x, args...) printf(x, ## args)
-#define DebugMAC(x) \
-  do { int ivyl; for(ivyl=0; ivyl<5; ivyl++) printf("%02x:", \
-  (unsigned char)(x[ivyl])); printf("%02x",(unsigned char)(x[5])); } while (0)
-#else
-#define Debug(x, args...) do{}while(0)
-#define DebugMAC(x) do{}while(0)
-#endif
+#include "sr_log.h" /* Debug(), sr_trace() */
 
 #define INIT_TTL 255
+#define SR_BURST_MAX 64  /* frames per sr_handlepacket_burst pass */
 #define PACKET_DUMP_SIZE 1024
 #ifndef IPV4_HDR_LEN
 #define IPV4_HDR_LEN 4
@@ -36,6 +29,15 @@
 /* forward declare */
 struct sr_if;
 struct sr_rt;
+struct sr_fib;
+struct sr_pool;
+struct sr_txq;
+struct sr_workers;
+struct sr_rxbuf;
+struct sr_io;
+struct sr_pcaplog;
+struct sr_icmplim;
+struct sr_dcache;
 
 /* ----------------------------------------------------------------------------
  * struct sr_instance
@@ -53,11 +55,41 @@ struct sr_instance
     unsigned short topo_id;
     struct sockaddr_in sr_addr; /* address to server */
     struct sr_if* if_list; /* list of interfaces */
+    struct sr_if* if_table[SR_IF_MAX]; /* interfaces by index */
+    unsigned int if_count;
+    struct sr_if* if_name_hash[SR_IF_HASH_SZ]; /* open addressing on name */
+    struct sr_if* if_ip_hash[SR_IF_HASH_SZ];   /* local address set */
     struct sr_rt* routing_table; /* routing table */
+    struct sr_rt** rt_tail; /* last link of routing_table, 0 if not known */
+    struct sr_fib* fib; /* compiled from routing_table, swapped on change */
+    pthread_mutex_t rt_lock; /* serializes routing_table changes */
     struct sr_arpcache cache;   /* ARP cache */
+    struct sr_pool* pool; /* packet buffers for TX and queued frames */
+    struct sr_dcache* dcache; /* bound to the thread that ran sr_init only */
     pthread_attr_t attr;
-    FILE* logfile;
+    pthread_t arp_thread; /* ARP cache timeout thread */
+    pthread_mutex_t tx_lock; /* serializes writes to sockfd */
+    struct sr_pcaplog* logfile; /* -l, written by its own thread */
     struct sr_nat* nat;
+    struct sr_icmplim* icmplim; /* generated ICMP errors, 0 no limit */
+    struct sr_txq* txq; /* staged output in coalescing mode, else 0 */
+    struct sr_rxbuf* rx; /* unparsed input from the server */
+    struct sr_workers* workers; /* forwarding threads, 0 forwards inline */
+    struct sr_io* io; /* local devices instead of the server, see sr_io.h */
+};
+
+/* ----------------------------------------------------------------------------
+ * struct sr_frame
+ *
+ * One received frame handed to sr_handlepacket_burst.
+ *
+ * -------------------------------------------------------------------------- */
+
+struct sr_frame
+{
+    uint8_t* buf;           /* ethernet frame, lent */
+    unsigned int len;
+    struct sr_if* iface;    /* receiving interface */
 };
 
 /* -- sr_main.c -- */
@@ -67,23 +99,34 @@ int sr_verify_routing_table(struct sr_instance* sr);
 int sr_send_packet(struct sr_instance* , uint8_t* , unsigned int , const char*);
 int sr_connect_to_server(struct sr_instance* ,unsigned short , char* );
 int sr_read_from_server(struct sr_instance* );
+int sr_send_coalesce(struct sr_instance* , unsigned int );
+void sr_send_coalesce_stop(struct sr_instance* );
+int sr_send_flush(struct sr_instance* );
+struct sr_txq* sr_txq_create(void);
+void sr_txq_destroy(struct sr_txq* );
+void sr_send_thread_queue(struct sr_txq* );
+void sr_log_packet(struct sr_instance* , uint8_t* , int );
+int sr_arp_req_not_for_us(struct sr_instance* , uint8_t* , unsigned int , struct sr_if* );
 
 /* -- sr_router.c -- */
 void sr_init(struct sr_instance* );
 void sr_handlepacket(struct sr_instance* , uint8_t * , unsigned int , char* );
+void sr_handlepacket_if(struct sr_instance* , uint8_t * , unsigned int , struct sr_if* );
+void sr_handlepacket_burst(struct sr_instance* , struct sr_frame* , unsigned int );
 bool check_sanity (sr_ip_hdr_t* ip_packet, unsigned int len);
-char* should_process(struct sr_instance* sr, sr_ip_hdr_t * ip_packet);
-void sr_ip_process(struct sr_instance* sr, uint8_t * packet/* lent */, unsigned int len, char* interface/* lent */);
-void sr_ip_forward(struct sr_instance* sr, uint8_t * packet/* lent */, unsigned int len, char* interface/* lent */, bool);
-void send_icmp(struct sr_instance* sr, uint8_t * packet/* lent */, unsigned int len, char* interface/* lent */, uint8_t, uint8_t);
-struct sr_rt* check_rtable(struct sr_instance*, uint32_t);
-void sr_handle_ip(struct sr_instance* sr, uint8_t * packet/* lent */, unsigned int len, char* interface/* lent */);
-void sr_handle_arp(struct sr_instance* sr, uint8_t * packet/* lent */, unsigned int len, char* interface/* lent */);
+struct sr_if* should_process(struct sr_instance* sr, sr_ip_hdr_t * ip_packet);
+void sr_ip_process(struct sr_instance* sr, uint8_t * packet/* lent */, unsigned int len, struct sr_if* iface/* lent */);
+void sr_ip_forward(struct sr_instance* sr, uint8_t * packet/* lent */, unsigned int len, struct sr_if* iface/* lent */, bool);
+void send_icmp(struct sr_instance* sr, uint8_t * packet/* lent */, unsigned int len, struct sr_if* iface/* lent */, uint8_t, uint8_t);
+void sr_handle_ip(struct sr_instance* sr, uint8_t * packet/* lent */, unsigned int len, struct sr_if* iface/* lent */);
+void sr_handle_ip_checked(struct sr_instance* sr, uint8_t * packet/* lent */, unsigned int len, struct sr_if* iface/* lent */);
+void sr_handle_arp(struct sr_instance* sr, uint8_t * packet/* lent */, unsigned int len, struct sr_if* iface/* lent */);
 
 /* -- sr_if.c -- */
 void sr_add_interface(struct sr_instance* , const char* );
 void sr_set_ether_ip(struct sr_instance* , uint32_t );
 void sr_set_ether_addr(struct sr_instance* , const unsigned char* );
 void sr_print_if_list(struct sr_instance* );
+void sr_index_interfaces(struct sr_instance* );
 
 #endif /* SR_ROUTER_H */
@@ -21,24 +21,235 @@
 
 #include "sr_rt.h"
 #include "sr_router.h"
+#include "sr_fib.h"
 
 /*---------------------------------------------------------------------
- * Method:
+ * Method: rt_append(..)
+ * Scope:  Local
+ *
+ * Append an entry to the list that *tail ends, walking to the end first
+ * if tail is not the last link.  Returns the new last link, so a caller
+ * that keeps it appends in constant time.
  *
  *---------------------------------------------------------------------*/
 
-int sr_load_rt(struct sr_instance* sr,const char* filename)
+static struct sr_rt** rt_append(struct sr_rt** tail, struct in_addr dest,
+        struct in_addr gw, struct in_addr mask, const char* if_name)
+{
+    struct sr_rt* entry;
+
+    /* -- find the end of the list -- */
+    while(*tail)
+    { tail = &(*tail)->next; }
+
+    entry = (struct sr_rt*)malloc(sizeof(struct sr_rt));
+    assert(entry);
+    entry->next = 0;
+    entry->dest = dest;
+    entry->gw   = gw;
+    entry->mask = mask;
+    strncpy(entry->interface,if_name,sr_IFACE_NAMELEN);
+    entry->interface[sr_IFACE_NAMELEN - 1] = '\0';
+    *tail = entry;
+    return &entry->next;
+} /* -- rt_append -- */
+
+void sr_rt_free(struct sr_rt* rt)
+{
+    struct sr_rt* next;
+
+    for( ; rt; rt = next)
+    {
+        next = rt->next;
+        free(rt);
+    }
+} /* -- sr_rt_free -- */
+
+#define RT_SPACE(c) ((c) == ' ' || (c) == '\t' || (c) == '\r')
+
+/* Next blank separated token on the line, 0 at the end of the line. */
+static const char* rt_token(const char** p, const char* end, unsigned int* len)
+{
+    const char* tok;
+
+    while(*p < end && RT_SPACE(**p))
+    { (*p)++; }
+    tok = *p;
+    while(*p < end && **p != '\n' && !RT_SPACE(**p))
+    { (*p)++; }
+    *len = *p - tok;
+    return *len ? tok : 0;
+} /* -- rt_token -- */
+
+/*---------------------------------------------------------------------
+ * Method: rt_parse_ip(..)
+ * Scope:  Local
+ *
+ * Dotted decimal quad without a library call; anything else inet_aton
+ * accepts (octal, hex, fewer parts) still goes through inet_aton.
+ * Returns 0 if tok is not an address.
+ *
+ *---------------------------------------------------------------------*/
+
+static int rt_parse_ip(const char* tok, unsigned int len, struct in_addr* addr)
+{
+    char copy[32];
+    uint32_t ip = 0, octet = 0;
+    unsigned int i, digits = 0, dots = 0;
+
+    for(i = 0; i < len; i++)
+    {
+        char c = tok[i];
+        if(c >= '0' && c <= '9' && digits < 3 && !(digits == 1 && octet == 0))
+        {
+            octet = octet * 10 + (c - '0');
+            digits++;
+        }
+        else if(c == '.' && digits && dots < 3 && octet <= 255)
+        {
+            ip = (ip << 8) | octet;
+            octet = digits = 0;
+            dots++;
+        }
+        else
+        { break; }
+    }
+    if(i == len && dots == 3 && digits && octet <= 255)
+    {
+        addr->s_addr = htonl((ip << 8) | octet);
+        return 1;
+    }
+
+    if(len >= sizeof(copy))
+    { return 0; }
+    memcpy(copy,tok,len);
+    copy[len] = '\0';
+    return inet_aton(copy,addr) != 0;
+} /* -- rt_parse_ip -- */
+
+/*---------------------------------------------------------------------
+ * Method: sr_rt_parse(..)
+ *
+ * Parse routing table text, one "dest gateway mask interface" entry per
+ * line, in a single pass with constant time appends.  Blank lines are
+ * skipped, and so are lines with fewer than four fields, with a warning.
+ * Returns 0 and the list in *routes, or -1 if an address does not
+ * parse.
+ *
+ *---------------------------------------------------------------------*/
+
+int sr_rt_parse(const char* text, size_t len, struct sr_rt** routes)
+{
+    const char* p = text;
+    const char* end = text + len;
+    const char* tok[4];
+    unsigned int tlen[4];
+    struct in_addr addr[3];
+    struct sr_rt** tail = routes;
+    char iface[sr_IFACE_NAMELEN];
+    unsigned int lineno = 0;
+    int i;
+
+    *routes = 0;
+    while(p < end)
+    {
+        lineno++;
+        for(i = 0; i < 4; i++)
+        {
+            if((tok[i] = rt_token(&p,end,&tlen[i])) == 0)
+            { break; }
+        }
+        /* -- the rest of the line is ignored -- */
+        while(p < end && *p != '\n')
+        { p++; }
+        p++;
+        if(i > 0 && i < 4)
+        {
+            fprintf(stderr,
+                    "*warning* routing table line %u has %d of 4 fields, skipped\n",
+                    lineno, i);
+        }
+        if(i < 4)
+        { continue; }
+
+        for(i = 0; i < 3; i++)
+        {
+            if(!rt_parse_ip(tok[i],tlen[i],&addr[i]))
+            {
+                fprintf(stderr,
+                        "Error loading routing table, cannot convert %.*s to valid IP (line %u)\n",
+                        (int)tlen[i], tok[i], lineno);
+                sr_rt_free(*routes);
+                *routes = 0;
+                return -1;
+            }
+        }
+        if(tlen[3] >= sr_IFACE_NAMELEN)
+        { tlen[3] = sr_IFACE_NAMELEN - 1; }
+        memcpy(iface,tok[3],tlen[3]);
+        iface[tlen[3]] = '\0';
+        tail = rt_append(tail,addr[0],addr[1],addr[2],iface);
+    }
+    return 0;
+} /* -- sr_rt_parse -- */
+
+/*---------------------------------------------------------------------
+ * Method: sr_rt_read(..)
+ *
+ * sr_rt_parse on the whole of a text file.
+ *
+ *---------------------------------------------------------------------*/
+
+int sr_rt_read(const char* filename, struct sr_rt** routes)
 {
     FILE* fp;
-    char  line[BUFSIZ];
-    char  dest[32];
-    char  gw[32];
-    char  mask[32];
-    char  iface[32];
-    struct in_addr dest_addr;
-    struct in_addr gw_addr;
-    struct in_addr mask_addr;
-    int clear_routing_table = 0;
+    char* text;
+    long len;
+    int ret;
+
+    fp = fopen(filename,"r");
+    if( fp == 0 )
+    {
+        perror("fopen");
+        return -1;
+    }
+    fseek(fp,0,SEEK_END);
+    len = ftell(fp);
+    fseek(fp,0,SEEK_SET);
+
+    text = (char*)malloc(len > 0 ? len : 1);
+    assert(text);
+    if(len > 0 && fread(text,1,len,fp) != (size_t)len)
+    {
+        perror("fread");
+        free(text);
+        fclose(fp);
+        return -1;
+    }
+    fclose(fp);
+
+    ret = sr_rt_parse(text,len > 0 ? len : 0,routes);
+    free(text);
+    return ret;
+} /* -- sr_rt_read -- */
+
+/*---------------------------------------------------------------------
+ * Method: sr_load_rt(..)
+ *
+ * Read a routing table file and make it the live table.  Text tables
+ * are parsed and compiled; a FIB compiled by sr_fibc is mapped as is.
+ * The table is loaded off to the side, so on error the current routes
+ * stay in place; on success the new FIB is published and the old one
+ * retired.  A table naming an interface the router lacks is an error
+ * too.  Safe to call while forwarding, e.g. to reload on SIGHUP.
+ *
+ *---------------------------------------------------------------------*/
+
+int sr_load_rt(struct sr_instance* sr,const char* filename)
+{
+    struct sr_rt* routes = 0;
+    struct sr_rt* old;
+    struct sr_fib* fib;
 
     /* -- REQUIRES -- */
     assert(filename);
@@ -48,88 +259,121 @@ int sr_load_rt(struct sr_instance* sr,const char* filename)
         return -1;
     }
 
-    fp = fopen(filename,"r");
+    if( sr_fib_file_check(filename) )
+    {
+        if( (fib = sr_fib_map(filename,&routes)) == 0 )
+        { return -1; }
+    }
+    else
+    {
+        if( sr_rt_read(filename,&routes) != 0 )
+        { return -1; }
+        fib = sr_fib_build(routes);
+    }
 
-    while( fgets(line,BUFSIZ,fp) != 0)
+    /* -- swap the list and publish its FIB, interfaces may not be known yet -- */
+    pthread_mutex_lock(&sr->rt_lock);
+    if( sr_fib_publish(sr, fib) != 0 )
     {
-        sscanf(line,"%s %s %s %s",dest,gw,mask,iface);
-        if(inet_aton(dest,&dest_addr) == 0)
-        { 
-            fprintf(stderr,
-                    "Error loading routing table, cannot convert %s to valid IP\n",
-                    dest);
-            return -1; 
-        }
-        if(inet_aton(gw,&gw_addr) == 0)
-        { 
-            fprintf(stderr,
-                    "Error loading routing table, cannot convert %s to valid IP\n",
-                    gw);
-            return -1; 
-        }
-        if(inet_aton(mask,&mask_addr) == 0)
-        { 
-            fprintf(stderr,
-                    "Error loading routing table, cannot convert %s to valid IP\n",
-                    mask);
-            return -1; 
-        }
-        if( clear_routing_table == 0 ){
-            printf("Loading routing table from server, clear local routing table.\n");
-            sr->routing_table = 0;
-            clear_routing_table = 1;
-        }
-        sr_add_rt_entry(sr,dest_addr,gw_addr,mask_addr,iface);
-    } /* -- while -- */
+        pthread_mutex_unlock(&sr->rt_lock);
+        fprintf(stderr,"Error: %s names an interface this router lacks\n",
+                filename);
+        sr_fib_destroy(fib);
+        sr_rt_free(routes);
+        return -1;
+    }
+    old = sr->routing_table;
+    sr->routing_table = routes;
+    sr->rt_tail = 0; /* -- found by the next add -- */
+    pthread_mutex_unlock(&sr->rt_lock);
+    sr_rt_free(old);
+    printf("Routing table loaded from %s, replacing the previous one.\n",
+           filename);
 
     return 0; /* -- success -- */
 } /* -- sr_load_rt -- */
 
 /*---------------------------------------------------------------------
- * Method:
+ * Method: sr_add_rt_entry(..)
+ *
+ * Append to sr->routing_table.  The forwarding path does not see the
+ * change until sr_rt_commit; at run time hold sr->rt_lock around both.
+ * The last link is kept, so only the first add after a load walks the
+ * list.
  *
  *---------------------------------------------------------------------*/
 
 void sr_add_rt_entry(struct sr_instance* sr, struct in_addr dest,
 struct in_addr gw, struct in_addr mask,char* if_name)
 {
-    struct sr_rt* rt_walker = 0;
-
     /* -- REQUIRES -- */
     assert(if_name);
     assert(sr);
 
-    /* -- empty list special case -- */
-    if(sr->routing_table == 0)
-    {
-        sr->routing_table = (struct sr_rt*)malloc(sizeof(struct sr_rt));
-        assert(sr->routing_table);
-        sr->routing_table->next = 0;
-        sr->routing_table->dest = dest;
-        sr->routing_table->gw   = gw;
-        sr->routing_table->mask = mask;
-        strncpy(sr->routing_table->interface,if_name,sr_IFACE_NAMELEN);
+    if(!sr->rt_tail)
+    { sr->rt_tail = &sr->routing_table; }
+    sr->rt_tail = rt_append(sr->rt_tail,dest,gw,mask,if_name);
 
-        return;
-    }
+} /* -- sr_add_entry -- */
 
-    /* -- find the end of the list -- */
-    rt_walker = sr->routing_table;
-    while(rt_walker->next){
-      rt_walker = rt_walker->next; 
+/*---------------------------------------------------------------------
+ * Method: sr_del_rt_entry(..)
+ *
+ * Remove the first entry for dest/mask, through gw if gw is not 0, so
+ * one member of a multipath route can go.  Returns 0 if one was
+ * removed.  Same locking rules as sr_add_rt_entry.
+ *
+ *---------------------------------------------------------------------*/
+
+int sr_del_rt_entry(struct sr_instance* sr, struct in_addr dest,
+        struct in_addr mask, const struct in_addr* gw)
+{
+    struct sr_rt** pp;
+    struct sr_rt* rt;
+
+    /* -- REQUIRES -- */
+    assert(sr);
+
+    for(pp = &sr->routing_table; (rt = *pp); pp = &rt->next)
+    {
+        if(rt->dest.s_addr == dest.s_addr && rt->mask.s_addr == mask.s_addr &&
+           (!gw || rt->gw.s_addr == gw->s_addr))
+        {
+            *pp = rt->next;
+            if(!rt->next)
+            { sr->rt_tail = pp; }
+            free(rt);
+            return 0;
+        }
     }
+    return -1;
+} /* -- sr_del_rt_entry -- */
 
-    rt_walker->next = (struct sr_rt*)malloc(sizeof(struct sr_rt));
-    assert(rt_walker->next);
-    rt_walker = rt_walker->next;
+/*---------------------------------------------------------------------
+ * Method: sr_rt_commit(..)
+ *
+ * Compile sr->routing_table into a new FIB and publish it.  Readers keep
+ * forwarding on the old FIB until the swap and are never blocked.  The
+ * caller holds sr->rt_lock.  Returns -1, keeping the old FIB, if a route
+ * names an interface the router lacks.
+ *
+ *---------------------------------------------------------------------*/
 
-    rt_walker->next = 0;
-    rt_walker->dest = dest;
-    rt_walker->gw   = gw;
-    rt_walker->mask = mask;
-    strncpy(rt_walker->interface,if_name,sr_IFACE_NAMELEN);
+int sr_rt_commit(struct sr_instance* sr)
+{
+    struct sr_fib* fib;
 
-} /* -- sr_add_entry -- */
+    /* -- REQUIRES -- */
+    assert(sr);
+
+    fib = sr_fib_build(sr->routing_table);
+    if( sr_fib_publish(sr, fib) != 0 )
+    {
+        sr_fib_destroy(fib);
+        return -1;
+    }
+    return 0;
+} /* -- sr_rt_commit -- */
 
 /*---------------------------------------------------------------------
  * Method:
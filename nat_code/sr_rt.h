@@ -38,8 +38,14 @@ struct sr_rt
 
 
 int sr_load_rt(struct sr_instance*,const char*);
+int sr_rt_parse(const char*, size_t, struct sr_rt**);
+int sr_rt_read(const char*, struct sr_rt**);
+void sr_rt_free(struct sr_rt*);
 void sr_add_rt_entry(struct sr_instance*, struct in_addr,struct in_addr,
                   struct in_addr, char*);
+int sr_del_rt_entry(struct sr_instance*, struct in_addr, struct in_addr,
+                    const struct in_addr*);
+int sr_rt_commit(struct sr_instance*);
 void sr_print_routing_table(struct sr_instance* sr);
 void sr_print_routing_entry(struct sr_rt* entry);
 
@@ -0,0 +1,219 @@
+/*-----------------------------------------------------------------------------
+ * file:  sr_timer.c
+ *
+ * Description:
+ *
+ * Timer wheel, see sr_timer.h.
+ *
+ *---------------------------------------------------------------------------*/
+
+#include <stdio.h>
+#include <stdlib.h>
+#include <assert.h>
+#include <string.h>
+#include <time.h>
+
+#include "sr_timer.h"
+
+#define TIMER_MASK (SR_TIMER_SLOTS - 1)
+
+static uint64_t timer_ns(void)
+{
+    struct timespec ts;
+
+    clock_gettime(CLOCK_MONOTONIC, &ts);
+    return (uint64_t)ts.tv_sec * 1000000000ull + ts.tv_nsec;
+} /* -- timer_ns -- */
+
+void sr_timer_wheel_init(struct sr_timer_wheel* w)
+{
+    /* -- REQUIRES -- */
+    assert(w);
+
+    memset(w, 0, sizeof(struct sr_timer_wheel));
+    w->t0 = timer_ns();
+} /* -- sr_timer_wheel_init -- */
+
+void sr_timer_init(struct sr_timer* t,
+                   void (*fn)(struct sr_timer* t, void* arg), void* arg)
+{
+    t->next = 0;
+    t->pprev = 0;
+    t->expires = 0;
+    t->fn = fn;
+    t->arg = arg;
+} /* -- sr_timer_init -- */
+
+uint64_t sr_timer_clock(const struct sr_timer_wheel* w)
+{ return (timer_ns() - w->t0) / 1000000; }
+
+/*---------------------------------------------------------------------
+ * Method: timer_place(..)
+ * Scope:  Local
+ *
+ * Link t into the slot for its expiry: the lowest level whose span
+ * covers the distance from now, indexed by the expiry's bits at that
+ * level.
+ *
+ *---------------------------------------------------------------------*/
+
+static void timer_place(struct sr_timer_wheel* w, struct sr_timer* t)
+{
+    uint64_t delta = t->expires - w->now;
+    struct sr_timer** head;
+    unsigned int level = 0;
+    uint64_t expires = t->expires;
+
+    while (level < SR_TIMER_LEVELS - 1 &&
+           delta >= (uint64_t)1 << (SR_TIMER_BITS * (level + 1)))
+    { level++; }
+    if (delta >= (uint64_t)1 << (SR_TIMER_BITS * SR_TIMER_LEVELS))
+    {
+        /* -- beyond the wheel: wait in the farthest slot, placed again then -- */
+        expires = w->now +
+            ((uint64_t)1 << (SR_TIMER_BITS * SR_TIMER_LEVELS)) - 1;
+    }
+    head = &w->slot[level][(expires >> (SR_TIMER_BITS * level)) & TIMER_MASK];
+    t->next = *head;
+    if (t->next)
+    { t->next->pprev = &t->next; }
+    t->pprev = head;
+    *head = t;
+} /* -- timer_place -- */
+
+void sr_timer_add(struct sr_timer_wheel* w, struct sr_timer* t,
+                  unsigned int ms)
+{
+    /* -- REQUIRES -- */
+    assert(w && t && t->fn);
+
+    if (sr_timer_pending(t))
+    { sr_timer_del(w, t); }
+    t->expires = w->now + ms;
+    timer_place(w, t);
+    w->pending++;
+} /* -- sr_timer_add -- */
+
+void sr_timer_del(struct sr_timer_wheel* w, struct sr_timer* t)
+{
+    if (!sr_timer_pending(t))
+    { return; }
+    *t->pprev = t->next;
+    if (t->next)
+    { t->next->pprev = t->pprev; }
+    t->next = 0;
+    t->pprev = 0;
+    w->pending--;
+} /* -- sr_timer_del -- */
+
+/* Move the timers of one higher level slot down to where they now go. */
+static void timer_cascade(struct sr_timer_wheel* w, unsigned int level)
+{
+    unsigned int idx = (w->now >> (SR_TIMER_BITS * level)) & TIMER_MASK;
+    struct sr_timer* t = w->slot[level][idx];
+    struct sr_timer* next;
+
+    w->slot[level][idx] = 0;
+    for (; t; t = next)
+    {
+        next = t->next;
+        timer_place(w, t);
+    }
+} /* -- timer_cascade -- */
+
+/*---------------------------------------------------------------------
+ * Method: sr_timer_run(..)
+ * Scope:  Global
+ *
+ * Tick by tick: at a level 0 wrap the matching slot of each higher level
+ * that also wrapped is cascaded first, then the level 0 slot runs.  The
+ * wheel is moved past the tick before its callbacks, so a timer re-armed
+ * for 0 ms runs on the next tick rather than in this pass.
+ *
+ *---------------------------------------------------------------------*/
+
+unsigned int sr_timer_run(struct sr_timer_wheel* w, uint64_t now)
+{
+    struct sr_timer* due;
+    struct sr_timer* t;
+    unsigned int level, fired = 0;
+
+    /* -- REQUIRES -- */
+    assert(w);
+
+    while (w->now <= now)
+    {
+        if (w->pending == 0)
+        {
+            w->now = now + 1;
+            break;
+        }
+        for (level = 1; level < SR_TIMER_LEVELS &&
+             (w->now & (((uint64_t)1 << (SR_TIMER_BITS * level)) - 1)) == 0;
+             level++)
+        { }
+        while (--level > 0)
+        { timer_cascade(w, level); }
+
+        /* -- detach the slot: a callback may arm a timer 63 ticks out,
+              which lands in this very slot -- */
+        due = w->slot[0][w->now & TIMER_MASK];
+        w->slot[0][w->now & TIMER_MASK] = 0;
+        if (due)
+        { due->pprev = &due; }
+        w->now++;
+        while ((t = due) != 0)
+        {
+            /* -- unlink before the call, which may re-arm t -- */
+            sr_timer_del(w, t);
+            t->fn(t, t->arg);
+            fired++;
+        }
+    }
+    return fired;
+} /* -- sr_timer_run -- */
+
+/*---------------------------------------------------------------------
+ * Method: sr_timer_next(..)
+ * Scope:  Global
+ *
+ * A level 0 slot is due at its tick; a higher level slot only has to be
+ * looked at when it cascades, at the start of its span, which can come
+ * before the first busy level 0 slot.
+ *
+ *---------------------------------------------------------------------*/
+
+unsigned int sr_timer_next(const struct sr_timer_wheel* w, unsigned int limit)
+{
+    uint64_t best = limit, at;
+    unsigned int level, d, shift, pos;
+
+    if (w->pending == 0)
+    { return limit; }
+    for (d = 0; d < SR_TIMER_SLOTS && d < best; d++)
+    {
+        if (w->slot[0][(w->now + d) & TIMER_MASK])
+        {
+            best = d;
+            break;
+        }
+    }
+    for (level = 1; level < SR_TIMER_LEVELS; level++)
+    {
+        shift = SR_TIMER_BITS * level;
+        pos = (w->now >> shift) & TIMER_MASK;
+        /* -- on a span boundary the current slot cascades before the next tick runs -- */
+        for (d = (w->now & (((uint64_t)1 << shift) - 1)) ? 1 : 0;
+             d <= SR_TIMER_SLOTS; d++)
+        {
+            if (w->slot[level][(pos + d) & TIMER_MASK])
+            {
+                at = (((w->now >> shift) + d) << shift) - w->now;
+                if (at < best)
+                { best = at; }
+                break;
+            }
+        }
+    }
+    return (unsigned int)best;
+} /* -- sr_timer_next -- */
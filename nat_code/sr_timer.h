@@ -0,0 +1,72 @@
+/*-----------------------------------------------------------------------------
+ * file:  sr_timer.h
+ *
+ * Description:
+ *
+ * Hierarchical hashed timer wheel with millisecond ticks.  Level 0 has a
+ * slot per tick for the next 64 ms, each higher level a slot per 64 slots
+ * of the one below; a timer is placed by how far away it is and moves
+ * down a level when the wheel reaches its slot.  Adding and removing are
+ * O(1), and running the wheel costs one slot per elapsed tick plus the
+ * timers that are due, whatever the number of timers pending.
+ *
+ * Timers are embedded in their owner's struct.  The wheel does no
+ * locking; callers serialise on their own lock, and callbacks run with it
+ * held.  A callback may add or delete timers, itself included.
+ *
+ *---------------------------------------------------------------------------*/
+
+#ifndef SR_TIMER_H
+#define SR_TIMER_H
+
+#ifdef _LINUX_
+#include <stdint.h>
+#endif /* _LINUX_ */
+
+#ifdef _DARWIN_
+#include <inttypes.h>
+#endif /* _DARWIN_ */
+
+#define SR_TIMER_BITS   6
+#define SR_TIMER_SLOTS  (1 << SR_TIMER_BITS)
+#define SR_TIMER_LEVELS 4       /* 2^24 ms, 4.6 hours; later ones wait there */
+
+struct sr_timer
+{
+    struct sr_timer* next;
+    struct sr_timer** pprev;    /* 0 when not pending */
+    uint64_t expires;           /* tick */
+    void (*fn)(struct sr_timer* t, void* arg);
+    void* arg;
+};
+
+struct sr_timer_wheel
+{
+    uint64_t now;               /* next tick to run */
+    uint64_t t0;                /* monotonic ns at tick 0 */
+    unsigned int pending;
+    struct sr_timer* slot[SR_TIMER_LEVELS][SR_TIMER_SLOTS];
+};
+
+#define sr_timer_pending(t) ((t)->pprev != 0)
+
+void sr_timer_wheel_init(struct sr_timer_wheel* w);
+void sr_timer_init(struct sr_timer* t,
+                   void (*fn)(struct sr_timer* t, void* arg), void* arg);
+
+/* Tick of the monotonic clock now. */
+uint64_t sr_timer_clock(const struct sr_timer_wheel* w);
+
+/* (Re)arm t to run ms ticks after the wheel's current tick. */
+void sr_timer_add(struct sr_timer_wheel* w, struct sr_timer* t,
+                  unsigned int ms);
+void sr_timer_del(struct sr_timer_wheel* w, struct sr_timer* t);
+
+/* Run every timer due up to and including tick now; returns how many. */
+unsigned int sr_timer_run(struct sr_timer_wheel* w, uint64_t now);
+
+/* Ticks from the wheel's current tick until something may be due, at
+   most limit. */
+unsigned int sr_timer_next(const struct sr_timer_wheel* w, unsigned int limit);
+
+#endif /* -- SR_TIMER_H -- */
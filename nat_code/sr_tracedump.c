@@ -0,0 +1,120 @@
+/*-----------------------------------------------------------------------------
+ * file:  sr_tracedump.c
+ *
+ * Description:
+ *
+ * Decode a trace written by the router (sr -X file, see sr_log.h):
+ *
+ *   sr_tracedump trace.bin
+ *
+ * Records of all threads are merged by time and printed one per line,
+ * with microseconds since the first record and the thread that wrote it.
+ *
+ *---------------------------------------------------------------------------*/
+
+#include <stdio.h>
+#include <stdlib.h>
+#include <string.h>
+
+#include <netinet/in.h>
+#include <arpa/inet.h>
+
+#include "sr_log.h"
+
+struct dump_rec
+{
+    struct sr_trace_rec r;
+    uint32_t thread;
+};
+
+static int dump_cmp(const void* x, const void* y)
+{
+    uint64_t a = ((const struct dump_rec*)x)->r.ts;
+    uint64_t b = ((const struct dump_rec*)y)->r.ts;
+
+    return a < b ? -1 : a > b;
+} /* -- dump_cmp -- */
+
+static void dump_print(const struct dump_rec* d, uint64_t t0, uint64_t hz)
+{
+    const struct sr_trace_info* info;
+    struct in_addr in;
+
+    printf("%14.3f  t%-2u ", (double)(d->r.ts - t0) * 1e6 / hz, d->thread);
+    if (d->r.ev >= sr_trace_n_events)
+    {
+        printf("event-%u %u %u\n", d->r.ev, d->r.a, d->r.b);
+        return;
+    }
+    info = &sr_trace_events[d->r.ev];
+    printf("%-10s %s=%u", info->name, info->a, d->r.a);
+    if (info->b_is_ip)
+    {
+        in.s_addr = d->r.b;
+        printf(" %s=%s\n", info->b, inet_ntoa(in));
+    }
+    else
+    { printf(" %s=%u\n", info->b, d->r.b); }
+} /* -- dump_print -- */
+
+int main(int argc, char** argv)
+{
+    struct sr_trace_file hdr;
+    struct sr_trace_thread th;
+    struct dump_rec* recs = 0;
+    size_t n = 0, cap = 0, i;
+    uint32_t t;
+    FILE* fp;
+
+    if (argc != 2)
+    {
+        fprintf(stderr, "usage: %s <trace file>\n", argv[0]);
+        return 1;
+    }
+    if ((fp = fopen(argv[1], "r")) == 0)
+    {
+        perror(argv[1]);
+        return 1;
+    }
+    if (fread(&hdr, sizeof(hdr), 1, fp) != 1 || hdr.magic != SR_TRACE_MAGIC ||
+        hdr.hz == 0)
+    {
+        fprintf(stderr, "%s: not a router trace\n", argv[1]);
+        return 1;
+    }
+
+    for (t = 0; t < hdr.n_threads; t++)
+    {
+        if (fread(&th, sizeof(th), 1, fp) != 1)
+        { break; }
+        if (n + th.n_recs > cap)
+        {
+            cap = n + th.n_recs;
+            recs = (struct dump_rec*)realloc(recs, cap * sizeof(*recs));
+            if (recs == 0)
+            {
+                fprintf(stderr, "Error: out of memory\n");
+                return 1;
+            }
+        }
+        for (i = 0; i < th.n_recs; i++, n++)
+        {
+            if (fread(&recs[n].r, sizeof(recs[n].r), 1, fp) != 1)
+            { break; }
+            recs[n].thread = th.id;
+        }
+        if (i < th.n_recs)
+        { break; }
+    }
+    if (t < hdr.n_threads)
+    { fprintf(stderr, "%s: truncated, showing what was read\n", argv[1]); }
+    fclose(fp);
+
+    qsort(recs, n, sizeof(*recs), dump_cmp);
+    for (i = 0; i < n; i++)
+    { dump_print(&recs[i], recs[0].r.ts, hdr.hz); }
+    fprintf(stderr, "%lu records from %u threads, %.3f GHz clock\n",
+            (unsigned long)n, hdr.n_threads, hdr.hz / 1e9);
+    free(recs);
+    return 0;
+} /* -- main -- */
@@ -3,20 +3,46 @@
 #include <string.h>
 #include "sr_protocol.h"
 #include "sr_utils.h"
+#include "inet_cksum.h"
 
 
 uint16_t cksum (const void *_data, int len) {
-  const uint8_t *data = _data;
-  uint32_t sum;
-
-  for (sum = 0;len >= 2; data += 2, len -= 2)
-    sum += data[0] << 8 | data[1];
-  if (len > 0)
-    sum += data[0] << 8;
-  while (sum > 0xffff)
-    sum = (sum >> 16) + (sum & 0xffff);
-  sum = htons (~sum);
-  return sum ? sum : 0xffff;
+  return inet_cksum(_data, len);
+}
+
+/* Accumulate data into a running sum, so a checksum can cover several
+   buffers (e.g. a pseudo header and a segment) without copying them
+   together.  Every buffer but the last must have an even length.  The
+   sum is in the byte order of the checksum library and is only meaningful
+   to cksum_partial() and cksum_finish(). */
+uint32_t cksum_partial (const void *_data, int len, uint32_t sum) {
+  return inet_csum_fold(inet_csum_partial(_data, len, sum));
+}
+
+uint16_t cksum_finish (uint32_t sum) {
+  return inet_csum_finish(sum);
+}
+
+/* Incrementally update a checksum after len bytes changed from old to
+   new (RFC 1624, eqn. 3: HC' = ~(~HC + ~m + m')).  The changed bytes
+   must start on a 16 bit boundary of the checksummed data and len must
+   be even.  Words are summed as they sit in memory, so the result is in
+   network byte order like sum itself. */
+uint16_t cksum_adjust (uint16_t sum, const void *old, const void *new, int len) {
+  const uint8_t *o = old, *n = new;
+  uint32_t acc = (uint16_t)~sum;
+  uint16_t ow, nw;
+
+  for (; len >= 2; o += 2, n += 2, len -= 2) {
+    memcpy(&ow, o, 2);
+    memcpy(&nw, n, 2);
+    acc += (uint16_t)~ow;
+    acc += nw;
+  }
+  while (acc > 0xffff)
+    acc = (acc >> 16) + (acc & 0xffff);
+  acc = (uint16_t)~acc;
+  return acc ? acc : 0xffff;
 }
 
 
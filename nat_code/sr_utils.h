@@ -29,6 +29,20 @@
 #define SR_UTILS_H
 
 uint16_t cksum(const void *_data, int len);
+uint32_t cksum_partial(const void *_data, int len, uint32_t sum);
+uint16_t cksum_finish(uint32_t sum);
+uint16_t cksum_adjust(uint16_t sum, const void *old, const void *new, int len);
+
+/* With -DSR_CKSUM_DEBUG every incremental update is checked against a
+   full recompute.  'full' is evaluated with the checksum field zeroed. */
+#ifdef SR_CKSUM_DEBUG
+#include <assert.h>
+#define CKSUM_DEBUG_CHECK(field, full) \
+  do { uint16_t cdc_incr = (field); (field) = 0; \
+       assert(cdc_incr == (full)); (field) = cdc_incr; } while (0)
+#else
+#define CKSUM_DEBUG_CHECK(field, full) do{}while(0)
+#endif
 
 uint16_t ethertype(uint8_t *buf);
 uint8_t ip_protocol(uint8_t *buf);
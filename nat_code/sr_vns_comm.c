@@ -31,7 +31,10 @@
 #include <netdb.h>
 #include <errno.h>
 
+#include <pthread.h>
+
 #include <sys/socket.h>
+#include <sys/uio.h>
 #include <netinet/in.h>
 #include <arpa/inet.h>
 #include <sys/time.h>
@@ -40,17 +43,60 @@
 #include "sr_router.h"
 #include "sr_if.h"
 #include "sr_protocol.h"
+#include "sr_fib.h"
+#include "sr_worker.h"
+#include "sr_rt.h"
+#include "sr_io.h"
+#include "sr_pcaplog.h"
+#include "sr_epoch.h"
 
 #include "sha1.h"
 #include "vnscommand.h"
 
-static void sr_log_packet(struct sr_instance* , uint8_t* , int );
-static int  sr_arp_req_not_for_us(struct sr_instance* sr,
-                                  uint8_t * packet /* lent */,
-                                  unsigned int len,
-                                  char* interface  /* lent */);
 int sr_read_from_server_expect(struct sr_instance* sr /* borrowed */, int expected_cmd);
 
+#define SR_TXQ_BYTES 65536   /* coalescing buffer, several full frames */
+#define SR_RXBUF_BYTES 262144 /* receive buffer, many commands */
+
+/* ----------------------------------------------------------------------------
+ * struct sr_rxbuf
+ *
+ * Bytes read from the server; [head, tail) has not been parsed yet.
+ *
+ * -------------------------------------------------------------------------- */
+
+struct sr_rxbuf
+{
+    unsigned int head;
+    unsigned int tail;
+    uint8_t buf[SR_RXBUF_BYTES];
+};
+
+/* ----------------------------------------------------------------------------
+ * struct sr_txq
+ *
+ * Outgoing VNS messages staged by sr_send_packet, either router wide in
+ * coalescing mode (sr->txq) or per forwarding worker thread.  The
+ * caller's frame is borrowed, so header and frame are copied in and the
+ * whole batch goes out with one write.
+ *
+ * -------------------------------------------------------------------------- */
+
+struct sr_txq
+{
+    pthread_mutex_t lock;
+    pthread_t flusher;
+    unsigned int usec;          /* flusher period */
+    pthread_cond_t kick;        /* first message staged, or stop */
+    int waiting;                /* flusher sleeps on kick */
+    int stop;
+    unsigned int used;
+    uint8_t buf[SR_TXQ_BYTES];
+};
+
+/* queue of the calling worker thread, see sr_send_thread_queue() */
+static __thread struct sr_txq* sr_thread_txq;
+
 /*-----------------------------------------------------------------------------
  * Method: sr_session_closed_help(..)
  *
@@ -226,6 +272,8 @@ int sr_handle_hwinfo(struct sr_instance* sr, c_hwinfo* hwinfo)
         } /* -- switch -- */
     } /* -- for -- */
 
+    sr_index_interfaces(sr);
+
     printf("Router interfaces:\n");
     sr_print_if_list(sr);
 
@@ -328,87 +376,95 @@ int sr_handle_auth_status(struct sr_instance* sr, c_auth_status* status) {
 
 int sr_read_from_server(struct sr_instance* sr /* borrowed */)
 {
+    if ( sr->io )
+    { return sr_io_poll(sr); }
     return sr_read_from_server_expect(sr, 0);
 }
 
-int sr_read_from_server_expect(struct sr_instance* sr /* borrowed */, int expected_cmd)
+/*-----------------------------------------------------------------------------
+ * Method: sr_rx_fill(..)
+ * Scope: Local
+ *
+ * Block until more bytes arrive from the server and append as many as fit.
+ * Unparsed bytes are first moved to the front so a whole command always
+ * fits.  Returns the number of bytes read, 0 on EOF and -1 on error.
+ *
+ *---------------------------------------------------------------------------*/
+
+static int sr_rx_fill(struct sr_instance* sr, struct sr_rxbuf* rx)
 {
-    int command, len;
-    unsigned char *buf = 0;
-    c_packet_ethernet_header* sr_pkt = 0;
-    int ret = 0, bytes_read = 0;
+    int ret;
 
-    /* REQUIRES */
-    assert(sr);
+    if ( rx->head > 0 )
+    {
+        memmove(rx->buf, rx->buf + rx->head, rx->tail - rx->head);
+        rx->tail -= rx->head;
+        rx->head = 0;
+    }
 
-    /*---------------------------------------------------------------------------
-      Read a command from the server
-      -------------------------------------------------------------------------*/
+    do
+    { /* -- just in case SIGALRM breaks recv -- */
+        ret = recv(sr->sockfd, rx->buf + rx->tail, SR_RXBUF_BYTES - rx->tail, 0);
+    } while ( ret == -1 && errno == EINTR ); /* be mindful of signals */
 
-    bytes_read = 0;
+    if ( ret == -1 )
+    { perror("recv(..):sr_client.c::sr_read_from_server"); }
+    else
+    { rx->tail += ret; }
+    return ret;
+} /* -- sr_rx_fill -- */
 
-    /* attempt to read the size of the incoming packet */
-    while( bytes_read < 4)
-    {
-        do
-        { /* -- just in case SIGALRM breaks recv -- */
-            errno = 0; /* -- hacky glibc workaround -- */
-            if((ret = recv(sr->sockfd,((uint8_t*)&len) + bytes_read,
-                            4 - bytes_read, 0)) == -1)
-            {
-                if ( errno == EINTR )
-                { continue; }
+/*-----------------------------------------------------------------------------
+ * Method: sr_rx_next(..)
+ * Scope: Local
+ *
+ * Length of the complete command at the head of the buffer, 0 if it has
+ * not fully arrived yet and -1 if the length field is bogus.
+ *
+ *---------------------------------------------------------------------------*/
 
-                perror("recv(..):sr_client.c::sr_read_from_server");
-                return -1;
-            }
-            bytes_read += ret;
-        } while ( errno == EINTR); /* be mindful of signals */
+static int sr_rx_next(struct sr_rxbuf* rx)
+{
+    uint32_t len;
 
-    }
+    if ( rx->tail - rx->head < 4 )
+    { return 0; }
 
+    memcpy(&len, rx->buf + rx->head, 4);
     len = ntohl(len);
 
-    if ( len > 10000 || len < 0 )
+    if ( len > 10000 || len < 8 )
     {
         fprintf(stderr,"Error: command length to large %d\n",len);
-        close(sr->sockfd);
-        return -1;
-    }
-
-    if((buf = malloc(len)) == 0)
-    {
-        fprintf(stderr,"Error: out of memory (sr_read_from_server)\n");
         return -1;
     }
+    return ( rx->tail - rx->head >= len ) ? (int)len : 0;
+} /* -- sr_rx_next -- */
 
-    /* set first field of command since we've already read it */
-    *((int *)buf) = htonl(len);
-
-    bytes_read = 0;
+/*-----------------------------------------------------------------------------
+ * Method: sr_handle_command(..)
+ * Scope: Local
+ *
+ * Act on one complete command from the server.  buf points into the
+ * receive buffer and may be modified in place.  Frames are collected in
+ * burst and handed to the router SR_BURST_MAX at a time, or before any
+ * other command so ordering is kept.  Returns 1 to keep going, 0 if the
+ * server closed the session and -1 on error.
+ *
+ *---------------------------------------------------------------------------*/
 
-    /* read the rest of the command */
-    while ( bytes_read < len - 4)
-    {
-        do
-        {/* -- just in case SIGALRM breaks recv -- */
-            errno = 0; /* -- hacky glibc workaround -- */
-            if ((ret = read(sr->sockfd, buf+4+bytes_read, len - 4 - bytes_read)) ==
-                    -1)
-            {
-                if ( errno == EINTR )
-                { continue; }
-                fprintf(stderr,"Error: failed reading command body %d\n",ret);
-                close(sr->sockfd);
-                return -1;
-            }
-            bytes_read += ret;
-        } while (errno == EINTR); /* be mindful of signals */
-    }
+static int sr_handle_command(struct sr_instance* sr, uint8_t* buf, int len,
+                             int expected_cmd, struct sr_frame* burst,
+                             unsigned int* n_burst)
+{
+    int command, ret;
+    uint32_t field;
+    c_packet_ethernet_header* sr_pkt = 0;
+    struct sr_if* iface = 0;
 
-    /* My entry for most unreadable line of code - guido */
-    /* ... you win - mc                                  */
-    command = *(((int *)buf)+1) = ntohl(*(((int *)buf)+1));
+    memcpy(&field, buf + 4, 4);
+    command = ntohl(field);
+    memcpy(buf + 4, &command, 4); /* handlers expect it in host order */
 
     /* make sure the command is what we expected if we were expecting something */
     if(expected_cmd && command!=expected_cmd) {
@@ -418,6 +474,12 @@ int sr_read_from_server_expect(struct sr_instance* sr /* borrowed */, int expect
         }
     }
 
+    if ( command != VNSPACKET && *n_burst > 0 )
+    {
+        sr_input_burst(sr, burst, *n_burst);
+        *n_burst = 0;
+    }
+
     ret = 1;
     switch (command)
     {
@@ -426,24 +488,38 @@ int sr_read_from_server_expect(struct sr_instance* sr /* borrowed */, int expect
         case VNSPACKET:
             sr_pkt = (c_packet_ethernet_header *)buf;
 
+            /* -- resolve the receiving interface once per frame -- */
+            sr_pkt->mInterfaceName[sizeof(sr_pkt->mInterfaceName) - 1] = '\0';
+            iface = sr_get_interface(sr, sr_pkt->mInterfaceName);
+            if ( iface == 0 )
+            {
+                fprintf(stderr, "** Error, interface %s, does not exist\n",
+                        sr_pkt->mInterfaceName);
+                break;
+            }
+
             /* -- check if it is an ARP to another router if so drop   -- */
             if ( sr_arp_req_not_for_us(sr,
                     (buf+sizeof(c_packet_header)),
                     len - sizeof(c_packet_ethernet_header) +
                     sizeof(struct sr_ethernet_hdr),
-                    (char*)(buf + sizeof(c_base))) )
+                    iface) )
             { break; }
 
             /* -- log packet -- */
             sr_log_packet(sr, buf + sizeof(c_packet_header),
                     ntohl(sr_pkt->mLen) - sizeof(c_packet_header));
 
-            /* -- pass to router, student's code should take over here -- */
-            sr_handlepacket(sr,
-                    (buf+sizeof(c_packet_header)),
-                    len - sizeof(c_packet_ethernet_header) +
-                    sizeof(struct sr_ethernet_hdr),
-                    (char*)(buf + sizeof(c_base)));
+            /* -- queue for the router, student's code should take over here -- */
+            burst[*n_burst].buf = buf + sizeof(c_packet_header);
+            burst[*n_burst].len = len - sizeof(c_packet_ethernet_header) +
+                                  sizeof(struct sr_ethernet_hdr);
+            burst[*n_burst].iface = iface;
+            if ( ++*n_burst == SR_BURST_MAX )
+            {
+                sr_input_burst(sr, burst, *n_burst);
+                *n_burst = 0;
+            }
 
             break;
 
@@ -454,8 +530,6 @@ int sr_read_from_server_expect(struct sr_instance* sr /* borrowed */, int expect
             fprintf(stderr,"Reason: %s\n",((c_close*)buf)->mErrorMessage);
             sr_session_closed_help();
 
-            if(buf)
-            { free(buf); }
             return 0;
             break;
 
@@ -474,6 +548,10 @@ int sr_read_from_server_expect(struct sr_instance* sr /* borrowed */, int expect
                 fprintf(stderr,"Routing table not consistent with hardware\n");
                 return -1;
             }
+            /* -- resolve the loaded FIB against the real interfaces -- */
+            pthread_mutex_lock(&sr->rt_lock);
+            sr_fib_reattach(sr);
+            pthread_mutex_unlock(&sr->rt_lock);
             printf(" <-- Ready to process packets --> \n");
             break;
 
@@ -501,8 +579,84 @@ int sr_read_from_server_expect(struct sr_instance* sr /* borrowed */, int expect
 
     }/* -- switch -- */
 
-    if(buf)
-    { free(buf); }
+    return ret;
+} /* -- sr_handle_command -- */
+
+/*-----------------------------------------------------------------------------
+ * Method: sr_read_from_server_expect(..)
+ * Scope: global
+ *
+ * Read whatever the server has sent into a reusable buffer and handle
+ * every complete command in it, then flush any output they generated.
+ * When expected_cmd is set exactly one command is handled and anything
+ * behind it is left for the next call.
+ *
+ *---------------------------------------------------------------------------*/
+
+int sr_read_from_server_expect(struct sr_instance* sr /* borrowed */, int expected_cmd)
+{
+    struct sr_rxbuf* rx;
+    struct sr_frame burst[SR_BURST_MAX];
+    unsigned int n_burst = 0;
+    int len, ret = 1, handled = 0;
+
+    /* REQUIRES */
+    assert(sr);
+
+    if ( (rx = sr->rx) == 0 )
+    {
+        if ( (rx = (struct sr_rxbuf*)malloc(sizeof(struct sr_rxbuf))) == 0 )
+        {
+            fprintf(stderr,"Error: out of memory (sr_read_from_server)\n");
+            return -1;
+        }
+        rx->head = rx->tail = 0;
+        sr->rx = rx;
+    }
+
+    while ( ret == 1 )
+    {
+        if ( (len = sr_rx_next(rx)) < 0 )
+        {
+            close(sr->sockfd);
+            return -1;
+        }
+
+        if ( len == 0 )
+        {
+            if ( handled )
+            { break; }
+
+            /*---------------------------------------------------------------
+              Wait for more from the server
+              -------------------------------------------------------------*/
+            if ( (ret = sr_rx_fill(sr, rx)) <= 0 )
+            {
+                if ( ret == 0 )
+                { fprintf(stderr,"Error: server closed connection\n"); }
+                close(sr->sockfd);
+                return -1;
+            }
+            ret = 1;
+            continue;
+        }
+
+        ret = sr_handle_command(sr, rx->buf + rx->head, len, expected_cmd,
+                                burst, &n_burst);
+        rx->head += len;
+        handled++;
+
+        if ( expected_cmd )
+        { break; }
+    }
+
+    /* -- frames still pointing into rx must be handled before the next fill -- */
+    if ( n_burst > 0 )
+    { sr_input_burst(sr, burst, n_burst); }
+
+    /* -- push out whatever the batch generated -- */
+    sr_send_flush(sr);
+
     return ret;
 }/* -- sr_read_from_server -- */
 
@@ -550,6 +704,257 @@ sr_ether_addrs_match_interface( struct sr_instance* sr, /* borrowed */
 
 } /* -- sr_ether_addrs_match_interface -- */
 
+/*-----------------------------------------------------------------------------
+ * Method: sr_write_all(..)
+ * Scope: Local
+ *
+ * write(2) the whole buffer, retrying on short writes and signals.
+ *
+ *---------------------------------------------------------------------------*/
+
+static int sr_write_all(int fd, const uint8_t* buf, unsigned int len)
+{
+    ssize_t ret;
+
+    while ( len > 0 )
+    {
+        if ( (ret = write(fd, buf, len)) == -1 )
+        {
+            if ( errno == EINTR )
+            { continue; }
+            return -1;
+        }
+        buf += ret;
+        len -= ret;
+    }
+    return 0;
+} /* -- sr_write_all -- */
+
+/*-----------------------------------------------------------------------------
+ * Method: sr_txq_write(..)
+ * Scope: Local
+ *
+ * Write out and empty a staging queue; the caller holds txq->lock.  All
+ * writers to the socket serialize on sr->tx_lock so messages from
+ * different threads never interleave.
+ *
+ *---------------------------------------------------------------------------*/
+
+static int sr_txq_write(struct sr_instance* sr, struct sr_txq* txq)
+{
+    int ret = 0;
+
+    if ( txq->used > 0 )
+    {
+        pthread_mutex_lock(&sr->tx_lock);
+        if ( sr_write_all(sr->sockfd, txq->buf, txq->used) != 0 )
+        {
+            perror("write(..):sr_txq_write");
+            ret = -1;
+        }
+        pthread_mutex_unlock(&sr->tx_lock);
+        txq->used = 0;
+    }
+    return ret;
+} /* -- sr_txq_write -- */
+
+struct sr_txq* sr_txq_create(void)
+{
+    struct sr_txq* txq;
+
+    if ( (txq = (struct sr_txq*)malloc(sizeof(struct sr_txq))) == 0 )
+    {
+        fprintf(stderr,"Error: out of memory (sr_txq_create)\n");
+        return 0;
+    }
+    pthread_mutex_init(&txq->lock, 0);
+    pthread_cond_init(&txq->kick, 0);
+    txq->usec = 0;
+    txq->waiting = 0;
+    txq->stop = 0;
+    txq->used = 0;
+    return txq;
+} /* -- sr_txq_create -- */
+
+void sr_txq_destroy(struct sr_txq* txq)
+{
+    if ( txq )
+    {
+        pthread_cond_destroy(&txq->kick);
+        pthread_mutex_destroy(&txq->lock);
+        free(txq);
+    }
+} /* -- sr_txq_destroy -- */
+
+/*-----------------------------------------------------------------------------
+ * Method: sr_send_thread_queue(..)
+ * Scope: Global
+ *
+ * Make sr_send_packet on the calling thread stage into txq (0 to undo).
+ * The thread must call sr_send_flush to push the messages out.
+ *
+ *---------------------------------------------------------------------------*/
+
+void sr_send_thread_queue(struct sr_txq* txq)
+{
+    sr_thread_txq = txq;
+} /* -- sr_send_thread_queue -- */
+
+/*-----------------------------------------------------------------------------
+ * Method: sr_send_flush(..)
+ * Scope: Global
+ *
+ * Write out the messages staged by this thread, or router wide in
+ * coalescing mode.  Called at the end of each receive or burst and by the
+ * flusher thread; a no-op when nothing is staged.
+ *
+ *---------------------------------------------------------------------------*/
+
+int sr_send_flush(struct sr_instance* sr /* borrowed */)
+{
+    struct sr_txq* txq;
+    int ret;
+
+    /* REQUIRES */
+    assert(sr);
+
+    if ( sr->io )
+    {
+        sr_io_flush(sr);
+        return 0;
+    }
+    /* -- sr->txq is retired at shutdown, see sr_send_coalesce_stop -- */
+    sr_epoch_enter();
+    if ( (txq = sr_thread_txq) == 0 &&
+         (txq = *(struct sr_txq* volatile*)&sr->txq) == 0 )
+    {
+        sr_epoch_exit();
+        return 0;
+    }
+
+    pthread_mutex_lock(&txq->lock);
+    ret = sr_txq_write(sr, txq);
+    pthread_mutex_unlock(&txq->lock);
+    sr_epoch_exit();
+
+    return ret;
+} /* -- sr_send_flush -- */
+
+/*-----------------------------------------------------------------------------
+ * Method: sr_send_flusher(..)
+ * Scope: Local
+ *
+ * Sleeps until the first message is staged, gives the batch 'usec' to
+ * grow and writes it.  Messages staged after stop are dropped; the
+ * connection is gone by then.
+ *
+ *---------------------------------------------------------------------------*/
+
+struct sr_flusher_arg
+{
+    struct sr_instance* sr;
+    struct sr_txq* txq;
+};
+
+static void* sr_send_flusher(void* arg_ptr)
+{
+    struct sr_flusher_arg arg = *(struct sr_flusher_arg*)arg_ptr;
+    struct sr_txq* txq = arg.txq;
+
+    free(arg_ptr);
+    pthread_mutex_lock(&txq->lock);
+    while ( !txq->stop )
+    {
+        if ( txq->used == 0 )
+        {
+            txq->waiting = 1;
+            pthread_cond_wait(&txq->kick, &txq->lock);
+            txq->waiting = 0;
+            continue;
+        }
+        pthread_mutex_unlock(&txq->lock);
+        usleep(txq->usec);
+        pthread_mutex_lock(&txq->lock);
+        if ( !txq->stop )
+        { sr_txq_write(arg.sr, txq); }
+    }
+    pthread_mutex_unlock(&txq->lock);
+    return 0;
+} /* -- sr_send_flusher -- */
+
+/*-----------------------------------------------------------------------------
+ * Method: sr_send_coalesce(..)
+ * Scope: Global
+ *
+ * Turn on coalescing: sr_send_packet stages messages and they are written
+ * in batches, at the end of every receive and within 'usec' microseconds
+ * for packets sent from the timer threads.
+ *
+ *---------------------------------------------------------------------------*/
+
+int sr_send_coalesce(struct sr_instance* sr /* borrowed */, unsigned int usec)
+{
+    struct sr_txq* txq;
+    struct sr_flusher_arg* arg;
+
+    /* REQUIRES */
+    assert(sr);
+    assert(sr->txq == 0);
+
+    if ( (txq = sr_txq_create()) == 0 )
+    { return -1; }
+    txq->usec = usec ? usec : 1;
+
+    arg = (struct sr_flusher_arg*)malloc(sizeof(struct sr_flusher_arg));
+    assert(arg);
+    arg->sr = sr;
+    arg->txq = txq;
+    if ( pthread_create(&txq->flusher, 0, sr_send_flusher, arg) != 0 )
+    {
+        perror("pthread_create(..):sr_send_coalesce");
+        free(arg);
+        sr_txq_destroy(txq);
+        return -1;
+    }
+    sr->txq = txq;
+
+    return 0;
+} /* -- sr_send_coalesce -- */
+
+static void txq_free(void* txq)
+{
+    sr_txq_destroy((struct sr_txq*)txq);
+} /* -- txq_free -- */
+
+/*-----------------------------------------------------------------------------
+ * Method: sr_send_coalesce_stop(..)
+ * Scope: Global
+ *
+ * Stop and join the flusher at shutdown.  Later sends write directly;
+ * the queue is retired, so a sender still staging into it is not cut
+ * off, but what it stages is not written.
+ *
+ *---------------------------------------------------------------------------*/
+
+void sr_send_coalesce_stop(struct sr_instance* sr /* borrowed */)
+{
+    struct sr_txq* txq;
+
+    /* REQUIRES */
+    assert(sr);
+
+    if ( (txq = __sync_lock_test_and_set(&sr->txq, 0)) == 0 )
+    { return; }
+
+    pthread_mutex_lock(&txq->lock);
+    txq->stop = 1;
+    pthread_cond_signal(&txq->kick);
+    pthread_mutex_unlock(&txq->lock);
+    pthread_join(txq->flusher, 0);
+
+    sr_epoch_retire(txq, txq_free);
+} /* -- sr_send_coalesce_stop -- */
+
 /*-----------------------------------------------------------------------------
  * Method: sr_send_packet(..)
  * Scope: Global
@@ -557,6 +962,10 @@ sr_ether_addrs_match_interface( struct sr_instance* sr, /* borrowed */
  * Send a packet (ethernet header included!) of length 'len' to the server
  * to be injected onto the wire.
  *
+ * The VNS header is built on the stack and sent together with the frame
+ * by writev(), or staged for a batched write in coalescing mode or on a
+ * worker thread.
+ *
  *---------------------------------------------------------------------------*/
 
 int sr_send_packet(struct sr_instance* sr /* borrowed */,
@@ -564,8 +973,11 @@ int sr_send_packet(struct sr_instance* sr /* borrowed */,
                          unsigned int len,
                          const char* iface /* borrowed */)
 {
-    c_packet_header *sr_pkt;
+    c_packet_header sr_pkt;
+    struct iovec iov[2];
+    struct sr_txq* txq;
     unsigned int total_len =  len + (sizeof(c_packet_header));
+    int ret = 0;
 
     /* REQUIRES */
     assert(sr);
@@ -578,75 +990,93 @@ int sr_send_packet(struct sr_instance* sr /* borrowed */,
         return -1;
     }
 
-    /* Create packet */
-    sr_pkt = (c_packet_header *)malloc(len +
-            sizeof(c_packet_header));
-    assert(sr_pkt);
-    sr_pkt->mLen  = htonl(total_len);
-    sr_pkt->mType = htonl(VNSPACKET);
-    strncpy(sr_pkt->mInterfaceName,iface,16);
-    memcpy(((uint8_t*)sr_pkt) + sizeof(c_packet_header),
-            buf,len);
+    /* Create header */
+    sr_pkt.mLen  = htonl(total_len);
+    sr_pkt.mType = htonl(VNSPACKET);
+    strncpy(sr_pkt.mInterfaceName,iface,16);
 
     /* -- log packet -- */
     sr_log_packet(sr,buf,len);
 
     if ( ! sr_ether_addrs_match_interface( sr, buf, iface) ){
         fprintf( stderr, "*** Error: problem with ethernet header, check log\n");
-        free ( sr_pkt );
         return -1;
     }
 
-    if( write(sr->sockfd, sr_pkt, total_len) < total_len ){
-        fprintf(stderr, "Error writing packet\n");
-        free(sr_pkt);
-        return -1;
+    /* -- local devices, kicked at the end of the burst on workers -- */
+    if ( sr->io )
+    { return sr_io_send(sr, buf, len, iface, sr_thread_txq != 0); }
+
+    /* -- sr->txq is retired at shutdown, see sr_send_coalesce_stop -- */
+    sr_epoch_enter();
+    if ( (txq = sr_thread_txq) == 0 )
+    { txq = *(struct sr_txq* volatile*)&sr->txq; }
+
+    if ( txq != 0 && total_len <= SR_TXQ_BYTES )
+    {
+        pthread_mutex_lock(&txq->lock);
+        if ( txq->used + total_len > SR_TXQ_BYTES )
+        { ret = sr_txq_write(sr, txq); }
+        memcpy(txq->buf + txq->used, &sr_pkt, sizeof(c_packet_header));
+        memcpy(txq->buf + txq->used + sizeof(c_packet_header), buf, len);
+        txq->used += total_len;
+        if ( txq->waiting )
+        { pthread_cond_signal(&txq->kick); }
+        pthread_mutex_unlock(&txq->lock);
+        sr_epoch_exit();
+        return ret;
     }
+    sr_epoch_exit();
 
-    free(sr_pkt);
+    iov[0].iov_base = &sr_pkt;
+    iov[0].iov_len  = sizeof(c_packet_header);
+    iov[1].iov_base = buf;
+    iov[1].iov_len  = len;
 
-    return 0;
+    pthread_mutex_lock(&sr->tx_lock);
+    if( writev(sr->sockfd, iov, 2) < (ssize_t)total_len ){
+        fprintf(stderr, "Error writing packet\n");
+        ret = -1;
+    }
+    pthread_mutex_unlock(&sr->tx_lock);
+
+    return ret;
 } /* -- sr_send_packet -- */
 
 /*-----------------------------------------------------------------------------
  * Method: sr_log_packet()
- * Scope: Local
+ * Scope: Global
  *
  *---------------------------------------------------------------------------*/
 
 void sr_log_packet(struct sr_instance* sr, uint8_t* buf, int len )
 {
-    struct pcap_pkthdr h;
-    int size;
+    struct sr_pcaplog* log;
 
     /* REQUIRES */
     assert(sr);
 
-    if(!sr->logfile)
-    {return; }
-
-    size = min(PACKET_DUMP_SIZE, len);
+    /* -- the log is retired at shutdown, not closed under us -- */
+    sr_epoch_enter();
+    log = *(struct sr_pcaplog* volatile*)&sr->logfile;
 
-    gettimeofday(&h.ts, 0);
-    h.caplen = size;
-    h.len = (size < PACKET_DUMP_SIZE) ? size : PACKET_DUMP_SIZE;
-
-    sr_dump(sr->logfile, &h, buf);
-    fflush(sr->logfile);
+    /* -- filtered and sampled before the copy into the log ring -- */
+    if(log && sr_pcaplog_want(log, buf, len))
+    { sr_pcaplog_put(log, buf, len); }
+    sr_epoch_exit();
 } /* -- sr_log_packet -- */
 
 /*-----------------------------------------------------------------------------
  * Method: sr_arp_req_not_for_us()
- * Scope: Local
+ * Scope: Global
  *
  *---------------------------------------------------------------------------*/
 
 int  sr_arp_req_not_for_us(struct sr_instance* sr,
                            uint8_t * packet /* lent */,
                            unsigned int len,
-                           char* interface  /* lent */)
+                           struct sr_if* iface  /* lent */)
 {
-    struct sr_if* iface = sr_get_interface(sr, interface);
     struct sr_ethernet_hdr* e_hdr = 0;
     struct sr_arp_hdr*       a_hdr = 0;
 
@@ -0,0 +1,932 @@
+/*-----------------------------------------------------------------------------
+ * file:  sr_vnsd.c
+ *
+ * Description:
+ *
+ * Local stand-in for the VNS server, for end-to-end load tests of sr
+ * without the Stanford service:
+ *
+ *   sr_vnsd -R 100000 -n 1000000 -x "./sr -s 127.0.0.1"
+ *
+ * It speaks the vnscommand.h protocol (authentication against auth_key,
+ * VNSOPEN or VNS_OPEN_TEMPLATE with VNS_RTABLE, VNSHWINFO, VNSPACKET) and
+ * plays every host around the router: ARP requests are answered for any
+ * address.  The router's interfaces come from IP_CONFIG ("sw0-eth1 ip");
+ * interfaces the rtable uses but IP_CONFIG lacks get addresses of their
+ * own.  The other IP_CONFIG entries are the traffic destinations, or the
+ * routes themselves if there are none.
+ *
+ * Traffic enters on one interface (by default the one the default route
+ * leaves through) as UDP flows from 198.18.0.0/15, or as IPv4 frames
+ * replayed from a pcap file, at a fixed rate or as fast as the router
+ * takes them.  The IP id of each frame carries a sequence number; frames
+ * that come back out of the router are matched on it for the forwarded
+ * rate, drop rate and latency.
+ *
+ *---------------------------------------------------------------------------*/
+
+#include <stdio.h>
+#include <stdlib.h>
+#include <assert.h>
+#include <string.h>
+#include <unistd.h>
+#include <errno.h>
+#include <signal.h>
+#include <time.h>
+#include <pthread.h>
+
+#include <sys/types.h>
+#include <sys/socket.h>
+#include <sys/wait.h>
+#include <netinet/in.h>
+#include <netinet/tcp.h>
+#include <arpa/inet.h>
+
+#include "sr_protocol.h"
+#include "sr_rt.h"
+#include "sr_fib.h"
+#include "sr_utils.h"
+#include "sr_dumper.h"
+#include "sha1.h"
+#include "vnscommand.h"
+
+#define VNSD_PORT       8888
+#define VNSD_IF_MAX     16
+#define VNSD_FLOWS      64
+#define VNSD_FRAME      60          /* minimum Ethernet frame, no FCS */
+#define VNSD_BATCH      256         /* frames per write */
+#define VNSD_WINDOW     8192        /* frames in flight, well under 2^16 ids */
+#define VNSD_STALL_NS   50000000ull /* no progress this long: write off */
+#define VNSD_HIST_US    100000      /* latency histogram, 1 us buckets */
+#define VNSD_AUTH_KEY   64
+#define VNSD_SALT       16
+#define VNSD_SHA1_LEN   20
+
+struct vnsd_if
+{
+    char name[sr_IFACE_NAMELEN];
+    uint8_t mac[ETHER_ADDR_LEN];
+    uint32_t ip;                    /* network order */
+    unsigned long rx;               /* frames forwarded out of it */
+};
+
+struct vnsd_frame
+{
+    uint8_t* buf;
+    unsigned int len;
+};
+
+struct vnsd
+{
+    int fd;
+    pthread_mutex_t tx_lock;
+    struct vnsd_if ifs[VNSD_IF_MAX];
+    unsigned int n_ifs;
+    struct vnsd_if* in;             /* ingress */
+    struct vnsd_frame* frames;      /* injected round robin */
+    unsigned int n_frames;
+    /* -- receive side -- */
+    volatile uint64_t sent_ns[65536];   /* by IP id, 0 when not in flight */
+    volatile unsigned long fwd;
+    volatile unsigned long other;
+    volatile unsigned long arps;
+    volatile int closed;
+    unsigned long hist[VNSD_HIST_US + 1];
+    uint64_t lat_sum;
+    uint64_t lat_min;
+    uint64_t lat_max;
+    volatile int measure;
+};
+
+static struct vnsd vnsd;
+
+static uint64_t now_ns(void)
+{
+    struct timespec ts;
+
+    clock_gettime(CLOCK_MONOTONIC, &ts);
+    return (uint64_t)ts.tv_sec * 1000000000ull + ts.tv_nsec;
+} /* -- now_ns -- */
+
+/* The host at ip, as far as the router can tell. */
+static void vnsd_host_mac(uint32_t ip, uint8_t* mac)
+{
+    mac[0] = 0x02;
+    mac[1] = 0x56;
+    memcpy(mac + 2, &ip, 4);
+} /* -- vnsd_host_mac -- */
+
+static int vnsd_write(const void* buf, size_t len)
+{
+    const uint8_t* p = (const uint8_t*)buf;
+    ssize_t n;
+
+    while (len > 0)
+    {
+        if ((n = send(vnsd.fd, p, len, MSG_NOSIGNAL)) < 0)
+        {
+            if (errno == EINTR)
+            { continue; }
+            return -1;
+        }
+        p += n;
+        len -= n;
+    }
+    return 0;
+} /* -- vnsd_write -- */
+
+static int vnsd_read(void* buf, size_t len)
+{
+    uint8_t* p = (uint8_t*)buf;
+    ssize_t n;
+
+    while (len > 0)
+    {
+        if ((n = recv(vnsd.fd, p, len, 0)) <= 0)
+        {
+            if (n < 0 && errno == EINTR)
+            { continue; }
+            return -1;
+        }
+        p += n;
+        len -= n;
+    }
+    return 0;
+} /* -- vnsd_read -- */
+
+/* Read one message into buf (at most size bytes); returns its type. */
+static int vnsd_read_msg(uint8_t* buf, uint32_t size, uint32_t* len)
+{
+    c_base* b = (c_base*)buf;
+
+    if (vnsd_read(buf, sizeof(c_base)) != 0)
+    { return -1; }
+    *len = ntohl(b->mLen);
+    if (*len < sizeof(c_base) || *len > size)
+    {
+        fprintf(stderr, "sr_vnsd: bad message length %u\n", *len);
+        return -1;
+    }
+    if (vnsd_read(buf + sizeof(c_base), *len - sizeof(c_base)) != 0)
+    { return -1; }
+    return ntohl(b->mType);
+} /* -- vnsd_read_msg -- */
+
+/*---------------------------------------------------------------------
+ * Method: vnsd_topology(..)
+ * Scope:  Local
+ *
+ * Router interfaces from IP_CONFIG and the rtable, destinations from the
+ * remaining IP_CONFIG hosts.  Returns the number of destinations.
+ *
+ *---------------------------------------------------------------------*/
+
+static unsigned int vnsd_topology(const char* ip_config, struct sr_rt* routes,
+                                  uint32_t* dests, unsigned int max_dests)
+{
+    FILE* fp;
+    char line[BUFSIZ], name[64], ip[32];
+    struct in_addr addr;
+    struct sr_rt* rt;
+    unsigned int i, n_dests = 0;
+
+    if ((fp = fopen(ip_config, "r")) != 0)
+    {
+        while (fgets(line, sizeof(line), fp))
+        {
+            if (sscanf(line, "%63s %31s", name, ip) != 2 ||
+                inet_aton(ip, &addr) == 0)
+            { continue; }
+            if (strncmp(name, "sw0-", 4) == 0 && vnsd.n_ifs < VNSD_IF_MAX)
+            {
+                strncpy(vnsd.ifs[vnsd.n_ifs].name, name + 4,
+                        sr_IFACE_NAMELEN - 1);
+                vnsd.ifs[vnsd.n_ifs++].ip = addr.s_addr;
+            }
+            else if (n_dests < max_dests)
+            { dests[n_dests++] = addr.s_addr; }
+        }
+        fclose(fp);
+    }
+    else
+    { perror("fopen(..):IP_CONFIG"); }
+
+    for (rt = routes; rt; rt = rt->next)
+    {
+        for (i = 0; i < vnsd.n_ifs; i++)
+        {
+            if (!strcmp(vnsd.ifs[i].name, rt->interface))
+            { break; }
+        }
+        if (i == vnsd.n_ifs && vnsd.n_ifs < VNSD_IF_MAX)
+        {
+            strncpy(vnsd.ifs[i].name, rt->interface, sr_IFACE_NAMELEN - 1);
+            vnsd.ifs[i].ip = htonl(0x0afe0001 | (i << 8));  /* 10.254.i.1 */
+            vnsd.n_ifs++;
+        }
+    }
+
+    for (i = 0; i < vnsd.n_ifs; i++)
+    {
+        vnsd.ifs[i].mac[0] = 0x02;
+        vnsd.ifs[i].mac[5] = (uint8_t)(i + 1);
+    }
+    return n_dests;
+} /* -- vnsd_topology -- */
+
+/*---------------------------------------------------------------------
+ * Method: vnsd_flows(..)
+ * Scope:  Local
+ *
+ * One UDP frame per flow, towards destinations not behind the ingress.
+ *
+ *---------------------------------------------------------------------*/
+
+static int vnsd_flows(const struct sr_fib* fib, struct sr_rt* routes,
+                      uint32_t* dests, unsigned int n_dests,
+                      unsigned int n_flows, unsigned int size)
+{
+    const struct sr_fib_nh* nh;
+    struct sr_rt* rt;
+    sr_ethernet_hdr_t* e;
+    sr_ip_hdr_t* ip;
+    uint16_t* udp;
+    uint32_t src;
+    unsigned int i, n = 0;
+
+    /* -- no hosts in IP_CONFIG, aim at the routes -- */
+    if (n_dests == 0)
+    {
+        for (rt = routes; rt && n_dests < VNSD_FLOWS; rt = rt->next)
+        {
+            dests[n_dests++] = rt->mask.s_addr == 0xffffffff ?
+                rt->dest.s_addr : (rt->dest.s_addr | htonl(1));
+        }
+    }
+    for (i = 0; i < n_dests; i++)
+    {
+        nh = sr_fib_lookup(fib, ntohl(dests[i]));
+        if (nh && strcmp(fib->ifnames[nh->iface], vnsd.in->name))
+        { dests[n++] = dests[i]; }
+    }
+    if (n == 0)
+    {
+        fprintf(stderr, "sr_vnsd: nothing routed away from %s\n",
+                vnsd.in->name);
+        return -1;
+    }
+
+    vnsd.frames = (struct vnsd_frame*)calloc(n_flows, sizeof(struct vnsd_frame));
+    assert(vnsd.frames);
+    for (i = 0; i < n_flows; i++)
+    {
+        vnsd.frames[i].buf = (uint8_t*)calloc(1, size);
+        vnsd.frames[i].len = size;
+        e = (sr_ethernet_hdr_t*)vnsd.frames[i].buf;
+        ip = (sr_ip_hdr_t*)(e + 1);
+        udp = (uint16_t*)(ip + 1);
+
+        src = htonl(0xc6120000 | (i & 0x1ffff));    /* 198.18.0.0/15 */
+        memcpy(e->ether_dhost, vnsd.in->mac, ETHER_ADDR_LEN);
+        vnsd_host_mac(src, e->ether_shost);
+        e->ether_type = htons(ethertype_ip);
+        ip->ip_v = 4;
+        ip->ip_hl = 5;
+        ip->ip_len = htons(size - sizeof(sr_ethernet_hdr_t));
+        ip->ip_ttl = 64;
+        ip->ip_p = IPPROTO_UDP;
+        ip->ip_src = src;
+        ip->ip_dst = dests[i % n];
+        udp[0] = htons(1024 + (i & 0x7fff));
+        udp[1] = htons(9);                                  /* discard */
+        udp[2] = htons(size - sizeof(sr_ethernet_hdr_t) - sizeof(sr_ip_hdr_t));
+        udp[3] = 0;                                         /* no checksum */
+    }
+    vnsd.n_frames = n_flows;
+    return 0;
+} /* -- vnsd_flows -- */
+
+/*---------------------------------------------------------------------
+ * Method: vnsd_pcap(..)
+ * Scope:  Local
+ *
+ * Load the IPv4 frames of a pcap file, readdressed to the ingress.
+ *
+ *---------------------------------------------------------------------*/
+
+static int vnsd_pcap(const char* path)
+{
+    FILE* fp;
+    struct pcap_file_header fh;
+    struct pcap_sf_pkthdr ph;
+    sr_ethernet_hdr_t* e;
+    sr_ip_hdr_t* ip;
+    uint8_t buf[65536];
+    unsigned int cap = 0, caplen;
+    int swap;
+
+    if ((fp = fopen(path, "rb")) == 0)
+    {
+        perror("fopen(..):pcap");
+        return -1;
+    }
+    if (fread(&fh, sizeof(fh), 1, fp) != 1 ||
+        (fh.magic != TCPDUMP_MAGIC && fh.magic != 0xd4c3b2a1))
+    {
+        fprintf(stderr, "sr_vnsd: %s is not a pcap file\n", path);
+        fclose(fp);
+        return -1;
+    }
+    swap = fh.magic != TCPDUMP_MAGIC;
+
+    while (fread(&ph, sizeof(ph), 1, fp) == 1)
+    {
+        caplen = swap ? __builtin_bswap32(ph.caplen) : ph.caplen;
+        if (caplen > sizeof(buf) || fread(buf, 1, caplen, fp) != caplen)
+        { break; }
+
+        e = (sr_ethernet_hdr_t*)buf;
+        ip = (sr_ip_hdr_t*)(e + 1);
+        if (caplen < sizeof(*e) + sizeof(*ip) || caplen > 1514 ||
+            e->ether_type != htons(ethertype_ip) || ip->ip_v != 4)
+        { continue; }
+
+        memcpy(e->ether_dhost, vnsd.in->mac, ETHER_ADDR_LEN);
+        vnsd_host_mac(ip->ip_src, e->ether_shost);
+        if (ip->ip_ttl < 2)
+        { ip->ip_ttl = 64; }
+
+        if (vnsd.n_frames == cap)
+        {
+            cap = cap ? cap * 2 : 1024;
+            vnsd.frames = (struct vnsd_frame*)
+                realloc(vnsd.frames, cap * sizeof(struct vnsd_frame));
+            assert(vnsd.frames);
+        }
+        vnsd.frames[vnsd.n_frames].buf = (uint8_t*)malloc(caplen);
+        memcpy(vnsd.frames[vnsd.n_frames].buf, buf, caplen);
+        vnsd.frames[vnsd.n_frames++].len = caplen;
+    }
+    fclose(fp);
+
+    if (vnsd.n_frames == 0)
+    {
+        fprintf(stderr, "sr_vnsd: no IPv4 frames in %s\n", path);
+        return -1;
+    }
+    printf("Replaying %u frames from %s\n", vnsd.n_frames, path);
+    return 0;
+} /* -- vnsd_pcap -- */
+
+/*---------------------------------------------------------------------
+ * Method: vnsd_session(..)
+ * Scope:  Local
+ *
+ * Authenticate the router, answer its open and describe the hardware.
+ *
+ *---------------------------------------------------------------------*/
+
+static int vnsd_session(const char* key_file, const char* rtable)
+{
+    static uint8_t buf[65536];
+    uint8_t salt[VNSD_SALT];
+    char key[VNSD_AUTH_KEY + 1];
+    c_auth_reply* ar;
+    c_base* b = (c_base*)buf;
+    c_hwinfo* hw;
+    SHA1Context sha1;
+    FILE* fp;
+    uint32_t len, ulen;
+    unsigned int i, n;
+    int type, ok = 1;
+
+    /* -- VNS_AUTH_REQUEST -- */
+    for (i = 0; i < VNSD_SALT; i++)
+    { salt[i] = (uint8_t)rand(); }
+    b->mLen = htonl(sizeof(c_base) + VNSD_SALT);
+    b->mType = htonl(VNS_AUTH_REQUEST);
+    memcpy(buf + sizeof(c_base), salt, VNSD_SALT);
+    if (vnsd_write(buf, sizeof(c_base) + VNSD_SALT) != 0 ||
+        vnsd_read_msg(buf, sizeof(buf), &len) != VNS_AUTH_REPLY)
+    { return -1; }
+
+    /* -- check the salted key if we have one, see sr_handle_auth_request -- */
+    ar = (c_auth_reply*)buf;
+    ulen = ntohl(ar->usernameLen);
+    if (key_file && (fp = fopen(key_file, "r")) != 0)
+    {
+        if (fgets(key, sizeof(key), fp) == key &&
+            strlen(key) == VNSD_AUTH_KEY && ulen <= len - sizeof(*ar) &&
+            len - sizeof(*ar) - ulen == VNSD_SHA1_LEN)
+        {
+            SHA1Reset(&sha1);
+            SHA1Input(&sha1, salt, VNSD_SALT);
+            SHA1Input(&sha1, (unsigned char*)key, VNSD_AUTH_KEY);
+            SHA1Result(&sha1);
+            for (i = 0; i < 5; i++)
+            { sha1.Message_Digest[i] = htonl(sha1.Message_Digest[i]); }
+            ok = memcmp(ar->username + ulen, sha1.Message_Digest,
+                        VNSD_SHA1_LEN) == 0;
+        }
+        else
+        { ok = 0; }
+        fclose(fp);
+    }
+    printf("Router user %.*s %s\n", (int)(ulen < 32 ? ulen : 32),
+           ar->username, ok ? "authenticated" : "rejected");
+
+    b->mLen = htonl(sizeof(c_base) + 1);
+    b->mType = htonl(VNS_AUTH_STATUS);
+    buf[sizeof(c_base)] = (uint8_t)ok;
+    if (vnsd_write(buf, sizeof(c_base) + 1) != 0 || !ok)
+    { return -1; }
+
+    /* -- VNSOPEN, or VNS_OPEN_TEMPLATE which wants the rtable -- */
+    type = vnsd_read_msg(buf, sizeof(buf), &len);
+    if (type == VNS_OPEN_TEMPLATE)
+    {
+        c_rtable* r = (c_rtable*)buf;
+        char host[IDSIZE];
+
+        memcpy(host, ((c_open_template*)buf)->mVirtualHostID, IDSIZE);
+        memcpy(r->mVirtualHostID, host, IDSIZE);
+        n = 0;
+        if ((fp = fopen(rtable, "r")) != 0)
+        {
+            n = fread(r->rtable, 1, sizeof(buf) - sizeof(*r), fp);
+            fclose(fp);
+        }
+        r->mLen = htonl(sizeof(*r) + n);
+        r->mType = htonl(VNS_RTABLE);
+        if (vnsd_write(buf, sizeof(*r) + n) != 0)
+        { return -1; }
+    }
+    else if (type != VNSOPEN)
+    {
+        fprintf(stderr, "sr_vnsd: expected an open, got %d\n", type);
+        return -1;
+    }
+
+    /* -- VNSHWINFO -- */
+    memset(buf, 0, sizeof(buf));
+    hw = (c_hwinfo*)buf;
+    for (i = 0, n = 0; i < vnsd.n_ifs; i++)
+    {
+        hw->mHWInfo[n].mKey = htonl(HWINTERFACE);
+        strncpy(hw->mHWInfo[n++].value, vnsd.ifs[i].name, 31);
+        hw->mHWInfo[n].mKey = htonl(HWETHER);
+        memcpy(hw->mHWInfo[n++].value, vnsd.ifs[i].mac, ETHER_ADDR_LEN);
+        hw->mHWInfo[n].mKey = htonl(HWETHIP);
+        memcpy(hw->mHWInfo[n++].value, &vnsd.ifs[i].ip, 4);
+        hw->mHWInfo[n].mKey = htonl(HWMASK);
+        memset(hw->mHWInfo[n++].value, 0xff, 3);
+    }
+    hw->mLen = htonl(2 * sizeof(uint32_t) + n * sizeof(c_hw_entry));
+    hw->mType = htonl(VNSHWINFO);
+    return vnsd_write(buf, 2 * sizeof(uint32_t) + n * sizeof(c_hw_entry));
+} /* -- vnsd_session -- */
+
+/*---------------------------------------------------------------------
+ * Method: vnsd_rx(..)
+ * Scope:  Local
+ *
+ * Receive thread: answer ARP, match forwarded frames.
+ *
+ *---------------------------------------------------------------------*/
+
+static void vnsd_arp_reply(const char* iface, const sr_arp_hdr_t* req)
+{
+    struct
+    {
+        c_packet_header h;
+        sr_ethernet_hdr_t e;
+        sr_arp_hdr_t a;
+    } __attribute__ ((packed)) m;
+    uint8_t mac[ETHER_ADDR_LEN];
+
+    vnsd_host_mac(req->ar_tip, mac);
+    memset(&m, 0, sizeof(m));
+    m.h.mLen = htonl(sizeof(m));
+    m.h.mType = htonl(VNSPACKET);
+    strncpy(m.h.mInterfaceName, iface, sizeof(m.h.mInterfaceName) - 1);
+    memcpy(m.e.ether_dhost, req->ar_sha, ETHER_ADDR_LEN);
+    memcpy(m.e.ether_shost, mac, ETHER_ADDR_LEN);
+    m.e.ether_type = htons(ethertype_arp);
+    m.a = *req;
+    m.a.ar_op = htons(arp_op_reply);
+    memcpy(m.a.ar_sha, mac, ETHER_ADDR_LEN);
+    m.a.ar_sip = req->ar_tip;
+    memcpy(m.a.ar_tha, req->ar_sha, ETHER_ADDR_LEN);
+    m.a.ar_tip = req->ar_sip;
+
+    pthread_mutex_lock(&vnsd.tx_lock);
+    vnsd_write(&m, sizeof(m));
+    pthread_mutex_unlock(&vnsd.tx_lock);
+} /* -- vnsd_arp_reply -- */
+
+static void vnsd_frame_in(const char* iface, uint8_t* frame, unsigned int len)
+{
+    sr_ethernet_hdr_t* e = (sr_ethernet_hdr_t*)frame;
+    sr_ip_hdr_t* ip = (sr_ip_hdr_t*)(e + 1);
+    sr_arp_hdr_t* a = (sr_arp_hdr_t*)(e + 1);
+    uint64_t sent, lat;
+    unsigned int i;
+
+    if (len >= sizeof(*e) + sizeof(*a) &&
+        e->ether_type == htons(ethertype_arp) &&
+        a->ar_op == htons(arp_op_request))
+    {
+        vnsd.arps++;
+        vnsd_arp_reply(iface, a);
+        return;
+    }
+    if (len < sizeof(*e) + sizeof(*ip) || e->ether_type != htons(ethertype_ip) ||
+        (sent = vnsd.sent_ns[ntohs(ip->ip_id)]) == 0)
+    {
+        vnsd.other++;
+        return;
+    }
+
+    vnsd.sent_ns[ntohs(ip->ip_id)] = 0;
+    if (!vnsd.measure)
+    { return; }
+
+    lat = (now_ns() - sent) / 1000;
+    vnsd.hist[lat < VNSD_HIST_US ? lat : VNSD_HIST_US]++;
+    vnsd.lat_sum += lat;
+    if (lat < vnsd.lat_min)
+    { vnsd.lat_min = lat; }
+    if (lat > vnsd.lat_max)
+    { vnsd.lat_max = lat; }
+    for (i = 0; i < vnsd.n_ifs; i++)
+    {
+        if (!strcmp(vnsd.ifs[i].name, iface))
+        {
+            vnsd.ifs[i].rx++;
+            break;
+        }
+    }
+    __sync_synchronize();
+    vnsd.fwd++;
+} /* -- vnsd_frame_in -- */
+
+static void* vnsd_rx(void* arg)
+{
+    static uint8_t buf[65536];
+    c_packet_header* h = (c_packet_header*)buf;
+    uint32_t len;
+    int type;
+
+    (void)arg;
+    while ((type = vnsd_read_msg(buf, sizeof(buf), &len)) > 0)
+    {
+        if (type == VNSCLOSE)
+        { break; }
+        if (type != VNSPACKET || len < sizeof(*h) + sizeof(sr_ethernet_hdr_t))
+        { continue; }
+        h->mInterfaceName[sizeof(h->mInterfaceName) - 1] = '\0';
+        vnsd_frame_in(h->mInterfaceName, buf + sizeof(*h), len - sizeof(*h));
+    }
+    vnsd.closed = 1;
+    return 0;
+} /* -- vnsd_rx -- */
+
+/*---------------------------------------------------------------------
+ * Method: vnsd_send(..)
+ * Scope:  Local
+ *
+ * Inject n frames in one write, stamping each with the next sequence
+ * number.
+ *
+ *---------------------------------------------------------------------*/
+
+static int vnsd_send(unsigned long* seq, unsigned int n)
+{
+    static uint8_t buf[VNSD_BATCH * (sizeof(c_packet_header) + 1514)];
+    static unsigned int next;
+    struct vnsd_frame* f;
+    c_packet_header* h;
+    sr_ip_hdr_t* ip;
+    uint8_t* p = buf;
+    uint16_t id;
+    uint64_t t = now_ns();
+    unsigned int i;
+    int ret;
+
+    for (i = 0; i < n; i++)
+    {
+        f = &vnsd.frames[next];
+        next = (next + 1) % vnsd.n_frames;
+
+        h = (c_packet_header*)p;
+        h->mLen = htonl(sizeof(*h) + f->len);
+        h->mType = htonl(VNSPACKET);
+        memset(h->mInterfaceName, 0, sizeof(h->mInterfaceName));
+        strncpy(h->mInterfaceName, vnsd.in->name, sizeof(h->mInterfaceName) - 1);
+        memcpy(p + sizeof(*h), f->buf, f->len);
+
+        id = (uint16_t)(*seq)++;
+        ip = (sr_ip_hdr_t*)(p + sizeof(*h) + sizeof(sr_ethernet_hdr_t));
+        ip->ip_id = htons(id);
+        ip->ip_sum = 0;
+        ip->ip_sum = cksum(ip, ip->ip_hl * 4);
+        vnsd.sent_ns[id] = t;
+
+        p += sizeof(*h) + f->len;
+    }
+
+    pthread_mutex_lock(&vnsd.tx_lock);
+    ret = vnsd_write(buf, p - buf);
+    pthread_mutex_unlock(&vnsd.tx_lock);
+    return ret;
+} /* -- vnsd_send -- */
+
+static unsigned long vnsd_percentile(unsigned long n, double q)
+{
+    unsigned long want = (unsigned long)(n * q), seen = 0;
+    unsigned long i;
+
+    for (i = 0; i <= VNSD_HIST_US; i++)
+    {
+        seen += vnsd.hist[i];
+        if (seen > want)
+        { return i; }
+    }
+    return VNSD_HIST_US;
+} /* -- vnsd_percentile -- */
+
+/*---------------------------------------------------------------------
+ * Method: vnsd_run(..)
+ * Scope:  Local
+ *
+ *---------------------------------------------------------------------*/
+
+static void vnsd_run(unsigned long pps, unsigned long count, double secs)
+{
+    uint64_t start, now, end, last_change;
+    unsigned long seq = 1, sent = 0, due, fwd, written_off = 0;
+    unsigned int i, batch;
+    struct timespec nap = { 0, 20000 };
+
+    /* -- one of everything first, so that ARP is resolved -- */
+    for (i = 0; i < vnsd.n_frames && i < 4096; i += batch)
+    {
+        batch = vnsd.n_frames - i < VNSD_BATCH ? vnsd.n_frames - i : VNSD_BATCH;
+        vnsd_send(&seq, batch);
+    }
+    usleep(500000);
+    memset((void*)vnsd.sent_ns, 0, sizeof(vnsd.sent_ns));
+    vnsd.lat_min = ~0ull;
+    vnsd.measure = 1;
+
+    start = now_ns();
+    end = start + (uint64_t)(secs * 1e9);
+    fwd = 0;
+    last_change = start;
+    while (!vnsd.closed && (count == 0 || sent < count))
+    {
+        now = now_ns();
+        if (secs > 0 && now >= end)
+        { break; }
+        if (vnsd.fwd != fwd)
+        {
+            fwd = vnsd.fwd;
+            last_change = now;
+        }
+        due = pps ? (unsigned long)((now - start) * 1e-9 * pps) - sent :
+                    VNSD_BATCH;
+        if (count && due > count - sent)
+        { due = count - sent; }
+        if (due == 0)
+        {
+            nanosleep(&nap, 0);
+            continue;
+        }
+        batch = due < VNSD_BATCH ? due : VNSD_BATCH;
+
+        /* -- keep ids unique; what is still out after a stall is lost -- */
+        if (sent - fwd - written_off + batch > VNSD_WINDOW)
+        {
+            if (now - last_change < VNSD_STALL_NS)
+            {
+                nanosleep(&nap, 0);
+                continue;
+            }
+            written_off = sent - fwd;
+        }
+        if (vnsd_send(&seq, batch) != 0)
+        { break; }
+        sent += batch;
+    }
+    end = now_ns();
+
+    /* -- drain: wait until nothing has come back for half a second -- */
+    fwd = vnsd.fwd;
+    last_change = now_ns();
+    while (!vnsd.closed && fwd < sent && now_ns() - last_change < 500000000ull)
+    {
+        usleep(10000);
+        if (vnsd.fwd != fwd)
+        {
+            fwd = vnsd.fwd;
+            last_change = now_ns();
+        }
+    }
+    vnsd.measure = 0;
+    __sync_synchronize();
+    fwd = vnsd.fwd;
+
+    printf("sent      %lu frames in %.3f s, %.0f pps offered\n", sent,
+           (end - start) * 1e-9, sent / ((end - start) * 1e-9));
+    printf("forwarded %lu, %.0f pps\n", fwd, fwd / ((end - start) * 1e-9));
+    printf("dropped   %lu (%.3f%%)\n", sent - fwd,
+           sent ? 100.0 * (sent - fwd) / sent : 0.0);
+    if (fwd > 0)
+    {
+        printf("latency   us min %llu avg %.1f p50 %lu p90 %lu p99 %lu "
+               "max %llu\n", (unsigned long long)vnsd.lat_min,
+               (double)vnsd.lat_sum / fwd, vnsd_percentile(fwd, 0.5),
+               vnsd_percentile(fwd, 0.9), vnsd_percentile(fwd, 0.99),
+               (unsigned long long)vnsd.lat_max);
+    }
+    for (i = 0; i < vnsd.n_ifs; i++)
+    {
+        if (vnsd.ifs[i].rx)
+        { printf("  out %-8s %lu\n", vnsd.ifs[i].name, vnsd.ifs[i].rx); }
+    }
+    printf("other     %lu frames from the router, %lu ARP requests\n",
+           vnsd.other, vnsd.arps);
+} /* -- vnsd_run -- */
+
+static void usage(char* argv0)
+{
+    printf("Format: %s [-h] [-p port] [-c IP_CONFIG] [-r rtable] \n", argv0);
+    printf("           [-k auth_key] [-i ingress interface] \n");
+    printf("           [-f pcap file | -F flows] [-s frame bytes] \n");
+    printf("           [-R pps, 0 = as fast as possible] \n");
+    printf("           [-n frames] [-d seconds] [-x router command] \n");
+} /* -- usage -- */
+
+int main(int argc, char** argv)
+{
+    unsigned int port = VNSD_PORT;
+    char* ip_config = "IP_CONFIG";
+    char* rtable = "rtable";
+    char* key_file = "auth_key";
+    char* ingress = 0;
+    char* pcap = 0;
+    char* spawn = 0;
+    unsigned int n_flows = VNSD_FLOWS;
+    unsigned int size = VNSD_FRAME;
+    unsigned long pps = 0, count = 0;
+    double secs = 0;
+    uint32_t dests[256];
+    unsigned int n_dests, i;
+    struct sr_rt* routes;
+    struct sr_rt* rt;
+    struct sr_fib* fib;
+    struct sockaddr_in addr;
+    pthread_t rx;
+    pid_t child = 0;
+    int lfd, one = 1, c, status;
+
+    while ((c = getopt(argc, argv, "hp:c:r:k:i:f:F:s:R:n:d:x:")) != EOF)
+    {
+        switch (c)
+        {
+            case 'p':
+                port = atoi(optarg);
+                break;
+            case 'c':
+                ip_config = optarg;
+                break;
+            case 'r':
+                rtable = optarg;
+                break;
+            case 'k':
+                key_file = optarg;
+                break;
+            case 'i':
+                ingress = optarg;
+                break;
+            case 'f':
+                pcap = optarg;
+                break;
+            case 'F':
+                n_flows = atoi(optarg);
+                break;
+            case 's':
+                size = atoi(optarg);
+                break;
+            case 'R':
+                pps = strtoul(optarg, 0, 10);
+                break;
+            case 'n':
+                count = strtoul(optarg, 0, 10);
+                break;
+            case 'd':
+                secs = atof(optarg);
+                break;
+            case 'x':
+                spawn = optarg;
+                break;
+            default:
+                usage(argv[0]);
+                return c == 'h' ? 0 : 2;
+        }
+    }
+    if (count == 0 && secs == 0)
+    { secs = 5; }
+    if (n_flows == 0)
+    { n_flows = 1; }
+    if (size < VNSD_FRAME)
+    { size = VNSD_FRAME; }
+    if (size > 1514)
+    { size = 1514; }
+
+    /* -- topology -- */
+    if (sr_rt_read(rtable, &routes) != 0)
+    { return 1; }
+    fib = sr_fib_build(routes);
+    n_dests = vnsd_topology(ip_config, routes, dests, 256);
+    if (vnsd.n_ifs == 0)
+    {
+        fprintf(stderr, "sr_vnsd: no router interfaces\n");
+        return 1;
+    }
+    vnsd.in = &vnsd.ifs[0];
+    for (rt = routes; rt && !ingress; rt = rt->next)
+    {
+        if (rt->mask.s_addr == 0)
+        { ingress = rt->interface; }
+    }
+    for (i = 0; ingress && i < vnsd.n_ifs; i++)
+    {
+        if (!strcmp(vnsd.ifs[i].name, ingress))
+        { vnsd.in = &vnsd.ifs[i]; }
+    }
+    if (pcap ? vnsd_pcap(pcap) : vnsd_flows(fib, routes, dests, n_dests,
+                                            n_flows, size))
+    { return 1; }
+    for (i = 0; i < vnsd.n_ifs; i++)
+    {
+        addr.sin_addr.s_addr = vnsd.ifs[i].ip;
+        printf("%s %s%s\n", vnsd.ifs[i].name, inet_ntoa(addr.sin_addr),
+               &vnsd.ifs[i] == vnsd.in ? " (ingress)" : "");
+    }
+
+    /* -- wait for the router -- */
+    lfd = socket(AF_INET, SOCK_STREAM, 0);
+    setsockopt(lfd, SOL_SOCKET, SO_REUSEADDR, &one, sizeof(one));
+    memset(&addr, 0, sizeof(addr));
+    addr.sin_family = AF_INET;
+    addr.sin_port = htons(port);
+    addr.sin_addr.s_addr = htonl(INADDR_ANY);
+    if (bind(lfd, (struct sockaddr*)&addr, sizeof(addr)) < 0 ||
+        listen(lfd, 1) < 0)
+    {
+        perror("bind(..):sr_vnsd");
+        return 1;
+    }
+    printf("Listening on port %u\n", port);
+    fflush(stdout);
+
+    if (spawn && (child = fork()) == 0)
+    {
+        freopen("/dev/null", "w", stdout);
+        execl("/bin/sh", "sh", "-c", spawn, (char*)0);
+        _exit(127);
+    }
+
+    if ((vnsd.fd = accept(lfd, 0, 0)) < 0)
+    {
+        perror("accept(..):sr_vnsd");
+        return 1;
+    }
+    close(lfd);
+    setsockopt(vnsd.fd, IPPROTO_TCP, TCP_NODELAY, &one, sizeof(one));
+    pthread_mutex_init(&vnsd.tx_lock, 0);
+    srand((unsigned int)now_ns());
+
+    if (vnsd_session(key_file, rtable) != 0)
+    {
+        fprintf(stderr, "sr_vnsd: session set up failed\n");
+        return 1;
+    }
+    pthread_create(&rx, 0, vnsd_rx, 0);
+    usleep(200000);     /* router loads its table after HWINFO */
+
+    vnsd_run(pps, count, secs);
+
+    shutdown(vnsd.fd, SHUT_RDWR);
+    pthread_join(rx, 0);
+    close(vnsd.fd);
+    if (child > 0)
+    {
+        kill(child, SIGTERM);
+        waitpid(child, &status, 0);
+    }
+    sr_fib_destroy(fib);
+    sr_rt_free(routes);
+    return 0;
+} /* -- main -- */
@@ -0,0 +1,321 @@
+/*-----------------------------------------------------------------------------
+ * file:  sr_worker.c
+ *
+ * Description:
+ *
+ * Flow hashed forwarding workers, see sr_worker.h.
+ *
+ *---------------------------------------------------------------------------*/
+
+#include <stdio.h>
+#include <stdlib.h>
+#include <assert.h>
+#include <string.h>
+#include <unistd.h>
+#include <sched.h>
+
+#include <netinet/in.h>
+#include <arpa/inet.h>
+
+#include "sr_worker.h"
+#include "sr_router.h"
+#include "sr_protocol.h"
+#include "sr_utils.h"
+#include "sr_pool.h"
+#include "sr_dcache.h"
+
+#define SR_WORKER_SPIN  256     /* empty polls before sleeping */
+
+/* avalanche the bits so any mask of the result is usable */
+static uint32_t flow_mix(uint32_t h)
+{
+    h ^= h >> 16;
+    h *= 0x85ebca6bu;
+    h ^= h >> 13;
+    h *= 0xc2b2ae35u;
+    h ^= h >> 16;
+    return h;
+}
+
+/*---------------------------------------------------------------------
+ * Method: sr_flow_hash(..)
+ * Scope:  Global
+ *
+ *---------------------------------------------------------------------*/
+
+uint32_t sr_flow_hash(const uint8_t* frame, unsigned int len)
+{
+    const sr_ip_hdr_t* iphdr;
+    const sr_arp_hdr_t* arphdr;
+    uint32_t h;
+    uint16_t ports[2];
+    unsigned int hl;
+
+    if (len < sizeof(sr_ethernet_hdr_t))
+    { return 0; }
+
+    if (ethertype((uint8_t*)frame) == ethertype_arp)
+    {
+        if (len < sizeof(sr_ethernet_hdr_t) + sizeof(sr_arp_hdr_t))
+        { return 0; }
+        arphdr = (const sr_arp_hdr_t*)(frame + sizeof(sr_ethernet_hdr_t));
+        return flow_mix(arphdr->ar_sip);
+    }
+
+    if (ethertype((uint8_t*)frame) != ethertype_ip ||
+        len < sizeof(sr_ethernet_hdr_t) + sizeof(sr_ip_hdr_t))
+    { return 0; }
+
+    iphdr = (const sr_ip_hdr_t*)(frame + sizeof(sr_ethernet_hdr_t));
+    h = flow_mix(iphdr->ip_src) ^ iphdr->ip_dst;
+    h = flow_mix(h ^ iphdr->ip_p);
+
+    /* -- ports only on the first fragment of TCP / UDP -- */
+    hl = iphdr->ip_hl * 4;
+    if ((iphdr->ip_p == 6 || iphdr->ip_p == 17) &&
+        (ntohs(iphdr->ip_off) & 0x1fff) == 0 &&
+        len >= sizeof(sr_ethernet_hdr_t) + hl + 4)
+    {
+        memcpy(ports, frame + sizeof(sr_ethernet_hdr_t) + hl, 4);
+        h = flow_mix(h ^ ((uint32_t)ports[0] << 16 | ports[1]));
+    }
+    return h;
+} /* -- sr_flow_hash -- */
+
+/*---------------------------------------------------------------------
+ * Method: sr_ring_pop(..)
+ * Scope:  Local
+ *
+ * Take up to max frames off a worker's ring.
+ *
+ *---------------------------------------------------------------------*/
+
+static unsigned int sr_ring_pop(struct sr_ring* ring, struct sr_frame* out,
+                                unsigned int max)
+{
+    unsigned int head = ring->head;
+    unsigned int n = ring->tail - head;
+    unsigned int i;
+
+    if (n > max)
+    { n = max; }
+    __sync_synchronize();   /* read slots after seeing tail */
+    for (i = 0; i < n; i++)
+    { out[i] = ring->slots[(head + i) & (SR_RING_SZ - 1)]; }
+    __sync_synchronize();   /* done with slots before releasing them */
+    ring->head = head + n;
+    return n;
+} /* -- sr_ring_pop -- */
+
+static void sr_worker_pin(pthread_t thread, int cpu)
+{
+#if defined(_LINUX_) && defined(CPU_SET)
+    cpu_set_t set;
+    long ncpu = sysconf(_SC_NPROCESSORS_ONLN);
+
+    if (cpu < 0 || ncpu <= 0)
+    { return; }
+    CPU_ZERO(&set);
+    CPU_SET(cpu % ncpu, &set);
+    if (pthread_setaffinity_np(thread, sizeof(set), &set) != 0)
+    { fprintf(stderr, "*warning* could not pin thread to cpu %d\n", cpu); }
+#else
+    (void)thread;
+    (void)cpu;
+#endif
+} /* -- sr_worker_pin -- */
+
+/*---------------------------------------------------------------------
+ * Method: sr_worker_main(..)
+ * Scope:  Local
+ *
+ * Worker loop: pop a burst, run it through the router, return the
+ * buffers and flush what the burst sent.  Spins briefly when idle, then
+ * sleeps until the reader signals.
+ *
+ *---------------------------------------------------------------------*/
+
+static void* sr_worker_main(void* arg)
+{
+    struct sr_worker* w = (struct sr_worker*)arg;
+    struct sr_instance* sr = w->sr;
+    struct sr_frame burst[SR_BURST_MAX];
+    unsigned int n, i, idle = 0;
+
+    sr_dcache_bind(w->dcache);
+    sr_send_thread_queue(w->txq);
+
+    while (1)
+    {
+        n = sr_ring_pop(&w->ring, burst, SR_BURST_MAX);
+        if (n == 0)
+        {
+            if (++idle < SR_WORKER_SPIN)
+            {
+                sched_yield();
+                continue;
+            }
+            pthread_mutex_lock(&w->lock);
+            w->sleeping = 1;
+            __sync_synchronize();   /* pairs with sr_workers_dispatch */
+            while (w->ring.head == w->ring.tail)
+            { pthread_cond_wait(&w->wake, &w->lock); }
+            w->sleeping = 0;
+            pthread_mutex_unlock(&w->lock);
+            idle = 0;
+            continue;
+        }
+        idle = 0;
+
+        sr_handlepacket_burst(sr, burst, n);
+        for (i = 0; i < n; i++)
+        { sr_pool_put(sr->pool, burst[i].buf); }
+        w->frames += n;
+        sr_send_flush(sr);
+    }
+    return 0;
+} /* -- sr_worker_main -- */
+
+/*---------------------------------------------------------------------
+ * Method: sr_workers_start(..)
+ * Scope:  Global
+ *
+ *---------------------------------------------------------------------*/
+
+int sr_workers_start(struct sr_instance* sr, unsigned int n, int first_cpu)
+{
+    struct sr_workers* ws;
+    unsigned int i;
+
+    /* -- REQUIRES -- */
+    assert(sr);
+    assert(sr->workers == 0);
+
+    if (n == 0 || n > SR_WORKER_MAX)
+    {
+        fprintf(stderr, "Error: worker count must be 1..%d\n", SR_WORKER_MAX);
+        return -1;
+    }
+
+    ws = (struct sr_workers*)calloc(1, sizeof(struct sr_workers));
+    assert(ws);
+    ws->n = n;
+
+    for (i = 0; i < n; i++)
+    {
+        struct sr_worker* w = &ws->w[i];
+
+        w->sr = sr;
+        w->id = i;
+        w->cpu = first_cpu >= 0 ? first_cpu + (int)i : -1;
+        w->ring.slots = (struct sr_frame*)calloc(SR_RING_SZ,
+                                                 sizeof(struct sr_frame));
+        w->dcache = sr_dcache_create();
+        w->txq = sr_txq_create();
+        assert(w->ring.slots && w->txq);
+        pthread_mutex_init(&w->lock, 0);
+        pthread_cond_init(&w->wake, 0);
+    }
+
+    /* -- publish before any frame can be dispatched -- */
+    sr->workers = ws;
+
+    for (i = 0; i < n; i++)
+    {
+        if (pthread_create(&ws->w[i].thread, 0, sr_worker_main, &ws->w[i]))
+        {
+            perror("pthread_create(..):sr_workers_start");
+            return -1;
+        }
+        pthread_detach(ws->w[i].thread);
+        sr_worker_pin(ws->w[i].thread, ws->w[i].cpu);
+    }
+
+    /* -- housekeeping threads go next to the workers -- */
+    if (first_cpu >= 0)
+    {
+        sr_worker_pin(sr->arp_thread, first_cpu + (int)n);
+        if (sr->nat)
+        { sr_worker_pin(sr->nat->thread, first_cpu + (int)n); }
+    }
+
+    printf("Forwarding on %u worker thread%s\n", n, n > 1 ? "s" : "");
+    return 0;
+} /* -- sr_workers_start -- */
+
+/*---------------------------------------------------------------------
+ * Method: sr_input_burst(..)
+ * Scope:  Global
+ *
+ *---------------------------------------------------------------------*/
+
+void sr_input_burst(struct sr_instance* sr, struct sr_frame* frames,
+                    unsigned int n)
+{
+    if (sr->workers)
+    { sr_workers_dispatch(sr, frames, n); }
+    else
+    { sr_handlepacket_burst(sr, frames, n); }
+} /* -- sr_input_burst -- */
+
+/*---------------------------------------------------------------------
+ * Method: sr_workers_dispatch(..)
+ * Scope:  Global
+ *
+ * Called on the reader thread only, the single producer of every ring.
+ * A frame whose worker ring is full is dropped and counted.
+ *
+ *---------------------------------------------------------------------*/
+
+void sr_workers_dispatch(struct sr_instance* sr, struct sr_frame* frames,
+                         unsigned int n)
+{
+    struct sr_workers* ws = sr->workers;
+    uint32_t pending = 0;   /* workers that got frames, as a bit set */
+    unsigned int i;
+
+    for (i = 0; i < n; i++)
+    {
+        struct sr_frame* f = &frames[i];
+        struct sr_worker* w;
+        struct sr_ring* ring;
+        uint8_t* copy;
+
+        if (f->len > SR_POOL_BUFSZ)
+        { continue; }
+
+        w = &ws->w[sr_flow_hash(f->buf, f->len) % ws->n];
+        ring = &w->ring;
+        if (ring->tail - ring->head == SR_RING_SZ)
+        {
+            w->drops++;
+            continue;
+        }
+
+        copy = sr_pool_get(sr->pool);
+        memcpy(copy, f->buf, f->len);
+        ring->slots[ring->tail & (SR_RING_SZ - 1)].buf = copy;
+        ring->slots[ring->tail & (SR_RING_SZ - 1)].len = f->len;
+        ring->slots[ring->tail & (SR_RING_SZ - 1)].iface = f->iface;
+        __sync_synchronize();   /* slot contents before the new tail */
+        ring->tail++;
+        if (w->id < 32)
+        { pending |= 1u << w->id; }
+        else
+        { pending = ~0u; }
+    }
+
+    /* -- wake sleepers once per burst -- */
+    __sync_synchronize();   /* new tails before reading sleeping */
+    for (i = 0; i < ws->n && pending; i++)
+    {
+        struct sr_worker* w = &ws->w[i];
+
+        if ((i >= 32 || (pending & (1u << i))) && w->sleeping)
+        {
+            pthread_mutex_lock(&w->lock);
+            pthread_cond_signal(&w->wake);
+            pthread_mutex_unlock(&w->lock);
+        }
+    }
+} /* -- sr_workers_dispatch -- */
@@ -0,0 +1,95 @@
+/*-----------------------------------------------------------------------------
+ * file:  sr_worker.h
+ *
+ * Description:
+ *
+ * Multi-threaded forwarding.  The thread reading from the server copies
+ * each received frame into a pool buffer and hands it to one of N worker
+ * threads, chosen by a hash of the flow (addresses, protocol and ports)
+ * so that packets of one flow stay in order.  Each worker owns a single
+ * producer, single consumer ring, a destination cache and a TX staging
+ * queue that it flushes after every burst.
+ *
+ *---------------------------------------------------------------------------*/
+
+#ifndef SR_WORKER_H
+#define SR_WORKER_H
+
+#ifdef _LINUX_
+#include <stdint.h>
+#endif /* _LINUX_ */
+
+#ifdef _DARWIN_
+#include <inttypes.h>
+#endif /* _DARWIN_ */
+
+#include <pthread.h>
+
+#define SR_WORKER_MAX   64
+#define SR_RING_SZ      1024    /* frames per worker ring, power of two */
+
+struct sr_instance;
+struct sr_frame;
+struct sr_dcache;
+struct sr_txq;
+
+/* ----------------------------------------------------------------------------
+ * struct sr_ring
+ *
+ * head is only written by the consumer and tail only by the producer.
+ *
+ * -------------------------------------------------------------------------- */
+
+struct sr_ring
+{
+    volatile unsigned int head;
+    char pad0[64 - sizeof(unsigned int)];
+    volatile unsigned int tail;
+    char pad1[64 - sizeof(unsigned int)];
+    struct sr_frame* slots;     /* SR_RING_SZ entries */
+};
+
+struct sr_worker
+{
+    struct sr_instance* sr;
+    unsigned int id;
+    int cpu;                    /* -1 if not pinned */
+    pthread_t thread;
+    struct sr_ring ring;
+    struct sr_dcache* dcache;
+    struct sr_txq* txq;
+    /* -- sleep when idle -- */
+    pthread_mutex_t lock;
+    pthread_cond_t wake;
+    volatile int sleeping;
+    /* -- counters -- */
+    unsigned long frames;
+    unsigned long drops;        /* ring full */
+};
+
+struct sr_workers
+{
+    unsigned int n;
+    struct sr_worker w[SR_WORKER_MAX];
+};
+
+/* Start n workers.  With first_cpu >= 0 worker i is pinned to CPU
+   first_cpu + i and the ARP and NAT timeout threads to the CPU after the
+   last worker (modulo the number of CPUs).  Returns 0 on success. */
+int sr_workers_start(struct sr_instance* sr, unsigned int n, int first_cpu);
+
+/* Forward a received burst inline, or hand it to the workers when there
+   are any.  Called by whatever reads frames: the VNS link or sr_io. */
+void sr_input_burst(struct sr_instance* sr, struct sr_frame* frames,
+                    unsigned int n);
+
+/* Copy frames into pool buffers and queue them on their workers.  Frames
+   are lent and may be reused as soon as this returns. */
+void sr_workers_dispatch(struct sr_instance* sr, struct sr_frame* frames,
+                         unsigned int n);
+
+/* Flow hash of an Ethernet frame: 5-tuple for TCP/UDP, addresses and
+   protocol for other IP, sender address for ARP. */
+uint32_t sr_flow_hash(const uint8_t* frame, unsigned int len);
+
+#endif /* -- SR_WORKER_H -- */
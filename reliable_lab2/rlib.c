@@ -18,6 +18,7 @@
 #include <signal.h>
 
 #include "rlib.h"
+#include "inet_cksum.h"
 
 char *progname;
 int opt_debug;
@@ -579,17 +580,7 @@ conn_poll (const struct config_common *cc)
 uint16_t
 cksum (const void *_data, int len)
 {
-  const uint8_t *data = _data;
-  uint32_t sum;
-
-  for (sum = 0;len >= 2; data += 2, len -= 2)
-    sum += data[0] << 8 | data[1];
-  if (len > 0)
-    sum += data[0] << 8;
-  while (sum > 0xffff)
-    sum = (sum >> 16) + (sum & 0xffff);
-  sum = htons (~sum);
-  return sum ? sum : 0xffff;
+  return inet_cksum (_data, len);
 }
 
 int